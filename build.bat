@@ -1,2 +1,2 @@
 mkdir build
-gcc -m64 -shared -o build/simgeki_io.dll mu3io.c config.c hid.c util/dprintf.c -I. -lsetupapi
\ No newline at end of file
+gcc -m64 -shared -o build/simgeki_io.dll mu3io.c config.c ini.c hid.c input.c decode.c writeq.c led.c hub.c hotplug.c keyboard.c stats.c report.c trace.c tracepoint.c lever.c calib.c session.c color.c transport_win32.c transport_iocp.c transport_loopback.c util/dprintf.c -I. -lsetupapi -lm
\ No newline at end of file
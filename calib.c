@@ -0,0 +1,167 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util/dprintf.h"
+
+#include "calib.h"
+
+int16_t calib_table[65536];
+
+static calib_state_t state = CALIB_OFF;
+static calib_points_t points;
+static bool have_points = false;
+static uint16_t device_offset = 0;
+static bool device_offset_known = false;
+
+// Learning, as signed distances from the center
+static int64_t learn_start_us;
+static int64_t learn_sum;
+static uint32_t learn_count;
+static int32_t learn_min, learn_max;
+static int64_t settle_start_us;
+
+static int32_t distance(uint16_t raw, uint16_t center) {
+  return (int16_t)(uint16_t)(raw - center);
+}
+
+static void build_table(void) {
+  int32_t left = -distance(points.min, points.center);
+  int32_t right = distance(points.max, points.center);
+
+  for (uint32_t value = 0; value < 65536; value++) {
+    int32_t d = distance((uint16_t)(value + device_offset), points.center);
+    int32_t mapped = d < 0 ? d * CALIB_RANGE / left : d * CALIB_RANGE / right;
+    if (mapped < -CALIB_RANGE) {
+      mapped = -CALIB_RANGE;
+    } else if (mapped > CALIB_RANGE) {
+      mapped = CALIB_RANGE;
+    }
+    calib_table[value] = (int16_t)mapped;
+  }
+}
+
+bool calib_points_valid(const calib_points_t* p) {
+  return distance(p->min, p->center) <= -CALIB_MIN_SPAN &&
+         distance(p->max, p->center) >= CALIB_MIN_SPAN;
+}
+
+uint16_t calib_device_offset(const calib_points_t* p) {
+  return (uint16_t)(p->center - 0x8000);
+}
+
+void calib_init(const calib_points_t* p) {
+  have_points = p != NULL && calib_points_valid(p);
+  if (!have_points) {
+    state = CALIB_OFF;
+    return;
+  }
+
+  points = *p;
+  device_offset = calib_device_offset(&points);
+  build_table();
+  state = CALIB_ACTIVE;
+}
+
+void calib_start(void) {
+  state = device_offset_known ? CALIB_CENTER : CALIB_WAIT_OFFSET;
+  learn_count = 0;
+  dprintf("SimGEKI: Lever calibration: leave the lever at the center, then "
+          "move it to both ends and back to the center.\n");
+}
+
+calib_state_t calib_state(void) {
+  return state;
+}
+
+void calib_on_roller_data(uint16_t value, uint16_t raw) {
+  uint16_t offset = (uint16_t)(raw - value);
+  bool changed = !device_offset_known || offset != device_offset;
+
+  device_offset = offset;
+  device_offset_known = true;
+
+  if (state == CALIB_WAIT_OFFSET) {
+    state = CALIB_CENTER;
+    learn_count = 0;
+  } else if (state == CALIB_ACTIVE && changed) {
+    // The device did not (yet) apply our offset: map what it really sends
+    dprintf("SimGEKI: Lever offset is %04X, rebuilding the calibration.\n",
+            offset);
+    build_table();
+  }
+}
+
+bool calib_observe(uint16_t value, int64_t time_us) {
+  uint16_t raw = (uint16_t)(value + device_offset);
+
+  switch (state) {
+    case CALIB_CENTER:
+      if (learn_count == 0) {
+        learn_start_us = time_us;
+        learn_sum = 0;
+      }
+      // Average around the first sample, which may sit near the wrap point
+      if (learn_count > 0) {
+        learn_sum += distance(raw, points.center);
+      } else {
+        points.center = raw;
+      }
+      learn_count++;
+      if (time_us - learn_start_us >= CALIB_CENTER_US) {
+        points.center =
+            (uint16_t)(points.center + (int32_t)(learn_sum / learn_count));
+        learn_min = learn_max = 0;
+        settle_start_us = -1;
+        state = CALIB_SWEEP;
+        dprintf("SimGEKI: Lever center at %04X, now move it to both ends.\n",
+                points.center);
+      }
+      return false;
+
+    case CALIB_SWEEP: {
+      int32_t d = distance(raw, points.center);
+      if (d < learn_min) {
+        learn_min = d;
+      } else if (d > learn_max) {
+        learn_max = d;
+      }
+      if (learn_min > -CALIB_MIN_SPAN || learn_max < CALIB_MIN_SPAN) {
+        return false;
+      }
+
+      // Both ends seen: wait until the lever rests near the center again
+      int32_t tolerance = (learn_max - learn_min) / 16;
+      if (d < -tolerance || d > tolerance) {
+        settle_start_us = -1;
+        return false;
+      }
+      if (settle_start_us < 0) {
+        settle_start_us = time_us;
+      }
+      if (time_us - settle_start_us < CALIB_SETTLE_US) {
+        return false;
+      }
+
+      points.min = (uint16_t)(points.center + learn_min);
+      points.max = (uint16_t)(points.center + learn_max);
+      have_points = true;
+      build_table();
+      state = CALIB_ACTIVE;
+      dprintf("SimGEKI: Lever calibrated: min %04X, center %04X, max %04X.\n",
+              points.min, points.center, points.max);
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
+
+bool calib_points(calib_points_t* p) {
+  if (!have_points || state != CALIB_ACTIVE) {
+    return false;
+  }
+  *p = points;
+  return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Lever calibration. The device reports roller_value = roller_raw_value -
+   offset, where the offset is set with ROLLER_SET_OFFSET and both values
+   come back in the reply to ROLLER_GET_DATA. Streamed SP_INPUT_GET reports
+   carry roller_value only, so once the offset is known every streamed value
+   is also a raw value.
+
+   Learning: with the lever at the center, the first CALIB_CENTER_US of
+   reports give the center; the operator then moves the lever fully to both
+   sides and back to the center, where it must stay for CALIB_SETTLE_US.
+
+   Mapping: a table over all 65536 streamed values, piecewise linear through
+   min -> -CALIB_RANGE, center -> 0, max -> +CALIB_RANGE and clamped outside,
+   so it is monotonic and costs one lookup per report. Raw positions are
+   taken relative to the center with 16-bit wrap-around, so a sensor whose
+   range crosses 0xFFFF -> 0x0000 calibrates as well.
+
+   Everything except calib_init() runs on the thread that handles reports. */
+
+#define CALIB_RANGE 0x5000           // Lever range the game expects
+#define CALIB_CENTER_US 100000       // Averaged for the center
+#define CALIB_SETTLE_US 500000       // Back at the center this long to finish
+#define CALIB_MIN_SPAN 0x1000        // Required travel to each side
+
+typedef struct {
+  uint16_t min;     // Raw value at the left end
+  uint16_t center;  // Raw value at the center
+  uint16_t max;     // Raw value at the right end
+} calib_points_t;
+
+typedef enum {
+  CALIB_OFF,          // No calibration, report values as they come
+  CALIB_WAIT_OFFSET,  // Learning, waiting for the ROLLER_GET_DATA reply
+  CALIB_CENTER,       // Learning the center
+  CALIB_SWEEP,        // Waiting for both ends and the return to the center
+  CALIB_ACTIVE,       // Mapping through the table
+} calib_state_t;
+
+extern int16_t calib_table[65536];
+
+/* Map streamed roller values through points (NULL = no calibration). The
+   device offset is assumed to be calib_device_offset(points) until a
+   ROLLER_GET_DATA reply says otherwise. */
+void calib_init(const calib_points_t* points);
+
+/* Are points usable: min < center < max, each end CALIB_MIN_SPAN away? */
+bool calib_points_valid(const calib_points_t* points);
+
+/* Offset that centers roller_value at 0x8000, for ROLLER_SET_OFFSET. */
+uint16_t calib_device_offset(const calib_points_t* points);
+
+/* Forget the current mapping and learn new points. Needs a ROLLER_GET_DATA
+   reply first. */
+void calib_start(void);
+
+calib_state_t calib_state(void);
+
+/* Reply to ROLLER_GET_DATA: learns the device offset, and rebuilds the
+   table if it changed. */
+void calib_on_roller_data(uint16_t value, uint16_t raw);
+
+/* Feed one streamed roller value while learning. Returns true once, when
+   new points have been learnt; they are then active, see calib_points(). */
+bool calib_observe(uint16_t value, int64_t time_us);
+
+/* Points in use, false if there are none. */
+bool calib_points(calib_points_t* points);
+
+/* The lever position for a streamed roller value. */
+static inline int16_t calib_map(uint16_t value) {
+  return calib_table[value];
+}
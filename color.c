@@ -0,0 +1,347 @@
+#include "platform.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "color.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define COLOR_X86 1
+#include <immintrin.h>
+#endif
+
+// Work buffers cover whole 32-byte vectors; the tail stays zero
+#define COLOR_FRAME_BYTES (LED_STREAM_LEDS * 3)
+#define COLOR_BUFFER_BYTES ((COLOR_FRAME_BYTES + 31) & ~31)
+// Most input LEDs one downsampled LED can cover (9 -> 1, plus a partial one)
+#define COLOR_MAX_TAPS 10
+
+// Board 0 segments in LED order, see mu3_io_led_set_colors()
+static const uint8_t segment_leds[] = {2, 7, 9, 7, 11, 7, 9, 7, 2};
+static const uint8_t segment_strip[] = {
+    COLOR_STRIP_BUTTONS, COLOR_STRIP_PILLARS,   COLOR_STRIP_PILLARS,
+    COLOR_STRIP_PILLARS, COLOR_STRIP_BILLBOARD, COLOR_STRIP_PILLARS,
+    COLOR_STRIP_PILLARS, COLOR_STRIP_PILLARS,   COLOR_STRIP_BUTTONS,
+};
+#define COLOR_SEGMENTS (sizeof(segment_leds) / sizeof(segment_leds[0]))
+
+typedef struct {
+  uint8_t first;  // First input LED
+  uint8_t count;  // Input LEDs averaged
+  uint16_t weight[COLOR_MAX_TAPS];  // 0.8 fixed point, sum 256
+} color_tap_t;
+
+typedef struct {
+  color_params_t params;
+  bool passthrough;
+  bool downsample;
+  uint8_t out_leds;
+  uint32_t limit_sum;  // Max sum of all output channels
+  uint8_t lut[COLOR_STRIPS][256];
+  uint8_t led_strip[LED_STREAM_LEDS];
+  color_tap_t taps[LED_STREAM_LEDS];
+} color_tables_t;
+
+typedef struct {
+  uint32_t (*sum)(const uint8_t* p, size_t n);
+  void (*scale)(uint8_t* p, size_t n, uint32_t factor);
+} color_kernels_t;
+
+// Built on the heap and published with one pointer swap. Tables are never
+// changed or freed once published: a frame may still be reading the old set,
+// and there is one set per distinct configuration (an ini save), not per
+// frame.
+static color_tables_t* volatile color_active = NULL;
+static const color_kernels_t* color_kernels = NULL;
+
+// --- Kernels: n is a multiple of 32. p may have any alignment: the work
+// buffers are on the stack, and mingw-w64 GCC does not realign it to 32 ---
+
+static uint32_t sum_scalar(const uint8_t* p, size_t n) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    sum += p[i];
+  }
+  return sum;
+}
+
+// factor is 0.8 fixed point, at most 256
+static void scale_scalar(uint8_t* p, size_t n, uint32_t factor) {
+  for (size_t i = 0; i < n; i++) {
+    p[i] = (uint8_t)((p[i] * factor) >> 8);
+  }
+}
+
+#ifdef COLOR_X86
+static uint32_t sum_sse2(const uint8_t* p, size_t n) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  for (size_t i = 0; i < n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+  }
+  return (uint32_t)_mm_cvtsi128_si32(acc) +
+         (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+}
+
+static void scale_sse2(uint8_t* p, size_t n, uint32_t factor) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i f = _mm_set1_epi16((short)factor);
+  for (size_t i = 0; i < n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+    __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), f),
+                                8);
+    __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), f),
+                                8);
+    _mm_storeu_si128((__m128i*)(p + i), _mm_packus_epi16(lo, hi));
+  }
+}
+
+__attribute__((target("avx2"))) static uint32_t sum_avx2(const uint8_t* p,
+                                                         size_t n) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i acc = zero;
+  for (size_t i = 0; i < n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+  }
+  __m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc),
+                               _mm256_extracti128_si256(acc, 1));
+  return (uint32_t)_mm_cvtsi128_si32(half) +
+         (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+}
+
+__attribute__((target("avx2"))) static void scale_avx2(uint8_t* p,
+                                                       size_t n,
+                                                       uint32_t factor) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i f = _mm256_set1_epi16((short)factor);
+  for (size_t i = 0; i < n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+    // Unpack and pack both work per 128-bit lane, so the order is kept
+    __m256i lo = _mm256_srli_epi16(
+        _mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), f), 8);
+    __m256i hi = _mm256_srli_epi16(
+        _mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), f), 8);
+    _mm256_storeu_si256((__m256i*)(p + i), _mm256_packus_epi16(lo, hi));
+  }
+}
+#endif  // COLOR_X86
+
+static const color_kernels_t kernel_table[COLOR_KERNEL_COUNT] = {
+    {sum_scalar, scale_scalar},
+#ifdef COLOR_X86
+    {sum_sse2, scale_sse2},
+    {sum_avx2, scale_avx2},
+#else
+    {sum_scalar, scale_scalar},
+    {sum_scalar, scale_scalar},
+#endif
+};
+
+static const char* const kernel_names[COLOR_KERNEL_COUNT] = {
+    "scalar",
+    "SSE2",
+    "AVX2",
+};
+
+bool color_kernel_supported(color_kernel_t kernel) {
+  switch (kernel) {
+    case COLOR_KERNEL_SCALAR:
+      return true;
+#ifdef COLOR_X86
+    case COLOR_KERNEL_SSE2:
+      return true;
+    case COLOR_KERNEL_AVX2:
+      return __builtin_cpu_supports("avx2") != 0;
+#endif
+    default:
+      return false;
+  }
+}
+
+void color_set_kernel(color_kernel_t kernel) {
+  if ((unsigned)kernel < COLOR_KERNEL_COUNT && color_kernel_supported(kernel)) {
+    color_kernels = &kernel_table[kernel];
+  }
+}
+
+const char* color_kernel_name(color_kernel_t kernel) {
+  return (unsigned)kernel < COLOR_KERNEL_COUNT ? kernel_names[kernel] : "?";
+}
+
+static const color_kernels_t* color_best_kernels(void) {
+  for (int k = COLOR_KERNEL_COUNT - 1; k > COLOR_KERNEL_SCALAR; k--) {
+    if (color_kernel_supported((color_kernel_t)k)) {
+      return &kernel_table[k];
+    }
+  }
+  return &kernel_table[COLOR_KERNEL_SCALAR];
+}
+
+// --- Tables ---
+
+static bool color_params_equal(const color_params_t* a,
+                               const color_params_t* b) {
+  for (int i = 0; i < COLOR_STRIPS; i++) {
+    if (a->gamma[i] != b->gamma[i]) {
+      return false;
+    }
+  }
+  return a->brightness == b->brightness &&
+         a->current_limit == b->current_limit &&
+         a->pillar_leds == b->pillar_leds;
+}
+
+static void color_build_lut(uint8_t* lut, uint16_t gamma, uint8_t brightness) {
+  double exponent = gamma != 0 ? gamma / 100.0 : 1.0;
+  for (int v = 0; v < 256; v++) {
+    double x = pow(v / 255.0, exponent) * brightness;
+    lut[v] = (uint8_t)(x + 0.5);
+  }
+}
+
+// Area-weighted taps averaging n input LEDs from first down to m outputs
+static void color_build_taps(color_tap_t* taps, uint8_t first, int n, int m) {
+  for (int j = 0; j < m; j++) {
+    // Output j covers [j * n, (j + 1) * n) in units of 1/m input LED
+    int start = j * n, end = (j + 1) * n;
+    color_tap_t* tap = &taps[j];
+    int total = 0, largest = 0;
+
+    tap->first = (uint8_t)(first + start / m);
+    tap->count = 0;
+    for (int i = start / m; i * m < end; i++) {
+      int lo = i * m > start ? i * m : start;
+      int hi = (i + 1) * m < end ? (i + 1) * m : end;
+      int w = (hi - lo) * 256 / n;
+      tap->weight[tap->count] = (uint16_t)w;
+      if (w > tap->weight[largest]) {
+        largest = tap->count;
+      }
+      total += w;
+      tap->count++;
+    }
+    // Rounding: the weights must add up to exactly one
+    tap->weight[largest] = (uint16_t)(tap->weight[largest] + 256 - total);
+  }
+}
+
+static void color_build(color_tables_t* t, const color_params_t* params) {
+  static const color_params_t passthrough = COLOR_DEFAULTS;
+
+  memset(t, 0, sizeof(*t));
+  t->params = *params;
+  t->passthrough = color_params_equal(params, &passthrough);
+
+  for (int s = 0; s < COLOR_STRIPS; s++) {
+    color_build_lut(t->lut[s], params->gamma[s], params->brightness);
+  }
+
+  uint8_t led = 0, out = 0;
+  for (size_t s = 0; s < COLOR_SEGMENTS; s++) {
+    int n = segment_leds[s];
+    int m = n;
+    if (segment_strip[s] == COLOR_STRIP_PILLARS && params->pillar_leds != 0 &&
+        params->pillar_leds < n) {
+      m = params->pillar_leds;
+      t->downsample = true;
+    }
+    memset(&t->led_strip[led], segment_strip[s], (size_t)n);
+    color_build_taps(&t->taps[out], led, n, m);
+    led = (uint8_t)(led + n);
+    out = (uint8_t)(out + m);
+  }
+  t->out_leds = out;
+
+  uint32_t limit = params->current_limit > 100 ? 100 : params->current_limit;
+  t->limit_sum = limit * out * 3 * 255 / 100;
+}
+
+bool color_configure(const color_params_t* params) {
+  const color_tables_t* active = color_active;
+  if (active != NULL && color_params_equal(&active->params, params)) {
+    return false;
+  }
+
+  // Build a new set, then switch over in one store
+  color_tables_t* next = (color_tables_t*)malloc(sizeof(*next));
+  if (next == NULL) {
+    return false;
+  }
+  color_build(next, params);
+  InterlockedExchangePointer((PVOID volatile*)&color_active, next);
+  return true;
+}
+
+// --- Transform ---
+
+uint8_t color_transform(const uint8_t* in, uint8_t* out) {
+  if (color_active == NULL) {
+    color_params_t defaults = COLOR_DEFAULTS;
+    color_configure(&defaults);
+  }
+  if (color_kernels == NULL) {
+    color_kernels = color_best_kernels();
+  }
+
+  const color_tables_t* t = color_active;
+  if (t == NULL) {
+    // Out of memory for the very first set
+    memcpy(out, in, COLOR_FRAME_BYTES);
+    return LED_STREAM_LEDS;
+  }
+  if (t->passthrough) {
+    memcpy(out, in, COLOR_FRAME_BYTES);
+    return LED_STREAM_LEDS;
+  }
+
+  uint8_t linear[COLOR_BUFFER_BYTES];
+  uint8_t frame[COLOR_BUFFER_BYTES];
+
+  // Gamma and brightness
+  for (int led = 0; led < LED_STREAM_LEDS; led++) {
+    const uint8_t* lut = t->lut[t->led_strip[led]];
+    linear[led * 3 + 0] = lut[in[led * 3 + 0]];
+    linear[led * 3 + 1] = lut[in[led * 3 + 1]];
+    linear[led * 3 + 2] = lut[in[led * 3 + 2]];
+  }
+
+  // Pillar downsampling
+  uint8_t* result = linear;
+  if (t->downsample) {
+    memset(frame, 0, sizeof(frame));
+    for (int o = 0; o < t->out_leds; o++) {
+      const color_tap_t* tap = &t->taps[o];
+      const uint8_t* src = &linear[tap->first * 3];
+      uint32_t r = 128, g = 128, b = 128;
+      for (int i = 0; i < tap->count; i++) {
+        r += tap->weight[i] * src[i * 3 + 0];
+        g += tap->weight[i] * src[i * 3 + 1];
+        b += tap->weight[i] * src[i * 3 + 2];
+      }
+      frame[o * 3 + 0] = (uint8_t)(r >> 8);
+      frame[o * 3 + 1] = (uint8_t)(g >> 8);
+      frame[o * 3 + 2] = (uint8_t)(b >> 8);
+    }
+    result = frame;
+  } else {
+    memset(&linear[COLOR_FRAME_BYTES], 0,
+           COLOR_BUFFER_BYTES - COLOR_FRAME_BYTES);
+  }
+
+  // Current limit: scale the whole frame down to the budget
+  uint32_t sum = color_kernels->sum(result, COLOR_BUFFER_BYTES);
+  if (sum > t->limit_sum) {
+    uint32_t factor = (uint32_t)(((uint64_t)t->limit_sum << 8) / sum);
+    color_kernels->scale(result, COLOR_BUFFER_BYTES, factor);
+  }
+
+  memcpy(out, result, COLOR_FRAME_BYTES);
+  return t->out_leds;
+}
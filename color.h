@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mu3io.h"
+
+/* Board 0 color pipeline, run on the caller's thread before a frame is
+   queued:
+
+   1. Gamma and brightness: one lookup table per strip (side buttons,
+      pillars, billboard), with the global brightness folded in.
+   2. Downsampling: the 7/9/7-LED pillar segments are averaged (in the
+      linear domain, after gamma) down to the LEDs a cabinet really has.
+   3. Current limiting: if the frame would draw more than the configured
+      share of full white, all channels are scaled down together.
+
+   The frame-wide steps run on SSE2/AVX2 kernels where the CPU has them, with
+   a scalar fallback that gives identical results. Tables are only rebuilt
+   when color_configure() gets different parameters; a rebuild is published
+   with one pointer swap, so frames in flight keep a consistent table. */
+
+enum {
+  COLOR_STRIP_BUTTONS,
+  COLOR_STRIP_PILLARS,
+  COLOR_STRIP_BILLBOARD,
+  COLOR_STRIPS
+};
+
+typedef struct {
+  uint16_t gamma[COLOR_STRIPS];  // Exponent x100, 100 = linear
+  uint8_t brightness;            // 255 = full
+  uint8_t current_limit;         // Max % of full white drawn by a frame
+  uint8_t pillar_leds;           // LEDs per pillar segment, 0 = all 7/9/7
+} color_params_t;
+
+// Pass-through: linear, full brightness, no limit, no downsampling
+#define COLOR_DEFAULTS                 \
+  {                                    \
+      .gamma = {100, 100, 100},        \
+      .brightness = 255,               \
+      .current_limit = 100,            \
+      .pillar_leds = 0,                \
+  }
+
+typedef enum {
+  COLOR_KERNEL_SCALAR,
+  COLOR_KERNEL_SSE2,
+  COLOR_KERNEL_AVX2,
+  COLOR_KERNEL_COUNT
+} color_kernel_t;
+
+/* Use params from now on. Returns true if the tables were rebuilt, false if
+   they already matched. */
+bool color_configure(const color_params_t* params);
+
+/* Transform one board 0 frame of LED_STREAM_LEDS * 3 bytes into out (same
+   size). Returns the number of LEDs in out, fewer than LED_STREAM_LEDS when
+   the pillars are downsampled; the side buttons are always the first and
+   last two. */
+uint8_t color_transform(const uint8_t* in, uint8_t* out);
+
+/* Kernels, for tests and benchmarks. color_set_kernel() ignores kernels the
+   CPU does not support; by default the fastest supported one is used. */
+bool color_kernel_supported(color_kernel_t kernel);
+void color_set_kernel(color_kernel_t kernel);
+const char* color_kernel_name(color_kernel_t kernel);
@@ -0,0 +1,210 @@
+#include "color.h"
+#include "mu3io.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Host-native test and benchmark of the board 0 color pipeline: every SIMD
+   kernel must match the scalar one bit for bit. */
+
+#define FRAME_BYTES (LED_STREAM_LEDS * 3)
+#define TEST_FRAMES 2000
+#define BENCH_FRAMES 1000000
+
+static volatile uint8_t bench_sink;
+
+void print_separator(const char* title) {
+  printf("\n========== %s ==========\n", title);
+}
+
+static double now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER freq, now;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return (double)now.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+static uint32_t lfsr = 0xACE1u;
+
+static void random_frame(uint8_t* rgb) {
+  for (int i = 0; i < FRAME_BYTES; i++) {
+    lfsr = lfsr * 1103515245u + 12345u;
+    rgb[i] = (uint8_t)(lfsr >> 16);
+  }
+}
+
+static const color_params_t test_params[] = {
+    COLOR_DEFAULTS,
+    {.gamma = {220, 220, 180}, .brightness = 255, .current_limit = 100},
+    {.gamma = {100, 250, 220}, .brightness = 128, .current_limit = 40},
+    {.gamma = {220, 220, 220},
+     .brightness = 200,
+     .current_limit = 25,
+     .pillar_leds = 3},
+    {.gamma = {100, 100, 100},
+     .brightness = 255,
+     .current_limit = 100,
+     .pillar_leds = 1},
+};
+#define TEST_PARAMS (sizeof(test_params) / sizeof(test_params[0]))
+
+static bool test_kernels(void) {
+  print_separator("Kernel Equivalence Test");
+
+  uint8_t in[FRAME_BYTES], expected[FRAME_BYTES], out[FRAME_BYTES];
+  bool ok = true;
+
+  for (int k = COLOR_KERNEL_SSE2; k < COLOR_KERNEL_COUNT; k++) {
+    if (!color_kernel_supported((color_kernel_t)k)) {
+      printf("%s: not supported here, skipped\n",
+             color_kernel_name((color_kernel_t)k));
+      continue;
+    }
+    int mismatches = 0;
+    for (size_t p = 0; p < TEST_PARAMS; p++) {
+      color_configure(&test_params[p]);
+      for (int f = 0; f < TEST_FRAMES; f++) {
+        random_frame(in);
+        color_set_kernel(COLOR_KERNEL_SCALAR);
+        uint8_t leds = color_transform(in, expected);
+        color_set_kernel((color_kernel_t)k);
+        if (color_transform(in, out) != leds ||
+            memcmp(out, expected, FRAME_BYTES) != 0) {
+          mismatches++;
+        }
+      }
+    }
+    printf("%s: %d mismatches\n", color_kernel_name((color_kernel_t)k),
+           mismatches);
+    ok = ok && mismatches == 0;
+  }
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+static bool test_pipeline(void) {
+  print_separator("Pipeline Test");
+
+  uint8_t in[FRAME_BYTES], out[FRAME_BYTES];
+  bool ok = true;
+
+  // Defaults pass the frame through
+  color_params_t defaults = COLOR_DEFAULTS;
+  color_configure(&defaults);
+  random_frame(in);
+  if (color_transform(in, out) != LED_STREAM_LEDS ||
+      memcmp(in, out, FRAME_BYTES) != 0) {
+    printf("Defaults changed the frame\n");
+    ok = false;
+  }
+
+  // Unchanged parameters do not rebuild the tables
+  if (color_configure(&defaults)) {
+    printf("Tables rebuilt for unchanged parameters\n");
+    ok = false;
+  }
+
+  // One LED per pillar segment: the average of the segment
+  color_configure(&test_params[4]);
+  for (int i = 0; i < FRAME_BYTES; i++) {
+    in[i] = (uint8_t)(i / 3 * 4);
+  }
+  uint8_t leds = color_transform(in, out);
+  if (leds != 2 + 3 + 11 + 3 + 2) {
+    printf("Downsampled to %u LEDs, expected 21\n", leds);
+    ok = false;
+  }
+  // Output 2 averages LEDs 2-8, output 3 LEDs 9-17
+  if (out[2 * 3] != 5 * 4 || out[3 * 3] != 13 * 4) {
+    printf("Segment averages %u, %u, expected %u, %u\n", out[2 * 3],
+           out[3 * 3], 5 * 4, 13 * 4);
+    ok = false;
+  }
+  if (out[0] != in[0] || out[(leds - 1) * 3] != in[60 * 3]) {
+    printf("Side buttons moved\n");
+    ok = false;
+  }
+
+  // Full white is held to the current limit
+  color_configure(&test_params[2]);
+  memset(in, 0xFF, sizeof(in));
+  leds = color_transform(in, out);
+  uint32_t sum = 0;
+  for (int i = 0; i < leds * 3; i++) {
+    sum += out[i];
+  }
+  uint32_t budget = test_params[2].current_limit * leds * 3u * 255 / 100;
+  if (sum > budget || sum < budget * 9 / 10) {
+    printf("Full white draws %u, budget %u\n", sum, budget);
+    ok = false;
+  }
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+static void bench(void) {
+  print_separator("Benchmark (one 61-LED frame)");
+
+  static const char* const names[TEST_PARAMS] = {
+      "pass-through", "gamma", "gamma+limit", "all, 3 per pillar",
+      "1 per pillar",
+  };
+  uint8_t in[FRAME_BYTES], out[FRAME_BYTES];
+
+  random_frame(in);
+  for (size_t p = 0; p < TEST_PARAMS; p++) {
+    color_configure(&test_params[p]);
+    printf("%-18s", names[p]);
+    for (int k = 0; k < COLOR_KERNEL_COUNT; k++) {
+      if (!color_kernel_supported((color_kernel_t)k)) {
+        continue;
+      }
+      color_set_kernel((color_kernel_t)k);
+      double start = now_ns();
+      for (int i = 0; i < BENCH_FRAMES; i++) {
+        in[0] = (uint8_t)i;
+        color_transform(in, out);
+        bench_sink = out[0];
+      }
+      printf("  %s %6.1f ns", color_kernel_name((color_kernel_t)k),
+             (now_ns() - start) / BENCH_FRAMES);
+    }
+    printf("\n");
+  }
+
+  // Reconfiguring with the same parameters is a comparison
+  double start = now_ns();
+  for (int i = 0; i < BENCH_FRAMES; i++) {
+    color_configure(&test_params[3]);
+  }
+  printf("Unchanged configure: %.1f ns\n", (now_ns() - start) / BENCH_FRAMES);
+}
+
+int main(void) {
+  printf("========================================\n");
+  printf("       SimGEKI LED color test\n");
+  printf("========================================\n");
+
+  bool ok = test_kernels();
+  ok = test_pipeline() && ok;
+  bench();
+
+  print_separator(ok ? "PASSED" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -5,6 +5,7 @@
 
 #include <ctype.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,7 +14,12 @@
 #include "util/dprintf.h"
 
 #include "config.h"
+#include "ini.h"
 #include "mu3io.h"
+#include "session.h"
+#include "stats.h"
+#include "tracepoint.h"
+#include "transport.h"
 
 MU3IO_CONFIG cfg = {
   .vid_num = {'0', 'C', 'A', '3', '\0'},
@@ -36,43 +42,32 @@ MU3IO_CONFIG cfg = {
     .gamebtn_R3_keycode = 0,
     .gamebtn_Rside_keycode = 0,
     .gamebtn_Rmenu_keycode = 0,
-};
 
-static void trim_whitespace(char* str) {
-  if (str == NULL) {
-    return;
-  }
-
-  char* start = str;
-  while (*start && isspace((unsigned char)*start)) {
-    start++;
-  }
-
-  if (start != str) {
-    memmove(str, start, strlen(start) + 1);
-  }
-
-  size_t len = strlen(str);
-  while (len > 0 && isspace((unsigned char)str[len - 1])) {
-    len--;
-  }
-  str[len] = '\0';
-}
-
-static void strip_comment_and_trim(char* str) {
-  if (str == NULL) {
-    return;
-  }
-
-  char* semi = strchr(str, ';');
-  if (semi != NULL) {
-    *semi = '\0';
-  }
-  trim_whitespace(str);
-}
+    .reader_thread_enabled = 0,
+    .shared_hub_enabled = 1,
+    .path_cache_enabled = 1,
+    .read_buffers = TRANSPORT_DEFAULT_READS,
+    .completion_port = 0,
+    .stream_timeout_ms = SESSION_GAP_MS,
+    .log_level = DLOG_INFO,
+    .tp_mask = 0,
+    .tp_records = TP_DEFAULT_RECORDS,
+    .reload_enabled = 1,
+
+    .lever_filter_enabled = 0,
+    .lever_filter = LEVER_FILTER_DEFAULTS,
+    .lever_predict_enabled = 0,
+    .lever_predict = LEVER_PREDICT_DEFAULTS,
+
+    .led_max_rate = 60,
+    .led_color = COLOR_DEFAULTS,
+};
 
-static bool build_ini_path(char* path, size_t path_size) {
-  if (path == NULL || path_size == 0) {
+// Build the path of a file that lives next to the DLL
+static bool build_module_path(const char* file_name,
+                              char* path,
+                              size_t path_size) {
+  if (file_name == NULL || path == NULL || path_size == 0) {
     return false;
   }
 
@@ -98,14 +93,18 @@ static bool build_ini_path(char* path, size_t path_size) {
   }
 
   *(last_slash + 1) = '\0';
-  if (strnlen(path, path_size) + strlen("simgeki_io.ini") + 1 > path_size) {
+  if (strnlen(path, path_size) + strlen(file_name) + 1 > path_size) {
     return false;
   }
 
-  strcat_s(path, path_size, "simgeki_io.ini");
+  strcat_s(path, path_size, file_name);
   return true;
 }
 
+static bool build_ini_path(char* path, size_t path_size) {
+  return build_module_path("simgeki_io.ini", path, path_size);
+}
+
 static void apply_hex_field(const char* value,
                             char* target,
                             size_t length,
@@ -136,107 +135,602 @@ static void apply_hex_field(const char* value,
   target[max_digits] = '\0';
 }
 
-static bool read_ini_hex_field(const char* section,
-                               const char* key,
-                               const char* ini_path,
-                               char* target,
-                               size_t length,
-                               const char* label) {
-  if (ini_path == NULL || target == NULL || length == 0) {
+typedef enum {
+  CONFIG_HEX,        // Fixed number of hex digits, upper-cased
+  CONFIG_UINT,       // Decimal, or hex with 0x
+  CONFIG_PATH,       // Relative names are resolved next to the DLL
+  CONFIG_LOG_LEVEL,  // See dprintf_parse_level()
+  CONFIG_TP_MASK,    // See tp_parse_mask()
+} config_type_t;
+
+typedef struct {
+  const char* section;
+  const char* key;
+  config_type_t type;
+  size_t offset;
+  size_t size;
+  unsigned long max;  // CONFIG_UINT, 0 = whatever fits the field
+} config_key_t;
+
+#define CONFIG_FIELD(field) \
+  offsetof(MU3IO_CONFIG, field), sizeof(((MU3IO_CONFIG*)0)->field)
+
+static const config_key_t config_keys[] = {
+    {"input", "VID", CONFIG_HEX, CONFIG_FIELD(vid_num), 0},
+    {"input", "PID", CONFIG_HEX, CONFIG_FIELD(pid_num), 0},
+    {"input", "MI", CONFIG_HEX, CONFIG_FIELD(mi_num), 0},
+    {"input", "keyboard", CONFIG_UINT, CONFIG_FIELD(keyboard_enabled), 0},
+    {"input", "test", CONFIG_UINT, CONFIG_FIELD(test_keycode), 0},
+    {"input", "service", CONFIG_UINT, CONFIG_FIELD(service_keycode), 0},
+    {"input", "coin", CONFIG_UINT, CONFIG_FIELD(coin_keycode), 0},
+    {"input", "left1", CONFIG_UINT, CONFIG_FIELD(gamebtn_L1_keycode), 0},
+    {"input", "left2", CONFIG_UINT, CONFIG_FIELD(gamebtn_L2_keycode), 0},
+    {"input", "left3", CONFIG_UINT, CONFIG_FIELD(gamebtn_L3_keycode), 0},
+    {"input", "leftSide", CONFIG_UINT, CONFIG_FIELD(gamebtn_Lside_keycode), 0},
+    {"input", "leftMenu", CONFIG_UINT, CONFIG_FIELD(gamebtn_Lmenu_keycode), 0},
+    {"input", "right1", CONFIG_UINT, CONFIG_FIELD(gamebtn_R1_keycode), 0},
+    {"input", "right2", CONFIG_UINT, CONFIG_FIELD(gamebtn_R2_keycode), 0},
+    {"input", "right3", CONFIG_UINT, CONFIG_FIELD(gamebtn_R3_keycode), 0},
+    {"input", "rightSide", CONFIG_UINT, CONFIG_FIELD(gamebtn_Rside_keycode),
+     0},
+    {"input", "rightMenu", CONFIG_UINT, CONFIG_FIELD(gamebtn_Rmenu_keycode),
+     0},
+
+    {"io", "readerThread", CONFIG_UINT, CONFIG_FIELD(reader_thread_enabled),
+     0},
+    {"io", "sharedHub", CONFIG_UINT, CONFIG_FIELD(shared_hub_enabled), 0},
+    {"io", "pathCache", CONFIG_UINT, CONFIG_FIELD(path_cache_enabled), 0},
+    {"io", "readBuffers", CONFIG_UINT, CONFIG_FIELD(read_buffers),
+     TRANSPORT_MAX_READS},
+    {"io", "completionPort", CONFIG_UINT, CONFIG_FIELD(completion_port), 0},
+    {"io", "trace", CONFIG_PATH, CONFIG_FIELD(trace_path), 0},
+    {"io", "streamTimeout", CONFIG_UINT, CONFIG_FIELD(stream_timeout_ms), 0},
+    {"io", "logLevel", CONFIG_LOG_LEVEL, CONFIG_FIELD(log_level), 0},
+    {"io", "tracePoints", CONFIG_TP_MASK, CONFIG_FIELD(tp_mask), 0},
+    {"io", "tracePointRecords", CONFIG_UINT, CONFIG_FIELD(tp_records),
+     1UL << 24},
+    {"io", "tracePointDump", CONFIG_PATH, CONFIG_FIELD(tp_dump_path), 0},
+    {"io", "reload", CONFIG_UINT, CONFIG_FIELD(reload_enabled), 0},
+
+    {"lever", "filter", CONFIG_UINT, CONFIG_FIELD(lever_filter_enabled), 0},
+    {"lever", "minCutoff", CONFIG_UINT, CONFIG_FIELD(lever_filter.min_cutoff),
+     0},
+    {"lever", "beta", CONFIG_UINT, CONFIG_FIELD(lever_filter.beta), 0},
+    {"lever", "speedCutoff", CONFIG_UINT, CONFIG_FIELD(lever_filter.d_cutoff),
+     0},
+    {"lever", "deadzone", CONFIG_UINT, CONFIG_FIELD(lever_filter.deadzone),
+     0},
+    {"lever", "hysteresis", CONFIG_UINT,
+     CONFIG_FIELD(lever_filter.hysteresis), 0},
+    {"lever", "predict", CONFIG_UINT, CONFIG_FIELD(lever_predict_enabled), 0},
+    {"lever", "predictHorizon", CONFIG_UINT,
+     CONFIG_FIELD(lever_predict.horizon_us), 0},
+    {"lever", "predictMax", CONFIG_UINT, CONFIG_FIELD(lever_predict.max_delta),
+     0},
+    {"lever", "predictLead", CONFIG_UINT, CONFIG_FIELD(lever_predict.lead_us),
+     0},
+    {"lever", "calibrate", CONFIG_UINT, CONFIG_FIELD(lever_calibrate), 0},
+    {"lever", "calibMin", CONFIG_UINT, CONFIG_FIELD(lever_calib.min), 0},
+    {"lever", "calibCenter", CONFIG_UINT, CONFIG_FIELD(lever_calib.center),
+     0},
+    {"lever", "calibMax", CONFIG_UINT, CONFIG_FIELD(lever_calib.max), 0},
+
+    {"led", "maxRate", CONFIG_UINT, CONFIG_FIELD(led_max_rate), 0},
+    {"led", "stream", CONFIG_UINT, CONFIG_FIELD(led_stream), 0},
+    {"led", "gammaButtons", CONFIG_UINT,
+     CONFIG_FIELD(led_color.gamma[COLOR_STRIP_BUTTONS]), 0},
+    {"led", "gammaPillars", CONFIG_UINT,
+     CONFIG_FIELD(led_color.gamma[COLOR_STRIP_PILLARS]), 0},
+    {"led", "gammaBillboard", CONFIG_UINT,
+     CONFIG_FIELD(led_color.gamma[COLOR_STRIP_BILLBOARD]), 0},
+    {"led", "brightness", CONFIG_UINT, CONFIG_FIELD(led_color.brightness), 0},
+    {"led", "currentLimit", CONFIG_UINT,
+     CONFIG_FIELD(led_color.current_limit), 0},
+    {"led", "pillarLeds", CONFIG_UINT, CONFIG_FIELD(led_color.pillar_leds),
+     0},
+};
+
+#define CONFIG_KEYS (sizeof(config_keys) / sizeof(config_keys[0]))
+
+typedef struct {
+  MU3IO_CONFIG* target;
+  bool seen[CONFIG_KEYS];
+} config_parse_t;
+
+// Editors save in several writes; wait for the folder to be quiet this long
+#define CONFIG_SETTLE_MS 50
+#define CONFIG_SETTLE_MAX_MS 1000
+
+// cfg as compiled in, the base of every reload
+static MU3IO_CONFIG config_defaults;
+static bool config_defaults_saved = false;
+
+static char config_ini_path[MAX_PATH];
+static WIN32_FILE_ATTRIBUTE_DATA config_ini_stamp;
+static config_reload_fn config_on_reload = NULL;
+static HANDLE config_watch_thread = NULL;
+
+// Immutable once published, and never freed: usb_init() holds the pointer
+// for a whole enumeration. A copy is only made when a saved ini changes
+// VID/PID/MI, so the leak is 64 bytes per such edit; that bound is
+// deliberate, freeing would need reader reference counts on the hot path.
+// Published by config_load_from_ini() before any reader starts.
+static config_hid_match_t* volatile config_hid_active = NULL;
+static config_hid_match_t config_hid_fallback;  // If allocation fails
+
+// Decimal, or hex with 0x like the profile API
+static bool parse_uint(const char* value, unsigned long max,
+                       unsigned long* out) {
+  int base = 10;
+  if (value[0] == '0' && (value[1] == 'x' || value[1] == 'X')) {
+    value += 2;
+    base = 16;
+  }
+  if (!isxdigit((unsigned char)value[0])) {
     return false;
   }
 
-  char buf[64];
-  DWORD len =
-      GetPrivateProfileStringA(section, key, "", buf, sizeof(buf), ini_path);
-  if (len == 0 || len >= sizeof(buf)) {
+  char* endptr = NULL;
+  unsigned long parsed = strtoul(value, &endptr, base);
+  if (endptr == value || parsed > max) {
     return false;
   }
 
-  strip_comment_and_trim(buf);
-  apply_hex_field(buf, target, length, label);
+  *out = parsed;
   return true;
 }
 
-static bool read_ini_uint8(const char* section,
-                           const char* key,
-                           const char* ini_path,
-                           uint8_t* out) {
-  if (ini_path == NULL || out == NULL) {
+static bool parse_path(const char* value, char* target, size_t length) {
+  bool absolute = value[0] == '\\' || value[0] == '/' ||
+                  (isalpha((unsigned char)value[0]) && value[1] == ':');
+  if (strlen(value) >= MAX_PATH - 1) {
     return false;
   }
-
-  // First try the built-in integer parser for readability
-  const UINT sentinel = (UINT)(-1);
-  UINT val = GetPrivateProfileIntA(section, key, sentinel, ini_path);
-  if (val != sentinel && val <= 0xFF) {
-    *out = (uint8_t)val;
+  if (absolute) {
+    if (strlen(value) + 1 > length) {
+      return false;
+    }
+    strcpy_s(target, length, value);
     return true;
   }
+  return build_module_path(value, target, length);
+}
 
-  // Fallback to manual parse (allows hex like 0x70)
-  char buf[32];
-  DWORD len = GetPrivateProfileStringA(section, key, "", buf, sizeof(buf),
-                                       ini_path);
-  if (len == 0 || len >= sizeof(buf)) {
-    return false;
+// Store one value into its field; invalid values keep what was there
+static void config_apply_key(MU3IO_CONFIG* target,
+                             const config_key_t* key,
+                             const char* value) {
+  char* field = (char*)target + key->offset;
+  unsigned long val;
+
+  switch (key->type) {
+    case CONFIG_HEX:
+      apply_hex_field(value, field, key->size, key->key);
+      break;
+    case CONFIG_UINT: {
+      unsigned long max = key->max != 0            ? key->max
+                          : key->size == 1         ? 0xFFUL
+                          : key->size == 2         ? 0xFFFFUL
+                                                   : 0xFFFFFFFFUL;
+      if (!parse_uint(value, max, &val)) {
+        break;
+      }
+      if (key->size == 1) {
+        *(uint8_t*)field = (uint8_t)val;
+      } else if (key->size == 2) {
+        *(uint16_t*)field = (uint16_t)val;
+      } else {
+        *(uint32_t*)field = (uint32_t)val;
+      }
+      break;
+    }
+    case CONFIG_PATH:
+      parse_path(value, field, key->size);
+      break;
+    case CONFIG_LOG_LEVEL: {
+      int level = dprintf_parse_level(value);
+      if (level < 0) {
+        dlog(DLOG_WARN, "SimGEKI: Unknown log level %s, ignored.\n", value);
+        break;
+      }
+      *(uint8_t*)field = (uint8_t)level;
+      break;
+    }
+    case CONFIG_TP_MASK:
+      *(uint32_t*)field = tp_parse_mask(value);
+      break;
   }
-  strip_comment_and_trim(buf);
+}
 
-  char* endptr = NULL;
-  unsigned long parsed = strtoul(buf, &endptr, 0);
-  if (endptr == buf || parsed > 0xFF) {
-    return false;
+static bool config_on_key(void* ctx,
+                          const char* section,
+                          const char* key,
+                          const char* value) {
+  config_parse_t* parse = (config_parse_t*)ctx;
+
+  // An empty value keeps the default, like a missing key
+  if (value[0] == '\0') {
+    return true;
   }
 
-  *out = (uint8_t)parsed;
+  for (size_t i = 0; i < CONFIG_KEYS; i++) {
+    const config_key_t* k = &config_keys[i];
+    if (!ini_name_equal(k->key, key) || !ini_name_equal(k->section, section)) {
+      continue;
+    }
+    // The profile API always returned the first of duplicate keys
+    if (!parse->seen[i]) {
+      parse->seen[i] = true;
+      config_apply_key(parse->target, k, value);
+    }
+    break;
+  }
   return true;
 }
 
+static HRESULT config_parse(const char* ini_path,
+                            MU3IO_CONFIG* target,
+                            size_t* keys) {
+  config_parse_t parse;
+
+  memset(&parse, 0, sizeof(parse));
+  parse.target = target;
+  return ini_parse_file(ini_path, config_on_key, &parse, keys);
+}
+
+static bool config_read_stamp(WIN32_FILE_ATTRIBUTE_DATA* stamp) {
+  return GetFileAttributesExA(config_ini_path, GetFileExInfoStandard, stamp) !=
+         0;
+}
+
+static void config_publish_hid_match(const MU3IO_CONFIG* config) {
+  const config_hid_match_t* active = config_hid_active;
+  config_hid_match_t next;
+
+  snprintf(next.vid, sizeof(next.vid), "VID_%s", config->vid_num);
+  snprintf(next.pid, sizeof(next.pid), "PID_%s", config->pid_num);
+  snprintf(next.mi, sizeof(next.mi), "MI_%s", config->mi_num);
+  snprintf(next.key, sizeof(next.key), "%s&%s&%s", next.vid, next.pid,
+           next.mi);
+  if (active != NULL && strcmp(active->key, next.key) == 0) {
+    return;
+  }
+
+  config_hid_match_t* match = (config_hid_match_t*)malloc(sizeof(*match));
+  if (match == NULL) {
+    if (active != NULL) {
+      return;  // Keep the current IDs
+    }
+    match = &config_hid_fallback;
+  }
+  *match = next;
+  InterlockedExchangePointer((PVOID volatile*)&config_hid_active, match);
+}
+
+const config_hid_match_t* config_hid_match(void) {
+  return config_hid_active;
+}
+
+static void config_load(void) {
+  if (!build_ini_path(config_ini_path, sizeof(config_ini_path))) {
+    config_ini_path[0] = '\0';
+    dprintf("SimGEKI: Failed to resolve ini path, skipping overrides.\n");
+    return;
+  }
+
+  if (!config_read_stamp(&config_ini_stamp)) {
+    dprintf("SimGEKI: Config ini not found at %s, using defaults.\n",
+            config_ini_path);
+    return;
+  }
+
+  dprintf("SimGEKI: Loading config from %s\n", config_ini_path);
+
+  LONGLONG start = stats_now();
+  MU3IO_CONFIG next = cfg;
+  size_t keys = 0;
+  if (config_parse(config_ini_path, &next, &keys) != S_OK) {
+    dlog(DLOG_WARN, "SimGEKI: Failed to read %s, using defaults.\n",
+         config_ini_path);
+    return;
+  }
+  cfg = next;
+  dprintf("SimGEKI: %u config keys read in %.3f ms.\n", (unsigned)keys,
+          (double)stats_elapsed_us(start, stats_now()) / 1000.0);
+
+  if (cfg.keyboard_enabled != 0) {
+    dprintf("SimGEKI: Keyboard input enabled.\n");
+  }
+  if (cfg.reader_thread_enabled != 0) {
+    dprintf("SimGEKI: Reader thread enabled.\n");
+  }
+  if (cfg.lever_filter_enabled != 0) {
+    dprintf("SimGEKI: Lever filter enabled.\n");
+  }
+  if (cfg.lever_predict_enabled != 0) {
+    dprintf("SimGEKI: Lever prediction enabled.\n");
+  }
+  if (cfg.led_stream != 0) {
+    dprintf("SimGEKI: LED streaming enabled.\n");
+  }
+}
+
 void config_load_from_ini(void) {
+  if (!config_defaults_saved) {
+    config_defaults = cfg;
+    config_defaults_saved = true;
+  }
+
+  config_load();
+  config_publish_hid_match(&cfg);
+}
+
+static void config_restart_note(const char* key) {
+  dprintf("SimGEKI: %s changed, takes effect after a restart.\n", key);
+}
+
+// Copy the settings that take effect while running into cfg. Each is one
+// field that the hot paths read with a single load; the ones that have to
+// change together (HID match strings, keyboard map, colors, lever
+// prediction) are republished whole, by config_publish_hid_match() and by
+// the reload handler.
+static void config_publish(const MU3IO_CONFIG* next) {
+  if (next->reader_thread_enabled != cfg.reader_thread_enabled) {
+    config_restart_note("readerThread");
+  }
+  if (next->shared_hub_enabled != cfg.shared_hub_enabled) {
+    config_restart_note("sharedHub");
+  }
+  if (next->path_cache_enabled != cfg.path_cache_enabled) {
+    config_restart_note("pathCache");
+  }
+  if (strcmp(next->trace_path, cfg.trace_path) != 0) {
+    config_restart_note("trace");
+  }
+  if (next->read_buffers != cfg.read_buffers) {
+    config_restart_note("readBuffers");
+  }
+  if (next->completion_port != cfg.completion_port) {
+    config_restart_note("completionPort");
+  }
+  if (next->stream_timeout_ms != cfg.stream_timeout_ms) {
+    config_restart_note("streamTimeout");
+  }
+  if (next->tp_records != cfg.tp_records) {
+    config_restart_note("tracePointRecords");
+  }
+  if (strcmp(next->tp_dump_path, cfg.tp_dump_path) != 0) {
+    config_restart_note("tracePointDump");
+  }
+  if (next->lever_filter_enabled != cfg.lever_filter_enabled ||
+      memcmp(&next->lever_filter, &cfg.lever_filter,
+             sizeof(cfg.lever_filter)) != 0) {
+    config_restart_note("Lever filter");
+  }
+  // calibrate/calibMin/... are written by the calibration itself and only
+  // read at startup
+
+  memcpy(cfg.vid_num, next->vid_num, sizeof(cfg.vid_num));
+  memcpy(cfg.pid_num, next->pid_num, sizeof(cfg.pid_num));
+  memcpy(cfg.mi_num, next->mi_num, sizeof(cfg.mi_num));
+  config_publish_hid_match(&cfg);
+
+  cfg.keyboard_enabled = next->keyboard_enabled;
+  cfg.test_keycode = next->test_keycode;
+  cfg.service_keycode = next->service_keycode;
+  cfg.coin_keycode = next->coin_keycode;
+  cfg.gamebtn_L1_keycode = next->gamebtn_L1_keycode;
+  cfg.gamebtn_L2_keycode = next->gamebtn_L2_keycode;
+  cfg.gamebtn_L3_keycode = next->gamebtn_L3_keycode;
+  cfg.gamebtn_Lside_keycode = next->gamebtn_Lside_keycode;
+  cfg.gamebtn_Lmenu_keycode = next->gamebtn_Lmenu_keycode;
+  cfg.gamebtn_R1_keycode = next->gamebtn_R1_keycode;
+  cfg.gamebtn_R2_keycode = next->gamebtn_R2_keycode;
+  cfg.gamebtn_R3_keycode = next->gamebtn_R3_keycode;
+  cfg.gamebtn_Rside_keycode = next->gamebtn_Rside_keycode;
+  cfg.gamebtn_Rmenu_keycode = next->gamebtn_Rmenu_keycode;
+
+  cfg.log_level = next->log_level;
+  cfg.tp_mask = next->tp_mask;
+  cfg.lever_predict_enabled = next->lever_predict_enabled;
+  cfg.lever_predict = next->lever_predict;
+  cfg.led_max_rate = next->led_max_rate;
+  cfg.led_stream = next->led_stream;
+  cfg.led_color = next->led_color;
+}
+
+// Re-read the ini after a change noticed at the given time
+static void config_reload(LONGLONG notified) {
+  MU3IO_CONFIG next = config_defaults;
+  MU3IO_CONFIG old = cfg;
+  size_t keys = 0;
+
+  LONGLONG start = stats_now();
+  if (config_parse(config_ini_path, &next, &keys) != S_OK) {
+    // Probably still locked by the editor; the next change retries
+    dlog(DLOG_WARN, "SimGEKI: Failed to re-read %s, keeping the config.\n",
+         config_ini_path);
+    return;
+  }
+  LONGLONG parsed = stats_now();
+
+  config_publish(&next);
+  if (config_on_reload != NULL) {
+    config_on_reload(&old);
+  }
+
+  LONGLONG end = stats_now();
+  dprintf(
+      "SimGEKI: Config reloaded %.1f ms after the change (%u keys read in "
+      "%.3f ms, applied in %.3f ms).\n",
+      (double)stats_elapsed_us(notified, end) / 1000.0, (unsigned)keys,
+      (double)stats_elapsed_us(start, parsed) / 1000.0,
+      (double)stats_elapsed_us(parsed, end) / 1000.0);
+}
+
+static DWORD WINAPI config_watch_proc(LPVOID param) {
+  HANDLE change = (HANDLE)param;
+
+  for (;;) {
+    if (WaitForSingleObject(change, INFINITE) != WAIT_OBJECT_0) {
+      break;
+    }
+    LONGLONG notified = stats_now();
+
+    // Let the editor finish saving, but don't wait forever on a folder
+    // that something else writes to all the time
+    do {
+      if (!FindNextChangeNotification(change)) {
+        dlog(DLOG_WARN, "SimGEKI: Config watch failed: %lu\n",
+             (unsigned long)GetLastError());
+        FindCloseChangeNotification(change);
+        return 1;
+      }
+    } while (WaitForSingleObject(change, CONFIG_SETTLE_MS) == WAIT_OBJECT_0 &&
+             stats_elapsed_us(notified, stats_now()) <
+                 CONFIG_SETTLE_MAX_MS * 1000);
+
+    // Most changes in the folder are other files (path cache, traces)
+    WIN32_FILE_ATTRIBUTE_DATA stamp;
+    if (!config_read_stamp(&stamp) ||
+        (CompareFileTime(&stamp.ftLastWriteTime,
+                         &config_ini_stamp.ftLastWriteTime) == 0 &&
+         stamp.nFileSizeLow == config_ini_stamp.nFileSizeLow)) {
+      continue;
+    }
+    config_ini_stamp = stamp;
+    config_reload(notified);
+  }
+
+  FindCloseChangeNotification(change);
+  return 0;
+}
+
+HRESULT config_watch_start(config_reload_fn on_reload) {
+  char dir[MAX_PATH];
+
+  if (!cfg.reload_enabled || config_watch_thread != NULL ||
+      config_ini_path[0] == '\0') {
+    return S_OK;
+  }
+
+  strcpy_s(dir, sizeof(dir), config_ini_path);
+  char* last_slash = strrchr(dir, '\\');
+  if (last_slash == NULL) {
+    last_slash = strrchr(dir, '/');
+  }
+  if (last_slash == NULL) {
+    return E_FAIL;
+  }
+  *last_slash = '\0';
+
+  // The folder, not the file: editors often save by replacing the file
+  HANDLE change = FindFirstChangeNotificationA(
+      dir, FALSE,
+      FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME |
+          FILE_NOTIFY_CHANGE_SIZE);
+  if (change == INVALID_HANDLE_VALUE) {
+    return HRESULT_FROM_WIN32(GetLastError());
+  }
+
+  config_on_reload = on_reload;
+  config_watch_thread =
+      CreateThread(NULL, 0, config_watch_proc, change, 0, NULL);
+  if (config_watch_thread == NULL) {
+    DWORD error = GetLastError();
+    FindCloseChangeNotification(change);
+    return HRESULT_FROM_WIN32(error);
+  }
+  SetThreadPriority(config_watch_thread, THREAD_PRIORITY_BELOW_NORMAL);
+
+  dprintf("SimGEKI: Watching %s for changes.\n", config_ini_path);
+  return S_OK;
+}
+
+static void config_write_lever_calib(const calib_points_t* points) {
   char ini_path[MAX_PATH] = {0};
+  char value[16];
+
   if (!build_ini_path(ini_path, sizeof(ini_path))) {
-    dprintf("SimGEKI: Failed to resolve ini path, skipping overrides.\n");
     return;
   }
 
-  DWORD attrs = GetFileAttributesA(ini_path);
-  if (attrs == INVALID_FILE_ATTRIBUTES) {
-    dprintf("SimGEKI: Config ini not found at %s, using defaults.\n",
+  snprintf(value, sizeof(value), "0x%04X", points->min);
+  WritePrivateProfileStringA("lever", "calibMin", value, ini_path);
+  snprintf(value, sizeof(value), "0x%04X", points->center);
+  WritePrivateProfileStringA("lever", "calibCenter", value, ini_path);
+  snprintf(value, sizeof(value), "0x%04X", points->max);
+  WritePrivateProfileStringA("lever", "calibMax", value, ini_path);
+  if (!WritePrivateProfileStringA("lever", "calibrate", "0", ini_path)) {
+    dprintf("SimGEKI: Failed to save the lever calibration to %s\n",
             ini_path);
-    return;
   }
+}
+
+// min | center << 16 | max << 32, with CONFIG_CALIB_PENDING set; 0 while
+// nothing waits to be saved
+#define CONFIG_CALIB_PENDING (1LL << 48)
+static volatile LONG64 config_calib_pending = 0;
+
+static DWORD WINAPI config_save_lever_calib_proc(LPVOID param) {
+  LONG64 packed;
+  (void)param;
+
+  // A newer calibration learnt meanwhile replaced the older one
+  while ((packed = InterlockedExchange64(&config_calib_pending, 0)) != 0) {
+    calib_points_t points = {
+        .min = (uint16_t)packed,
+        .center = (uint16_t)(packed >> 16),
+        .max = (uint16_t)(packed >> 32),
+    };
+    config_write_lever_calib(&points);
+  }
+  return 0;
+}
 
-  dprintf("SimGEKI: Loading config from %s\n", ini_path);
+// Called on the report thread, which is the game's poll thread in polled
+// mode: the profile writes go to a thread pool thread
+void config_save_lever_calib(const calib_points_t* points) {
+  if (points == NULL) {
+    return;
+  }
 
-  read_ini_hex_field("input", "VID", ini_path, cfg.vid_num,
-                     sizeof(cfg.vid_num), "VID");
-  read_ini_hex_field("input", "PID", ini_path, cfg.pid_num,
-                     sizeof(cfg.pid_num), "PID");
-  read_ini_hex_field("input", "MI", ini_path, cfg.mi_num,
-                     sizeof(cfg.mi_num), "MI");
+  LONG64 packed = CONFIG_CALIB_PENDING | (LONG64)points->min |
+                  (LONG64)points->center << 16 | (LONG64)points->max << 32;
+  if (InterlockedExchange64(&config_calib_pending, packed) != 0) {
+    return;  // Not saved yet, the queued save picks up these points
+  }
+  if (!QueueUserWorkItem(config_save_lever_calib_proc, NULL,
+                         WT_EXECUTELONGFUNCTION)) {
+    config_save_lever_calib_proc(NULL);
+  }
+}
 
-  read_ini_uint8("input", "keyboard", ini_path, &cfg.keyboard_enabled);
+bool config_load_hid_path(const char* key, char* path, size_t path_size) {
+  char cache_path[MAX_PATH] = {0};
 
-  if(cfg.keyboard_enabled != 0) {
-    dprintf("SimGEKI: Keyboard input enabled.\n");
+  if (!cfg.path_cache_enabled || key == NULL || path == NULL ||
+      path_size == 0 ||
+      !build_module_path(HID_PATH_CACHE_FILE, cache_path,
+                         sizeof(cache_path))) {
+    return false;
   }
 
-  read_ini_uint8("input", "test", ini_path, &cfg.test_keycode);
-  read_ini_uint8("input", "service", ini_path, &cfg.service_keycode);
-  read_ini_uint8("input", "coin", ini_path, &cfg.coin_keycode);
+  DWORD len = GetPrivateProfileStringA("hid", key, "", path, (DWORD)path_size,
+                                       cache_path);
+  return len > 0 && len < path_size - 1;
+}
+
+void config_save_hid_path(const char* key, const char* path) {
+  char cache_path[MAX_PATH] = {0};
 
-  read_ini_uint8("input", "left1", ini_path, &cfg.gamebtn_L1_keycode);
-  read_ini_uint8("input", "left2", ini_path, &cfg.gamebtn_L2_keycode);
-  read_ini_uint8("input", "left3", ini_path, &cfg.gamebtn_L3_keycode);
-  read_ini_uint8("input", "leftSide", ini_path, &cfg.gamebtn_Lside_keycode);
-  read_ini_uint8("input", "leftMenu", ini_path, &cfg.gamebtn_Lmenu_keycode);
+  if (!cfg.path_cache_enabled || key == NULL || path == NULL ||
+      !build_module_path(HID_PATH_CACHE_FILE, cache_path,
+                         sizeof(cache_path))) {
+    return;
+  }
 
-  read_ini_uint8("input", "right1", ini_path, &cfg.gamebtn_R1_keycode);
-  read_ini_uint8("input", "right2", ini_path, &cfg.gamebtn_R2_keycode);
-  read_ini_uint8("input", "right3", ini_path, &cfg.gamebtn_R3_keycode);
-  read_ini_uint8("input", "rightSide", ini_path,
-                 &cfg.gamebtn_Rside_keycode);
-  read_ini_uint8("input", "rightMenu", ini_path,
-                 &cfg.gamebtn_Rmenu_keycode);
+  if (!WritePrivateProfileStringA("hid", key, path, cache_path)) {
+    dprintf("SimGEKI: Failed to write device path cache %s\n", cache_path);
+  }
 }
@@ -1,7 +1,14 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "calib.h"
+#include "color.h"
+#include "lever.h"
+#include "platform.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -28,12 +35,75 @@ typedef struct {
   uint8_t gamebtn_Rside_keycode;
   uint8_t gamebtn_Rmenu_keycode;
 
+  uint8_t reader_thread_enabled;
+  uint8_t shared_hub_enabled;
+  uint8_t path_cache_enabled;  // Remember the device path across runs
+  uint8_t read_buffers;  // HID reads kept in flight, 1..TRANSPORT_MAX_READS
+  uint8_t completion_port;  // I/O completion port engine, else events
+  char trace_path[260];  // Record HID reports to this file, empty = off
+  uint16_t stream_timeout_ms;  // Restart streaming after this gap, 0 = never
+  uint8_t log_level;  // DLOG_* level, messages above it are skipped
+  uint32_t tp_mask;     // Trace points recorded, 1 << TP_*, 0 = none
+  uint32_t tp_records;  // Trace point ring size
+  char tp_dump_path[260];  // Trace point dump file, empty = no dump
+  uint8_t reload_enabled;  // Re-read simgeki_io.ini when it changes
+
+  uint8_t lever_filter_enabled;
+  lever_filter_params_t lever_filter;
+  uint8_t lever_predict_enabled;
+  lever_predict_params_t lever_predict;
+  uint8_t lever_calibrate;      // Learn a new calibration at startup
+  calib_points_t lever_calib;   // Raw min/center/max, all 0 = none
+
+  uint16_t led_max_rate;  // Max LED frames per second and board, 0 = no limit
+  uint8_t led_stream;     // Send all board 0 LEDs with SP_LED_STREAM
+  color_params_t led_color;  // Board 0 gamma, brightness, limit, layout
+
 } MU3IO_CONFIG;
 
+// Settings that can change while running (see config_watch_start()) are
+// single fields, updated with one store each
 extern MU3IO_CONFIG cfg;
 
+// Device match strings built from VID/PID/MI, upper case
+typedef struct {
+  char vid[16];  // "VID_0CA3"
+  char pid[16];  // "PID_0021"
+  char mi[16];   // "MI_05"
+  char key[48];  // "VID_0CA3&PID_0021&MI_05", the path cache key
+} config_hid_match_t;
+
+// Called on the watcher thread once a reload is published; old holds the
+// values cfg had before
+typedef void (*config_reload_fn)(const MU3IO_CONFIG* old);
+
+// Last good device path per VID/PID/MI, stored next to simgeki_io.ini
+#define HID_PATH_CACHE_FILE "simgeki_io.cache"
+
+// Read simgeki_io.ini into cfg, in one pass over the file.
 void config_load_from_ini(void);
 
+// Current device match strings. Republished as a new copy when VID/PID/MI
+// change; a returned copy never changes and stays valid, so the strings of
+// one call always belong together. NULL before config_load_from_ini().
+const config_hid_match_t* config_hid_match(void);
+
+// Watch simgeki_io.ini and re-read it whenever it is saved. The settings
+// that take effect while running (keys, VID/PID/MI, log level, trace points,
+// lever prediction, LEDs) are copied into cfg and on_reload applies them;
+// the others are reported as needing a restart. Does nothing when reload is
+// disabled in the ini.
+HRESULT config_watch_start(config_reload_fn on_reload);
+
+// Look up / store the cached device path for key ("VID_xxxx&PID_xxxx&MI_xx").
+// Both do nothing when pathCache is disabled.
+bool config_load_hid_path(const char* key, char* path, size_t path_size);
+void config_save_hid_path(const char* key, const char* path);
+
+// Store a learnt lever calibration in simgeki_io.ini and clear calibrate.
+// Returns right away, the file is written on a thread pool thread.
+void config_save_lever_calib(const calib_points_t* points);
+
 #ifdef __cplusplus
 }
 #endif
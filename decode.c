@@ -0,0 +1,62 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decode.h"
+#include "mu3io.h"
+
+uint32_t decode_table_lo[256];
+uint32_t decode_table_hi[256];
+
+#define TO_OPBTN(b) ((uint32_t)(b))
+#define TO_LEFT(b) ((uint32_t)(b) << 8)
+#define TO_RIGHT(b) ((uint32_t)(b) << 16)
+
+// input_status bit -> decoded bit. Inverted buttons are reported when the
+// input bit is clear (the side buttons are wired active-low).
+static const struct {
+  uint16_t input_bit;
+  uint32_t output_bit;
+  bool inverted;
+} decode_map[] = {
+    {BT_COIN, TO_OPBTN(MU3_IO_OPBTN_COIN), false},      // 硬币投币按钮
+    {BT_TEST, TO_OPBTN(MU3_IO_OPBTN_TEST), false},      // 测试按钮
+    {BT_SERVICE, TO_OPBTN(MU3_IO_OPBTN_SERVICE), false},  // 服务按钮
+    {BT_R_A, TO_RIGHT(MU3_IO_GAMEBTN_1), false},        // 右侧按钮1
+    {BT_R_B, TO_RIGHT(MU3_IO_GAMEBTN_2), false},        // 右侧按钮2
+    {BT_R_C, TO_RIGHT(MU3_IO_GAMEBTN_3), false},        // 右侧按钮3
+    {BT_L_A, TO_LEFT(MU3_IO_GAMEBTN_1), false},         // 左侧按钮1
+    {BT_L_B, TO_LEFT(MU3_IO_GAMEBTN_2), false},         // 左侧按钮2
+    {BT_L_C, TO_LEFT(MU3_IO_GAMEBTN_3), false},         // 左侧按钮3
+    {BT_LSIDE, TO_LEFT(MU3_IO_GAMEBTN_SIDE), true},     // 左侧侧键
+    {BT_RSIDE, TO_RIGHT(MU3_IO_GAMEBTN_SIDE), true},    // 右侧侧键
+    {BT_RMENU, TO_RIGHT(MU3_IO_GAMEBTN_MENU), false},   // 右侧菜单键
+    {BT_LMENU, TO_LEFT(MU3_IO_GAMEBTN_MENU), false},    // 左侧菜单键
+};
+
+void decode_init(void) {
+  for (uint32_t byte = 0; byte < 256; byte++) {
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+
+    for (size_t i = 0; i < sizeof(decode_map) / sizeof(decode_map[0]); i++) {
+      uint16_t bit = decode_map[i].input_bit;
+      // Each input bit lives in exactly one byte, so the inversion can be
+      // baked into that byte's table and the lookups simply OR together.
+      if (bit & 0x00FF) {
+        bool set = (byte & bit) != 0;
+        if (set != decode_map[i].inverted) {
+          lo |= decode_map[i].output_bit;
+        }
+      } else {
+        bool set = (byte & (bit >> 8)) != 0;
+        if (set != decode_map[i].inverted) {
+          hi |= decode_map[i].output_bit;
+        }
+      }
+    }
+
+    decode_table_lo[byte] = lo;
+    decode_table_hi[byte] = hi;
+  }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Decoded buttons, same layout as the low 24 bits of an input snapshot:
+     [7:0] opbtn (MU3_IO_OPBTN_*), [15:8] left, [23:16] right
+   (MU3_IO_GAMEBTN_*). Side buttons are already inverted. */
+#define DECODE_OPBTN(b) ((uint8_t)(b))
+#define DECODE_LEFT(b) ((uint8_t)((b) >> 8))
+#define DECODE_RIGHT(b) ((uint8_t)((b) >> 16))
+
+extern uint32_t decode_table_lo[256];
+extern uint32_t decode_table_hi[256];
+
+/* Build the input_status lookup tables from the BT_* mapping. Must be called
+   once before decode_input_status(); calling it again is harmless. */
+void decode_init(void);
+
+/* Map a report's 16-bit input_status to opbtn/left/right bits: one lookup
+   per byte, no branches. */
+static inline uint32_t decode_input_status(uint16_t input_status) {
+  return decode_table_lo[input_status & 0xFF] |
+         decode_table_hi[input_status >> 8];
+}
@@ -0,0 +1,143 @@
+#include "decode.h"
+#include "mu3io.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define BENCH_ROUNDS 2000  // 2000 * 65536 decodes per decoder
+
+static volatile uint32_t bench_sink;
+
+void print_separator(const char* title) {
+  printf("\n========== %s ==========\n", title);
+}
+
+static double now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER freq, now;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return (double)now.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+// The branchy decoder hid_on_data() used before the lookup tables, kept
+// verbatim as the reference for the equivalence test.
+static uint32_t decode_reference(uint16_t input_status) {
+  uint8_t mu3_opbtn = 0;
+  if (input_status & BT_COIN) {
+    mu3_opbtn |= MU3_IO_OPBTN_COIN;
+  }
+  if (input_status & BT_TEST) {
+    mu3_opbtn |= MU3_IO_OPBTN_TEST;
+  }
+  if (input_status & BT_SERVICE) {
+    mu3_opbtn |= MU3_IO_OPBTN_SERVICE;
+  }
+  uint8_t mu3_left_btn = 0;
+  uint8_t mu3_right_btn = 0;
+  if (input_status & BT_R_A) {
+    mu3_right_btn |= MU3_IO_GAMEBTN_1;
+  }
+  if (input_status & BT_R_B) {
+    mu3_right_btn |= MU3_IO_GAMEBTN_2;
+  }
+  if (input_status & BT_R_C) {
+    mu3_right_btn |= MU3_IO_GAMEBTN_3;
+  }
+  if (input_status & BT_L_A) {
+    mu3_left_btn |= MU3_IO_GAMEBTN_1;
+  }
+  if (input_status & BT_L_B) {
+    mu3_left_btn |= MU3_IO_GAMEBTN_2;
+  }
+  if (input_status & BT_L_C) {
+    mu3_left_btn |= MU3_IO_GAMEBTN_3;
+  }
+  if (input_status & BT_LSIDE) {
+    mu3_left_btn |= MU3_IO_GAMEBTN_SIDE;
+  }
+  if (input_status & BT_RSIDE) {
+    mu3_right_btn |= MU3_IO_GAMEBTN_SIDE;
+  }
+  if (input_status & BT_RMENU) {
+    mu3_right_btn |= MU3_IO_GAMEBTN_MENU;
+  }
+  if (input_status & BT_LMENU) {
+    mu3_left_btn |= MU3_IO_GAMEBTN_MENU;
+  }
+  mu3_left_btn ^= MU3_IO_GAMEBTN_SIDE;
+  mu3_right_btn ^= MU3_IO_GAMEBTN_SIDE;
+  return (uint32_t)mu3_opbtn | ((uint32_t)mu3_left_btn << 8) |
+         ((uint32_t)mu3_right_btn << 16);
+}
+
+static bool test_equivalence(void) {
+  print_separator("Equivalence Test");
+
+  int mismatches = 0;
+  for (uint32_t status = 0; status <= 0xFFFF; status++) {
+    uint32_t expected = decode_reference((uint16_t)status);
+    uint32_t actual = decode_input_status((uint16_t)status);
+    if (expected != actual) {
+      if (mismatches < 10) {
+        printf("Mismatch at 0x%04X: expected %06X, got %06X\n",
+               (unsigned)status, (unsigned)expected, (unsigned)actual);
+      }
+      mismatches++;
+    }
+  }
+
+  printf("Checked 65536 inputs, %d mismatches\n", mismatches);
+  return mismatches == 0;
+}
+
+// Feed both decoders the same pseudo-random input sequence so the branchy
+// version cannot profit from perfectly predictable bits.
+static void bench_decoder(const char* name, uint32_t (*decode)(uint16_t)) {
+  uint32_t lfsr = 0xACE1u;
+  uint32_t acc = 0;
+  double start = now_ns();
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    for (uint32_t i = 0; i < 0x10000; i++) {
+      lfsr = lfsr * 1103515245u + 12345u;
+      acc ^= decode((uint16_t)(lfsr >> 16));
+    }
+  }
+  double elapsed = now_ns() - start;
+  bench_sink = acc;
+  printf("%-10s %.3f ns/decode\n", name,
+         elapsed / ((double)BENCH_ROUNDS * 0x10000));
+}
+
+static uint32_t decode_table(uint16_t input_status) {
+  return decode_input_status(input_status);
+}
+
+int main() {
+  printf("========================================\n");
+  printf("      SimGEKI input decode test\n");
+  printf("========================================\n");
+
+  decode_init();
+
+  bool ok = test_equivalence();
+
+  print_separator("Decode Benchmark");
+  bench_decoder("branchy", decode_reference);
+  bench_decoder("table", decode_table);
+
+  print_separator(ok ? "PASSED" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -3,6 +3,8 @@
 
 #include "util/dprintf.h"
 
+#include "tracepoint.h"
+
 #include <stdio.h>
 #include <winreg.h>
 #include <string.h>
@@ -159,9 +161,7 @@ HRESULT GetHidPathByVidPidMi(const char* vid,
   for (i = 0;; i++) {
     deviceInfoData.cbSize = sizeof(SP_DEVINFO_DATA);
     if (!SetupDiEnumDeviceInfo(deviceInfoSet, i, &deviceInfoData)) {
-#ifdef DEBUG
-      printf("SetupDiEnumDeviceInfo failed.\n");
-#endif
+      TP(TP_ENUM, i, TP_ENUM_END, GetLastError());
       break;
     }
 
@@ -171,17 +171,11 @@ HRESULT GetHidPathByVidPidMi(const char* vid,
       continue;
     }
 
-// dprintf("Testing device: %s\n", hardwareId);
-#ifdef DEBUG
-    printf("Testing device: %s\n", hardwareId);
-#endif
+    TP(TP_ENUM, i, TP_ENUM_TESTED, 0);
 
     if (strstr(hardwareId, vid) && strstr(hardwareId, pid) &&
         strstr(hardwareId, mi)) {
-// dprintf("Testing Passed: %s\n", hardwareId);
-#ifdef DEBUG
-      printf("Found device with VID: %s, PID: %s, MI: %s\n", vid, pid, mi);
-#endif
+      TP(TP_ENUM, i, TP_ENUM_MATCHED, 0);
 
       SP_DEVICE_INTERFACE_DATA deviceInterfaceData = {
           sizeof(SP_DEVICE_INTERFACE_DATA)};
@@ -223,13 +217,6 @@ HRESULT GetHidPathByVidPidMi(const char* vid,
         }
         free(detailData);
       } else {
-#ifdef DEBUG
-        // dprintf("SetupDiEnumDeviceInterfaces Hacked, trying registry
-        // method...\n");
-        printf(
-            "SetupDiEnumDeviceInterfaces failed, trying registry method...\n");
-#endif
-
         char devicePath[1024];
         size_t pathSize = sizeof(devicePath);
         HRESULT hr =
@@ -250,6 +237,7 @@ HRESULT GetHidPathByVidPidMi(const char* vid,
         }
 
         DWORD err = GetLastError();
+        TP(TP_ENUM, i, TP_ENUM_NO_PATH, err);
         dprintf("ERR: EnumDeviceInterfaces failed: 0x%08X\n", err);
       }
     }
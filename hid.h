@@ -7,8 +7,6 @@
 #include <hidclass.h>
 #include <stdint.h>
 
-// #define DEBUG
-
 HRESULT GetHidPathByVidPidMi(const char* vid,
                              const char* pid,
                              const char* mi,
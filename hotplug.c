@@ -0,0 +1,188 @@
+#include <windows.h>
+
+#include <cfgmgr32.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "util/dprintf.h"
+
+#include "config.h"
+#include "hid.h"
+#include "hotplug.h"
+
+// Fallback retry timer, doubled after every failed attempt
+#define HOTPLUG_BACKOFF_MIN_MS 250
+#define HOTPLUG_BACKOFF_MAX_MS 8000
+// With arrival notifications the timer is only a safety net
+#define HOTPLUG_BACKOFF_MAX_NOTIFY_MS 60000
+
+typedef CONFIGRET(WINAPI* cm_register_notification_fn)(PCM_NOTIFY_FILTER,
+                                                        PVOID,
+                                                        PCM_NOTIFY_CALLBACK,
+                                                        PHCMNOTIFICATION);
+
+static hotplug_connect_fn hotplug_connect = NULL;
+static HANDLE hotplug_thread = NULL;
+static HANDLE hotplug_lost_event = NULL;       // Manual-reset, device missing
+static HANDLE hotplug_connected_event = NULL;  // Manual-reset, device ready
+static HANDLE hotplug_arrival_event = NULL;    // Auto-reset, HID arrival
+static HCMNOTIFICATION hotplug_notification = NULL;
+// Makes "lost" and "connected" change together, so a reconnect requested
+// while the worker connects is never overwritten
+static CRITICAL_SECTION hotplug_lock;
+
+// Is the interface symbolic link one of ours?
+static bool hotplug_is_our_device(const WCHAR* symbolic_link) {
+  char link[512];
+
+  if (WideCharToMultiByte(CP_ACP, 0, symbolic_link, -1, link, sizeof(link),
+                          NULL, NULL) == 0) {
+    // Can't tell, let the worker have a look
+    return true;
+  }
+  _strupr_s(link, sizeof(link));
+
+  // Read on every notification, so a config reload changes the filter too
+  const config_hid_match_t* match = config_hid_match();
+  return strstr(link, match->vid) != NULL && strstr(link, match->pid) != NULL;
+}
+
+static DWORD CALLBACK hotplug_notify_proc(HCMNOTIFICATION notification,
+                                          PVOID context,
+                                          CM_NOTIFY_ACTION action,
+                                          PCM_NOTIFY_EVENT_DATA data,
+                                          DWORD data_size) {
+  (void)notification;
+  (void)context;
+  (void)data_size;
+
+  if (!hotplug_is_our_device(data->u.DeviceInterface.SymbolicLink)) {
+    return ERROR_SUCCESS;
+  }
+
+  if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL) {
+    dprintf("SimGEKI: USB device arrival notified.\n");
+    SetEvent(hotplug_arrival_event);
+  } else if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL) {
+    // The pending read fails as well and triggers the actual cleanup
+    dprintf("SimGEKI: USB device removal notified.\n");
+  }
+
+  return ERROR_SUCCESS;
+}
+
+// CM_Register_Notification needs Windows 8; load it dynamically so the DLL
+// still runs (timer only) on older systems
+static bool hotplug_register_notification(void) {
+  HMODULE cfgmgr = LoadLibraryA("cfgmgr32.dll");
+  if (cfgmgr == NULL) {
+    return false;
+  }
+
+  cm_register_notification_fn cm_register = (cm_register_notification_fn)(
+      void*)GetProcAddress(cfgmgr, "CM_Register_Notification");
+  if (cm_register == NULL) {
+    return false;
+  }
+
+  CM_NOTIFY_FILTER filter;
+  memset(&filter, 0, sizeof(filter));
+  filter.cbSize = sizeof(filter);
+  filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+  filter.u.DeviceInterface.ClassGuid = GUID_DEVINTERFACE_HID;
+
+  return cm_register(&filter, NULL, hotplug_notify_proc,
+                     &hotplug_notification) == CR_SUCCESS;
+}
+
+static DWORD WINAPI hotplug_thread_proc(LPVOID param) {
+  (void)param;
+  bool notify = hotplug_register_notification();
+  DWORD backoff_max =
+      notify ? HOTPLUG_BACKOFF_MAX_NOTIFY_MS : HOTPLUG_BACKOFF_MAX_MS;
+  DWORD backoff = HOTPLUG_BACKOFF_MIN_MS;
+
+  dprintf("SimGEKI: Reconnect worker started (%s).\n",
+          notify ? "arrival notifications" : "timer only");
+
+  for (;;) {
+    // Idle until someone reports the device as lost
+    WaitForSingleObject(hotplug_lost_event, INFINITE);
+
+    // Cleared before connecting: the new connection may fail again (in the
+    // reader, right after it was published) before connect returns
+    ResetEvent(hotplug_lost_event);
+    if (hotplug_connect() == S_OK) {
+      EnterCriticalSection(&hotplug_lock);
+      bool lost_again =
+          WaitForSingleObject(hotplug_lost_event, 0) == WAIT_OBJECT_0;
+      if (!lost_again) {
+        SetEvent(hotplug_connected_event);
+      }
+      LeaveCriticalSection(&hotplug_lock);
+
+      if (!lost_again) {
+        backoff = HOTPLUG_BACKOFF_MIN_MS;
+        dprintf("SimGEKI: USB device reconnected successfully.\n");
+        continue;
+      }
+      // Failed right away, retry with backoff like any failed attempt
+      dprintf("SimGEKI: USB device lost again while connecting.\n");
+    }
+    SetEvent(hotplug_lost_event);
+
+    if (WaitForSingleObject(hotplug_arrival_event, backoff) ==
+        WAIT_OBJECT_0) {
+      // A matching device just showed up, retry quickly from now on
+      backoff = HOTPLUG_BACKOFF_MIN_MS;
+    } else if (backoff < backoff_max) {
+      backoff = backoff * 2 < backoff_max ? backoff * 2 : backoff_max;
+    }
+  }
+
+  return 0;
+}
+
+HRESULT hotplug_start(hotplug_connect_fn connect, bool connected) {
+  if (hotplug_thread != NULL) {
+    return S_OK;
+  }
+
+  hotplug_connect = connect;
+  InitializeCriticalSection(&hotplug_lock);
+  hotplug_lost_event = CreateEvent(NULL, TRUE, !connected, NULL);
+  hotplug_connected_event = CreateEvent(NULL, TRUE, connected, NULL);
+  hotplug_arrival_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (hotplug_lost_event == NULL || hotplug_connected_event == NULL ||
+      hotplug_arrival_event == NULL) {
+    return HRESULT_FROM_WIN32(GetLastError());
+  }
+
+  hotplug_thread = CreateThread(NULL, 0, hotplug_thread_proc, NULL, 0, NULL);
+  if (hotplug_thread == NULL) {
+    return HRESULT_FROM_WIN32(GetLastError());
+  }
+
+  return S_OK;
+}
+
+void hotplug_request_reconnect(void) {
+  if (hotplug_thread == NULL) {
+    return;
+  }
+
+  EnterCriticalSection(&hotplug_lock);
+  ResetEvent(hotplug_connected_event);
+  SetEvent(hotplug_lost_event);
+  LeaveCriticalSection(&hotplug_lock);
+}
+
+bool hotplug_wait_connected(DWORD timeout_ms) {
+  if (hotplug_thread == NULL) {
+    return false;
+  }
+
+  return WaitForSingleObject(hotplug_connected_event, timeout_ms) ==
+         WAIT_OBJECT_0;
+}
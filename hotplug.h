@@ -0,0 +1,24 @@
+#pragma once
+
+#include <windows.h>
+
+#include <stdbool.h>
+
+/* Background (re)connection worker. Device enumeration never runs on a game
+   thread: the worker calls the connect function whenever the device is
+   missing, woken by HID interface arrival notifications
+   (CM_Register_Notification) and by a fallback timer with exponential
+   backoff for systems where notifications are unavailable. */
+
+typedef HRESULT (*hotplug_connect_fn)(void);
+
+/* Start the worker. If connected is false it starts connecting right away.
+   Safe to call more than once. */
+HRESULT hotplug_start(hotplug_connect_fn connect, bool connected);
+
+/* Report that the device was lost (after usb_cleanup()), so the worker
+   starts reconnecting. */
+void hotplug_request_reconnect(void);
+
+/* Wait up to timeout_ms for the worker to (re)connect the device. */
+bool hotplug_wait_connected(DWORD timeout_ms);
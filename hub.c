@@ -0,0 +1,357 @@
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/dprintf.h"
+
+#include "hub.h"
+#include "input.h"
+#include "led.h"
+#include "mu3io.h"
+
+#define HUB_MAPPING_NAME "Local\\SimGEKI_IO_Hub"
+#define HUB_OWNER_MUTEX_NAME "Local\\SimGEKI_IO_Owner"
+#define HUB_LED_EVENT_NAME "Local\\SimGEKI_IO_LedEvent"
+
+#define HUB_MAGIC 0x4255484B  // "KHUB"
+#define HUB_VERSION 3
+
+// Attempts to read a slot while the client is writing it
+#define HUB_SEQLOCK_RETRIES 4
+
+// hub_wait_input() checks for the owner's first input this often
+#define HUB_WAIT_POLL_MS 5
+
+typedef struct {
+  volatile LONG seq;    // Odd while the client is writing the frame
+  volatile LONG dirty;  // Set by the client, cleared by the owner
+  HidconfigData frame;
+} hub_led_slot_t;
+
+// Full board 0 frame for SP_LED_STREAM, same protocol as the report slots
+typedef struct {
+  volatile LONG seq;
+  volatile LONG dirty;
+  uint8_t leds;
+  uint8_t rgb[LED_STREAM_LEDS * 3];
+} hub_led_stream_slot_t;
+
+typedef struct {
+  volatile LONG magic;
+  LONG version;
+  volatile LONG owner_pid;
+  volatile input_snapshot_t snapshot;  // Latest input from the owner
+  volatile LONG64 snapshot_qpc;        // Its decode time (system-wide QPC)
+  volatile LONG pressed;               // Presses not yet seen by the client
+  hub_led_slot_t led[LED_BOARD_COUNT];
+  hub_led_stream_slot_t led_stream;
+} hub_shared_t;
+
+static hub_shared_t* hub = NULL;
+static HANDLE hub_mapping = NULL;
+static HANDLE hub_owner_mutex = NULL;
+static HANDLE hub_event = NULL;
+static HANDLE hub_ready = NULL;  // Signalled after the initial election
+static HANDLE hub_stop = NULL;   // Makes the hub thread give up its role
+static HANDLE hub_thread = NULL;
+static hub_promote_fn hub_on_promote = NULL;
+static volatile LONG hub_current_role = HUB_ROLE_NONE;
+
+// Serializes LED writers inside the client process
+static CRITICAL_SECTION hub_led_lock;
+
+static void hub_become_owner(bool promoted) {
+  // A previous owner's last input is stale, and it may have died before it
+  // could clear it
+  InterlockedExchange64(&hub->snapshot_qpc, 0);
+  InterlockedExchange(&hub->pressed, 0);
+  InterlockedExchange(&hub->owner_pid, (LONG)GetCurrentProcessId());
+  InterlockedExchange(&hub_current_role, HUB_ROLE_OWNER);
+
+  // Already the owner here: the promote hook starts the reader, which only
+  // waits on hub_led_event() for owners
+  if (promoted) {
+    dprintf("SimGEKI: Hub owner exited, taking over the device.\n");
+    if (hub_on_promote != NULL) {
+      hub_on_promote();
+    }
+  }
+}
+
+// Runs on the hub thread, which owns the mutex: it must stay alive until
+// ownership is given up, or the mutex is abandoned under the client
+static void hub_hold_ownership(void) {
+  WaitForSingleObject(hub_stop, INFINITE);
+
+  InterlockedExchange64(&hub->snapshot_qpc, 0);
+  InterlockedExchange(&hub->owner_pid, 0);
+  InterlockedExchange(&hub_current_role, HUB_ROLE_NONE);
+  ReleaseMutex(hub_owner_mutex);
+}
+
+static DWORD WINAPI hub_thread_proc(LPVOID param) {
+  (void)param;
+
+  DWORD wait = WaitForSingleObject(hub_owner_mutex, 0);
+  if (wait == WAIT_OBJECT_0 || wait == WAIT_ABANDONED) {
+    hub_become_owner(false);
+    SetEvent(hub_ready);
+    hub_hold_ownership();
+    return 0;
+  }
+
+  InterlockedExchange(&hub_current_role, HUB_ROLE_CLIENT);
+  dprintf("SimGEKI: Hub client attached, device owned by process %ld.\n",
+          hub->owner_pid);
+  SetEvent(hub_ready);
+
+  // Sleep until the owner releases or abandons the mutex
+  HANDLE handles[2] = {hub_owner_mutex, hub_stop};
+  wait = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+  if (wait == WAIT_OBJECT_0 || wait == WAIT_ABANDONED_0) {
+    hub_become_owner(true);
+    hub_hold_ownership();
+  }
+
+  return 0;
+}
+
+HRESULT hub_init(hub_promote_fn on_promote) {
+  HRESULT hr;
+
+  if (hub != NULL) {
+    return S_OK;
+  }
+
+  hub_on_promote = on_promote;
+  InitializeCriticalSection(&hub_led_lock);
+
+  hub_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                   0, sizeof(hub_shared_t), HUB_MAPPING_NAME);
+  if (hub_mapping == NULL) {
+    return HRESULT_FROM_WIN32(GetLastError());
+  }
+
+  hub = (hub_shared_t*)MapViewOfFile(hub_mapping, FILE_MAP_ALL_ACCESS, 0, 0,
+                                     sizeof(hub_shared_t));
+  if (hub == NULL) {
+    hr = HRESULT_FROM_WIN32(GetLastError());
+    CloseHandle(hub_mapping);
+    hub_mapping = NULL;
+    return hr;
+  }
+
+  // A fresh mapping is zero-filled; whoever gets here first stamps it
+  if (InterlockedCompareExchange(&hub->magic, HUB_MAGIC, 0) == 0) {
+    hub->version = HUB_VERSION;
+  } else if (hub->magic != HUB_MAGIC || hub->version != HUB_VERSION) {
+    dprintf("SimGEKI: Hub mapping has an incompatible layout.\n");
+    hr = E_FAIL;
+    goto fail;
+  }
+
+  hub_owner_mutex = CreateMutexA(NULL, FALSE, HUB_OWNER_MUTEX_NAME);
+  hub_event = CreateEventA(NULL, FALSE, FALSE, HUB_LED_EVENT_NAME);
+  hub_ready = CreateEvent(NULL, TRUE, FALSE, NULL);
+  hub_stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (hub_owner_mutex == NULL || hub_event == NULL || hub_ready == NULL ||
+      hub_stop == NULL) {
+    hr = HRESULT_FROM_WIN32(GetLastError());
+    goto fail;
+  }
+
+  hub_thread = CreateThread(NULL, 0, hub_thread_proc, NULL, 0, NULL);
+  if (hub_thread == NULL) {
+    hr = HRESULT_FROM_WIN32(GetLastError());
+    goto fail;
+  }
+
+  WaitForSingleObject(hub_ready, INFINITE);
+  atexit(hub_shutdown);
+  return S_OK;
+
+fail:
+  if (hub_stop != NULL) {
+    CloseHandle(hub_stop);
+    hub_stop = NULL;
+  }
+  if (hub_ready != NULL) {
+    CloseHandle(hub_ready);
+    hub_ready = NULL;
+  }
+  if (hub_event != NULL) {
+    CloseHandle(hub_event);
+    hub_event = NULL;
+  }
+  if (hub_owner_mutex != NULL) {
+    CloseHandle(hub_owner_mutex);
+    hub_owner_mutex = NULL;
+  }
+  UnmapViewOfFile(hub);
+  hub = NULL;
+  CloseHandle(hub_mapping);
+  hub_mapping = NULL;
+  return hr;
+}
+
+void hub_shutdown(void) {
+  // At process exit the hub thread is already gone and the mutex abandoned,
+  // which the client handles the same way
+  if (hub_stop != NULL) {
+    SetEvent(hub_stop);
+  }
+}
+
+hub_role_t hub_role(void) {
+  return (hub_role_t)hub_current_role;
+}
+
+void hub_publish_input(input_snapshot_t state,
+                       uint32_t pressed,
+                       LONGLONG qpc) {
+  if (hub_current_role != HUB_ROLE_OWNER) {
+    return;
+  }
+
+  // A client may pair a new timestamp with the previous state, which only
+  // shortens its prediction by one report
+  InterlockedExchange64(&hub->snapshot_qpc, qpc);
+  snapshot_store(&hub->snapshot, state);
+  if (pressed != 0) {
+    InterlockedOr(&hub->pressed, (LONG)pressed);
+  }
+}
+
+void hub_publish_disconnect(void) {
+  if (hub_current_role != HUB_ROLE_OWNER) {
+    return;
+  }
+
+  InterlockedExchange64(&hub->snapshot_qpc, 0);
+}
+
+input_snapshot_t hub_fold_input(LONGLONG* qpc) {
+  if (hub == NULL) {
+    *qpc = 0;
+    return 0;
+  }
+
+  input_snapshot_t state = snapshot_load(&hub->snapshot);
+  *qpc = InterlockedCompareExchange64(&hub->snapshot_qpc, 0, 0);
+  uint32_t pressed = (uint32_t)InterlockedExchange(&hub->pressed, 0);
+  return state | (input_snapshot_t)pressed;
+}
+
+bool hub_wait_input(DWORD timeout_ms) {
+  DWORD start = GetTickCount();
+
+  // Only used while starting up, a short sleep loop is good enough
+  while (hub != NULL &&
+         InterlockedCompareExchange64(&hub->snapshot_qpc, 0, 0) == 0) {
+    if (GetTickCount() - start >= timeout_ms) {
+      return false;
+    }
+    Sleep(HUB_WAIT_POLL_MS);
+  }
+  return hub != NULL;
+}
+
+void hub_submit_led(uint8_t board, const HidconfigData* data) {
+  if (hub == NULL || board >= LED_BOARD_COUNT || data == NULL) {
+    return;
+  }
+
+  hub_led_slot_t* slot = &hub->led[board];
+
+  EnterCriticalSection(&hub_led_lock);
+  InterlockedIncrement(&slot->seq);
+  memcpy((void*)&slot->frame, data, sizeof(*data));
+  InterlockedIncrement(&slot->seq);
+  LeaveCriticalSection(&hub_led_lock);
+
+  // Only wake the owner when the slot goes from idle to dirty
+  if (InterlockedExchange(&slot->dirty, 1) == 0) {
+    SetEvent(hub_event);
+  }
+}
+
+void hub_submit_led_stream(const uint8_t* rgb, uint8_t leds) {
+  if (hub == NULL || rgb == NULL || leds > LED_STREAM_LEDS) {
+    return;
+  }
+
+  hub_led_stream_slot_t* slot = &hub->led_stream;
+
+  EnterCriticalSection(&hub_led_lock);
+  InterlockedIncrement(&slot->seq);
+  slot->leds = leds;
+  memcpy(slot->rgb, rgb, leds * 3u);
+  InterlockedIncrement(&slot->seq);
+  LeaveCriticalSection(&hub_led_lock);
+
+  if (InterlockedExchange(&slot->dirty, 1) == 0) {
+    SetEvent(hub_event);
+  }
+}
+
+static void hub_drain_led_stream(void) {
+  hub_led_stream_slot_t* slot = &hub->led_stream;
+  uint8_t rgb[sizeof(slot->rgb)];
+  uint8_t leds;
+
+  if (slot->dirty == 0 || InterlockedExchange(&slot->dirty, 0) == 0) {
+    return;
+  }
+
+  for (int retry = 0; retry < HUB_SEQLOCK_RETRIES; retry++) {
+    LONG begin = InterlockedCompareExchange(&slot->seq, 0, 0);
+    if (begin & 1) {
+      break;
+    }
+    leds = slot->leds;
+    memcpy(rgb, slot->rgb, sizeof(rgb));
+    MemoryBarrier();
+    if (InterlockedCompareExchange(&slot->seq, 0, 0) == begin) {
+      led_submit_stream(rgb, leds);
+      break;
+    }
+  }
+}
+
+void hub_drain_leds(void) {
+  if (hub_current_role != HUB_ROLE_OWNER) {
+    return;
+  }
+
+  hub_drain_led_stream();
+
+  for (uint8_t board = 0; board < LED_BOARD_COUNT; board++) {
+    hub_led_slot_t* slot = &hub->led[board];
+    HidconfigData frame;
+
+    if (slot->dirty == 0 || InterlockedExchange(&slot->dirty, 0) == 0) {
+      continue;
+    }
+
+    for (int retry = 0; retry < HUB_SEQLOCK_RETRIES; retry++) {
+      LONG begin = InterlockedCompareExchange(&slot->seq, 0, 0);
+      if (begin & 1) {
+        // Writer is inside; it marks the slot dirty again when done
+        break;
+      }
+      memcpy(&frame, (const void*)&slot->frame, sizeof(frame));
+      MemoryBarrier();
+      if (InterlockedCompareExchange(&slot->seq, 0, 0) == begin) {
+        led_submit(board, &frame);
+        break;
+      }
+    }
+  }
+}
+
+HANDLE hub_led_event(void) {
+  return hub_current_role == HUB_ROLE_OWNER ? hub_event : NULL;
+}
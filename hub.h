@@ -0,0 +1,73 @@
+#pragma once
+
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "input.h"
+#include "mu3io.h"
+
+/* Board 0 LEDs come from the mu3 process and board 1 from amdaemon, and both
+   load this DLL. Only one of them (the owner) opens the HID device; the other
+   attaches as a client through a named file mapping:
+
+   - the owner publishes every decoded report into the mapping,
+   - the client reads inputs from it and hands LED frames over through one
+     seqlock slot per board, which the owner forwards to the device.
+
+   Ownership is a named mutex held by a hub thread, which stays alive until
+   hub_shutdown() or process exit. The client's hub thread blocks on the
+   same mutex and takes over when the owner releases it or exits (the mutex
+   is then abandoned). */
+
+typedef enum {
+  HUB_ROLE_NONE = 0,  // Hub disabled, this process talks to the device
+  HUB_ROLE_OWNER,     // This process owns the device and serves the client
+  HUB_ROLE_CLIENT,    // Another process owns the device
+} hub_role_t;
+
+/* Called on the hub thread right before a client becomes the owner. */
+typedef void (*hub_promote_fn)(void);
+
+/* Create or attach to the shared mapping and run the initial election.
+   Returns once the role of this process is known. */
+HRESULT hub_init(hub_promote_fn on_promote);
+
+/* Give up the role: an owner releases the device to the client. Registered
+   with atexit by hub_init(). */
+void hub_shutdown(void);
+
+hub_role_t hub_role(void);
+
+/* Owner: publish a decoded report for the client. pressed holds the buttons
+   that went down in this report, so the client sees short taps too; qpc is
+   its decode time. */
+void hub_publish_input(input_snapshot_t state,
+                       uint32_t pressed,
+                       LONGLONG qpc);
+
+/* Owner: the device disconnected, the published input is no longer live. */
+void hub_publish_disconnect(void);
+
+/* Client: latest input from the owner with all presses since the last call
+   OR-ed in. *qpc receives its decode time, 0 if unknown. */
+input_snapshot_t hub_fold_input(LONGLONG* qpc);
+
+/* Client: wait up to timeout_ms for the owner to publish its first input,
+   that is for the owner's device to be connected. */
+bool hub_wait_input(DWORD timeout_ms);
+
+/* Client: hand an LED frame to the owner. Never blocks. */
+void hub_submit_led(uint8_t board, const HidconfigData* data);
+
+/* Client: hand a board 0 frame of leds RGB values to the owner for
+   SP_LED_STREAM. Never blocks. */
+void hub_submit_led_stream(const uint8_t* rgb, uint8_t leds);
+
+/* Owner: forward LED frames the client submitted since the last call. */
+void hub_drain_leds(void);
+
+/* Owner: auto-reset event signalled when the client submits a frame into an
+   idle slot, NULL when the hub is disabled. */
+HANDLE hub_led_event(void);
@@ -0,0 +1,153 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ini.h"
+
+static bool ini_is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Copy [start, end) without surrounding whitespace, truncated to size - 1
+static void ini_copy_trimmed(char* out,
+                             size_t size,
+                             const char* start,
+                             const char* end) {
+  while (start < end && ini_is_space(*start)) {
+    start++;
+  }
+  while (end > start && ini_is_space(end[-1])) {
+    end--;
+  }
+
+  size_t len = (size_t)(end - start);
+  if (len > size - 1) {
+    len = size - 1;
+  }
+  memcpy(out, start, len);
+  out[len] = '\0';
+}
+
+bool ini_name_equal(const char* a, const char* b) {
+  for (;; a++, b++) {
+    char ca = *a >= 'A' && *a <= 'Z' ? (char)(*a | 0x20) : *a;
+    char cb = *b >= 'A' && *b <= 'Z' ? (char)(*b | 0x20) : *b;
+    if (ca != cb) {
+      return false;
+    }
+    if (ca == '\0') {
+      return true;
+    }
+  }
+}
+
+size_t ini_parse(const char* text, size_t len, ini_handler_fn handler,
+                 void* ctx) {
+  char section[INI_MAX_NAME] = "";
+  char key[INI_MAX_NAME];
+  char value[INI_MAX_VALUE];
+  const char* p = text;
+  const char* end = text + len;
+  size_t keys = 0;
+
+  // UTF-8 byte order mark, as written by Notepad
+  if (len >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+    p += 3;
+  }
+
+  while (p < end) {
+    const char* eol = memchr(p, '\n', (size_t)(end - p));
+    if (eol == NULL) {
+      eol = end;
+    }
+    const char* line = p;
+    p = eol < end ? eol + 1 : end;
+
+    while (line < eol && ini_is_space(*line)) {
+      line++;
+    }
+    if (line == eol || *line == ';' || *line == '#') {
+      continue;
+    }
+
+    if (*line == '[') {
+      const char* close = memchr(line, ']', (size_t)(eol - line));
+      if (close != NULL) {
+        ini_copy_trimmed(section, sizeof(section), line + 1, close);
+      }
+      continue;
+    }
+
+    const char* equals = memchr(line, '=', (size_t)(eol - line));
+    if (equals == NULL) {
+      continue;
+    }
+    ini_copy_trimmed(key, sizeof(key), line, equals);
+    if (key[0] == '\0') {
+      continue;
+    }
+
+    const char* v = equals + 1;
+    const char* v_end = eol;
+    while (v < v_end && ini_is_space(*v)) {
+      v++;
+    }
+    const char* quote_end =
+        v < v_end && *v == '"' ? memchr(v + 1, '"', (size_t)(v_end - v - 1))
+                               : NULL;
+    if (quote_end != NULL) {
+      v++;
+      v_end = quote_end;
+    } else {
+      const char* comment = memchr(v, ';', (size_t)(v_end - v));
+      if (comment != NULL) {
+        v_end = comment;
+      }
+    }
+    ini_copy_trimmed(value, sizeof(value), v, v_end);
+
+    keys++;
+    if (!handler(ctx, section, key, value)) {
+      break;
+    }
+  }
+
+  return keys;
+}
+
+HRESULT ini_parse_file(const char* path, ini_handler_fn handler, void* ctx,
+                       size_t* keys) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return E_FAIL;
+  }
+
+  long size = -1;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    size = ftell(file);
+    rewind(file);
+  }
+  if (size < 0 || size > (long)INI_MAX_FILE) {
+    fclose(file);
+    return E_FAIL;
+  }
+
+  char* text = malloc(size > 0 ? (size_t)size : 1);
+  if (text == NULL) {
+    fclose(file);
+    return E_OUTOFMEMORY;
+  }
+
+  size_t len = fread(text, 1, (size_t)size, file);
+  bool failed = ferror(file) != 0;
+  fclose(file);
+
+  size_t count = failed ? 0 : ini_parse(text, len, handler, ctx);
+  free(text);
+  if (keys != NULL) {
+    *keys = count;
+  }
+  return failed ? E_FAIL : S_OK;
+}
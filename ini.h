@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "platform.h"
+
+/* Single-pass ini reader. The file is read into memory once and every
+   "key = value" line is handed to a callback together with its section, in
+   file order, instead of looking each key up with GetPrivateProfileStringA
+   (which opens and scans the file again for every key).
+
+   Follows the profile API where it matters for simgeki_io.ini: section and
+   key names are matched case-insensitively (ini_name_equal), whitespace
+   around names and values is trimmed, "; comments" are stripped from lines
+   and values, and a value in double quotes loses its quotes. */
+
+#define INI_MAX_NAME 64
+#define INI_MAX_VALUE 512  // Longer values are truncated
+#define INI_MAX_FILE (1u << 20)  // Bigger files are refused
+
+// Return false to stop parsing
+typedef bool (*ini_handler_fn)(void* ctx,
+                               const char* section,
+                               const char* key,
+                               const char* value);
+
+/* Parse len bytes of ini text. Returns the number of keys handed to the
+   handler. */
+size_t ini_parse(const char* text, size_t len, ini_handler_fn handler,
+                 void* ctx);
+
+/* Read path in one go and parse it. keys (optional) receives the number of
+   keys parsed. */
+HRESULT ini_parse_file(const char* path, ini_handler_fn handler, void* ctx,
+                       size_t* keys);
+
+/* ASCII case-insensitive comparison of section and key names. */
+bool ini_name_equal(const char* a, const char* b);
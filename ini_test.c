@@ -0,0 +1,254 @@
+#include "ini.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Host-native test and benchmark of the single-pass ini reader, against the
+   simgeki_io.ini that ships with the DLL. */
+
+#define SHIPPED_INI "simgeki_io.ini"
+#define BENCH_ROUNDS 2000
+#define MAX_ENTRIES 96
+
+typedef struct {
+  char section[INI_MAX_NAME];
+  char key[INI_MAX_NAME];
+  char value[INI_MAX_VALUE];
+} entry_t;
+
+typedef struct {
+  entry_t entries[MAX_ENTRIES];
+  size_t count;
+  size_t stop_after;  // 0 = never stop
+} collect_t;
+
+static volatile size_t bench_sink;
+
+void print_separator(const char* title) {
+  printf("\n========== %s ==========\n", title);
+}
+
+static double now_ns(void) {
+#ifdef _WIN32
+  LARGE_INTEGER freq, now;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return (double)now.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+static bool collect(void* ctx,
+                    const char* section,
+                    const char* key,
+                    const char* value) {
+  collect_t* c = (collect_t*)ctx;
+
+  if (c->count < MAX_ENTRIES) {
+    entry_t* e = &c->entries[c->count];
+    strcpy(e->section, section);
+    strcpy(e->key, key);
+    strcpy(e->value, value);
+  }
+  c->count++;
+  return c->stop_after == 0 || c->count < c->stop_after;
+}
+
+static bool count_only(void* ctx,
+                       const char* section,
+                       const char* key,
+                       const char* value) {
+  (void)section;
+  (void)key;
+  (void)value;
+  (*(size_t*)ctx)++;
+  return true;
+}
+
+static bool expect(const collect_t* c,
+                   size_t index,
+                   const char* section,
+                   const char* key,
+                   const char* value) {
+  if (index >= c->count || strcmp(c->entries[index].section, section) != 0 ||
+      strcmp(c->entries[index].key, key) != 0 ||
+      strcmp(c->entries[index].value, value) != 0) {
+    printf("FAIL: entry %zu, expected [%s] %s = \"%s\"", index, section, key,
+           value);
+    if (index < c->count) {
+      printf(", got [%s] %s = \"%s\"", c->entries[index].section,
+             c->entries[index].key, c->entries[index].value);
+    }
+    printf("\n");
+    return false;
+  }
+  return true;
+}
+
+static bool test_syntax(void) {
+  print_separator("Syntax");
+
+  static const char text[] =
+      "\xEF\xBB\xBF"
+      "top = before any section\n"
+      "; comment line\r\n"
+      "# another comment\n"
+      "\n"
+      "  [ input ]  \r\n"
+      "VID = 0CA3\r\n"
+      "rightSide = 0xBA ;;\n"
+      "\tleft1=0x53;S\n"
+      "no equals sign here\n"
+      " = no key\n"
+      "trace =\n"
+      "[io]\n"
+      "tracePointDump = \"dir;with;semicolons.tpt\" ; comment\n"
+      "logLevel = debug   ";
+  collect_t c;
+  memset(&c, 0, sizeof(c));
+
+  size_t keys = ini_parse(text, sizeof(text) - 1, collect, &c);
+  bool ok = keys == 7 && c.count == 7;
+  if (!ok) {
+    printf("FAIL: %zu keys, expected 7\n", keys);
+  }
+  ok = expect(&c, 0, "", "top", "before any section") && ok;
+  ok = expect(&c, 1, "input", "VID", "0CA3") && ok;
+  ok = expect(&c, 2, "input", "rightSide", "0xBA") && ok;
+  ok = expect(&c, 3, "input", "left1", "0x53") && ok;
+  ok = expect(&c, 4, "input", "trace", "") && ok;
+  ok = expect(&c, 5, "io", "tracePointDump", "dir;with;semicolons.tpt") && ok;
+  ok = expect(&c, 6, "io", "logLevel", "debug") && ok;
+
+  // The handler can stop the parse
+  memset(&c, 0, sizeof(c));
+  c.stop_after = 2;
+  keys = ini_parse(text, sizeof(text) - 1, collect, &c);
+  if (keys != 2) {
+    printf("FAIL: parse went on after the handler stopped it (%zu)\n", keys);
+    ok = false;
+  }
+
+  // Names are matched like the profile API matches them
+  if (!ini_name_equal("rightSide", "RIGHTSIDE") ||
+      !ini_name_equal("io", "IO") || ini_name_equal("left1", "left") ||
+      ini_name_equal("led", "lex")) {
+    printf("FAIL: ini_name_equal\n");
+    ok = false;
+  }
+
+  // Overlong values are truncated, never overflow
+  char long_text[INI_MAX_VALUE * 2 + 16];
+  memset(long_text, 'x', sizeof(long_text));
+  memcpy(long_text, "k = ", 4);
+  memset(&c, 0, sizeof(c));
+  ini_parse(long_text, sizeof(long_text), collect, &c);
+  if (c.count != 1 || strlen(c.entries[0].value) != INI_MAX_VALUE - 1) {
+    printf("FAIL: long value not truncated\n");
+    ok = false;
+  }
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+static bool test_shipped(void) {
+  print_separator("Shipped " SHIPPED_INI);
+
+  collect_t c;
+  size_t keys = 0;
+  memset(&c, 0, sizeof(c));
+
+  if (ini_parse_file(SHIPPED_INI, collect, &c, &keys) != S_OK) {
+    printf("FAIL: cannot read %s\n", SHIPPED_INI);
+    return false;
+  }
+
+  bool ok = keys == c.count && keys >= 40;
+  if (!ok) {
+    printf("FAIL: %zu keys\n", keys);
+  }
+  ok = expect(&c, 0, "input", "VID", "0CA3") && ok;
+
+  bool found_side = false;
+  bool found_level = false;
+  for (size_t i = 0; i < c.count && i < MAX_ENTRIES; i++) {
+    if (ini_name_equal(c.entries[i].key, "rightSide")) {
+      found_side = strcmp(c.entries[i].value, "0xBA") == 0;
+    }
+    if (ini_name_equal(c.entries[i].key, "logLevel")) {
+      found_level = strcmp(c.entries[i].section, "io") == 0;
+    }
+  }
+  if (!found_side || !found_level) {
+    printf("FAIL: rightSide/logLevel not read as expected\n");
+    ok = false;
+  }
+
+  if (ini_parse_file("does_not_exist.ini", collect, &c, NULL) == S_OK) {
+    printf("FAIL: missing file parsed\n");
+    ok = false;
+  }
+
+  printf("%zu keys, %s\n", keys, ok ? "OK" : "FAILED");
+  return ok;
+}
+
+static void bench(void) {
+  print_separator("Benchmark");
+
+  size_t keys = 0;
+  if (ini_parse_file(SHIPPED_INI, count_only, &keys, NULL) != S_OK ||
+      keys == 0) {
+    printf("Cannot read %s\n", SHIPPED_INI);
+    return;
+  }
+
+  double start = now_ns();
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    size_t n = 0;
+    ini_parse_file(SHIPPED_INI, count_only, &n, NULL);
+    bench_sink = n;
+  }
+  double once = (now_ns() - start) / BENCH_ROUNDS;
+
+  // What looking up every key on its own costs: one open and scan per key,
+  // like GetPrivateProfileStringA does
+  start = now_ns();
+  for (int i = 0; i < BENCH_ROUNDS / 10; i++) {
+    for (size_t k = 0; k < keys; k++) {
+      size_t n = 0;
+      ini_parse_file(SHIPPED_INI, count_only, &n, NULL);
+      bench_sink = n;
+    }
+  }
+  double per_key = (now_ns() - start) / (BENCH_ROUNDS / 10);
+
+  printf("%zu keys\n", keys);
+  printf("One pass:          %8.1f us\n", once / 1000.0);
+  printf("One scan per key:  %8.1f us\n", per_key / 1000.0);
+}
+
+int main(void) {
+  printf("========================================\n");
+  printf("       SimGEKI ini reader test\n");
+  printf("========================================\n");
+
+  bool ok = test_syntax();
+  ok = test_shipped() && ok;
+  bench();
+
+  print_separator(ok ? "PASSED" : "FAILED");
+  return ok ? 0 : 1;
+}
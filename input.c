@@ -0,0 +1,101 @@
+#include "platform.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "input.h"
+
+// Latest decoded input, written by whoever drains the HID reads
+static volatile input_snapshot_t live_snapshot = 0;
+static volatile LONG64 live_qpc = 0;
+// Previous decoded buttons, only touched by the producer
+static uint32_t prev_buttons = 0;
+
+// Single-producer/single-consumer ring of decoded reports. ring_head is only
+// written by the producer, ring_tail only by the consumer.
+static input_event_t ring[INPUT_RING_SIZE];
+static volatile LONG ring_head = 0;
+static volatile LONG ring_tail = 0;
+
+// Press edges of events that did not fit into the ring
+static volatile LONG overflow_pressed = 0;
+static volatile LONG overflow_count = 0;
+
+uint32_t input_publish(uint32_t buttons, int16_t lever, int16_t velocity) {
+  input_event_t* ev;
+  input_snapshot_t state = SNAPSHOT_FROM_INPUT(buttons, lever, velocity);
+  uint32_t pressed, released;
+  LARGE_INTEGER now;
+  LONG head = ring_head;
+
+  buttons = SNAPSHOT_BUTTONS(state);
+  pressed = buttons & ~prev_buttons;
+  released = prev_buttons & ~buttons;
+  prev_buttons = buttons;
+  QueryPerformanceCounter(&now);
+
+  if ((ULONG)(head - ring_tail) >= INPUT_RING_SIZE) {
+    // Ring full: keep the edges so no press gets lost, drop the rest
+    InterlockedOr(&overflow_pressed, (LONG)pressed);
+    InterlockedIncrement(&overflow_count);
+  } else {
+    ev = &ring[head & (INPUT_RING_SIZE - 1)];
+    ev->qpc = now.QuadPart;
+    ev->state = state;
+    ev->pressed = pressed;
+    ev->released = released;
+    // Full barrier: the event must be visible before the new head
+    InterlockedExchange(&ring_head, head + 1);
+  }
+
+  InterlockedExchange64(&live_qpc, now.QuadPart);
+  snapshot_store(&live_snapshot, state);
+  return pressed;
+}
+
+input_snapshot_t input_live(void) {
+  return snapshot_load(&live_snapshot);
+}
+
+LONGLONG input_live_qpc(void) {
+  return InterlockedCompareExchange64(&live_qpc, 0, 0);
+}
+
+// Decode time of the newest report folded, only touched by the consumer
+static LONGLONG folded_qpc = 0;
+
+input_snapshot_t input_fold_pending(void) {
+  static LONG seen_overflow = 0;
+  static input_snapshot_t last_state = 0;
+  LONG head = InterlockedCompareExchange(&ring_head, 0, 0);
+  LONG tail = ring_tail;
+  LONG overflow;
+  uint32_t pressed = 0;
+
+  for (; tail != head; tail++) {
+    const input_event_t* ev = &ring[tail & (INPUT_RING_SIZE - 1)];
+    pressed |= ev->pressed;
+    last_state = ev->state;
+    folded_qpc = ev->qpc;
+  }
+  InterlockedExchange(&ring_tail, tail);
+
+  // Events were dropped: the newest state only lives in the live snapshot
+  overflow = InterlockedCompareExchange(&overflow_count, 0, 0);
+  if (overflow != seen_overflow) {
+    seen_overflow = overflow;
+    pressed |= (uint32_t)InterlockedExchange(&overflow_pressed, 0);
+    last_state = snapshot_load(&live_snapshot);
+    folded_qpc = InterlockedCompareExchange64(&live_qpc, 0, 0);
+  }
+
+  return last_state | (input_snapshot_t)pressed;
+}
+
+LONGLONG input_folded_qpc(void) {
+  return folded_qpc;
+}
+
+uint32_t input_dropped_events(void) {
+  return (uint32_t)InterlockedCompareExchange(&overflow_count, 0, 0);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "platform.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Packed input snapshot, published with a single 64-bit atomic store so that
+// buttons and lever are always read together:
+//   [7:0] opbtn, [15:8] left, [23:16] right, [47:32] lever (two's complement)
+//   [63:48] lever velocity (two's complement, lever.h units)
+// The button bits use the decode.h layout.
+typedef LONG64 input_snapshot_t;
+
+#define SNAPSHOT_FROM_BUTTONS(buttons, lever)  \
+  ((input_snapshot_t)(((uint64_t)((buttons) & 0xFFFFFF)) | \
+                      ((uint64_t)(uint16_t)(lever) << 32)))
+#define SNAPSHOT_FROM_INPUT(buttons, lever, velocity)  \
+  ((input_snapshot_t)((uint64_t)SNAPSHOT_FROM_BUTTONS(buttons, lever) | \
+                      ((uint64_t)(uint16_t)(velocity) << 48)))
+#define SNAPSHOT_OPBTN(s) ((uint8_t)((uint64_t)(s)))
+#define SNAPSHOT_LEFT(s) ((uint8_t)((uint64_t)(s) >> 8))
+#define SNAPSHOT_RIGHT(s) ((uint8_t)((uint64_t)(s) >> 16))
+#define SNAPSHOT_LEVER(s) ((int16_t)(uint16_t)((uint64_t)(s) >> 32))
+#define SNAPSHOT_LEVER_VELOCITY(s) ((int16_t)(uint16_t)((uint64_t)(s) >> 48))
+#define SNAPSHOT_BUTTONS(s) ((uint32_t)((uint64_t)(s) & 0xFFFFFF))
+
+// Capacity of the decoded report ring, must be a power of two. 256 entries
+// cover a quarter second of 1 kHz reports between two polls.
+#define INPUT_RING_SIZE 256
+
+typedef struct {
+  LONGLONG qpc;            // QueryPerformanceCounter at decode time
+  input_snapshot_t state;  // Decoded input carried by the report
+  uint32_t pressed;        // Buttons that went down in this report
+  uint32_t released;       // Buttons that went up in this report
+} input_event_t;
+
+static inline void snapshot_store(volatile input_snapshot_t* target,
+                                  input_snapshot_t value) {
+  InterlockedExchange64(target, value);
+}
+
+static inline input_snapshot_t snapshot_load(
+    volatile input_snapshot_t* source) {
+  // Aligned 64-bit loads are atomic on x64; the compare-exchange keeps this
+  // correct on 32-bit builds as well.
+  return InterlockedCompareExchange64(source, 0, 0);
+}
+
+/* Publish a decoded report: computes the button edges against the previous
+   report, updates the live snapshot and appends an event to the ring.
+   buttons uses the decode.h layout (the low 24 bits of a snapshot), velocity
+   the lever.h units.
+
+   Returns the buttons that went down in this report.
+
+   Must only be called from one thread at a time (the ring producer). */
+uint32_t input_publish(uint32_t buttons, int16_t lever, int16_t velocity);
+
+/* Latest decoded input, regardless of polling. */
+input_snapshot_t input_live(void);
+
+/* Decode time (QueryPerformanceCounter) of input_live(). */
+LONGLONG input_live_qpc(void);
+
+/* Consume every pending event and return the input to present for this poll:
+   the newest state with every button that was pressed in any pending report
+   OR-ed in, so a tap shorter than the poll interval is still seen once.
+
+   Must only be called from one thread at a time (the ring consumer). */
+input_snapshot_t input_fold_pending(void);
+
+/* Decode time (QueryPerformanceCounter) of the newest report included by the
+   last input_fold_pending(), 0 before the first report. Consumer side only. */
+LONGLONG input_folded_qpc(void);
+
+/* Number of events that could not be queued because the ring was full. Their
+   press edges are still folded into the next poll. */
+uint32_t input_dropped_events(void);
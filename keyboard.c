@@ -0,0 +1,317 @@
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/dprintf.h"
+
+#include "config.h"
+#include "keyboard.h"
+#include "mu3io.h"
+
+#define KEYBOARD_WINDOW_CLASS "SimGEKI_IO_Keyboard"
+#define KEYBOARD_MAX_KEYS 13  // Number of *_keycode fields in the config
+// Raw Input registrations of the process looked at when checking who owns
+// the keyboard one
+#define KEYBOARD_MAX_REGISTRATIONS 16
+// How often the listener checks that the game has not taken the keyboard
+// registration over
+#define KEYBOARD_CHECK_TIMER 1
+#define KEYBOARD_CHECK_MS 1000
+
+typedef struct {
+  // keycode -> buttons (decode.h layout), 0 = unmapped
+  uint32_t map[256];
+  // Distinct mapped keycodes, to rebuild the held mask without a 256 scan
+  uint8_t keys[KEYBOARD_MAX_KEYS];
+  int key_count;
+} keyboard_layout_t;
+
+// Rebuilt on the heap and published with one pointer swap, so the listener
+// always sees one whole layout. Never changed or freed once published, a
+// reader may still hold it; there is one per saved key mapping.
+static keyboard_layout_t* volatile keyboard_active = NULL;
+
+// Only touched by the listener thread
+static bool keyboard_down[256];
+
+static volatile LONG keyboard_held = 0;     // Buttons held right now
+static volatile LONG keyboard_pressed = 0;  // Pressed since the last fold
+
+static HANDLE keyboard_thread = NULL;
+static volatile bool keyboard_raw_active = false;
+
+static void keyboard_map_key(keyboard_layout_t* layout,
+                             uint8_t keycode,
+                             uint32_t buttons) {
+  if (keycode == 0) {
+    return;
+  }
+
+  if (layout->map[keycode] == 0 && layout->key_count < KEYBOARD_MAX_KEYS) {
+    layout->keys[layout->key_count++] = keycode;
+  }
+  layout->map[keycode] |= buttons;
+}
+
+static void keyboard_build_map(void) {
+  const keyboard_layout_t* active = keyboard_active;
+  keyboard_layout_t* layout = (keyboard_layout_t*)malloc(sizeof(*layout));
+
+  if (layout == NULL) {
+    return;  // Keep the current keys
+  }
+  memset(layout, 0, sizeof(*layout));
+
+  keyboard_map_key(layout, cfg.test_keycode, MU3_IO_OPBTN_TEST);
+  keyboard_map_key(layout, cfg.service_keycode, MU3_IO_OPBTN_SERVICE);
+  keyboard_map_key(layout, cfg.coin_keycode, MU3_IO_OPBTN_COIN);
+
+  keyboard_map_key(layout, cfg.gamebtn_L1_keycode, MU3_IO_GAMEBTN_1 << 8);
+  keyboard_map_key(layout, cfg.gamebtn_L2_keycode, MU3_IO_GAMEBTN_2 << 8);
+  keyboard_map_key(layout, cfg.gamebtn_L3_keycode, MU3_IO_GAMEBTN_3 << 8);
+  keyboard_map_key(layout, cfg.gamebtn_Lside_keycode,
+                   MU3_IO_GAMEBTN_SIDE << 8);
+  keyboard_map_key(layout, cfg.gamebtn_Lmenu_keycode,
+                   MU3_IO_GAMEBTN_MENU << 8);
+
+  keyboard_map_key(layout, cfg.gamebtn_R1_keycode, MU3_IO_GAMEBTN_1 << 16);
+  keyboard_map_key(layout, cfg.gamebtn_R2_keycode, MU3_IO_GAMEBTN_2 << 16);
+  keyboard_map_key(layout, cfg.gamebtn_R3_keycode, MU3_IO_GAMEBTN_3 << 16);
+  keyboard_map_key(layout, cfg.gamebtn_Rside_keycode,
+                   MU3_IO_GAMEBTN_SIDE << 16);
+  keyboard_map_key(layout, cfg.gamebtn_Rmenu_keycode,
+                   MU3_IO_GAMEBTN_MENU << 16);
+
+  if (active != NULL && memcmp(active, layout, sizeof(*layout)) == 0) {
+    free(layout);
+    return;
+  }
+  InterlockedExchangePointer((PVOID volatile*)&keyboard_active, layout);
+}
+
+static void keyboard_on_key(uint8_t keycode, bool down) {
+  const keyboard_layout_t* layout = keyboard_active;
+  uint32_t buttons = layout != NULL ? layout->map[keycode] : 0;
+
+  // Unmapped key, or auto-repeat of a key that is already down
+  if (buttons == 0 || keyboard_down[keycode] == down) {
+    return;
+  }
+  keyboard_down[keycode] = down;
+
+  uint32_t held = 0;
+  for (int i = 0; i < layout->key_count; i++) {
+    if (keyboard_down[layout->keys[i]]) {
+      held |= layout->map[layout->keys[i]];
+    }
+  }
+
+  // Publish the press edge first so a fold never sees it without the state
+  if (down) {
+    InterlockedOr(&keyboard_pressed, (LONG)buttons);
+  }
+  InterlockedExchange(&keyboard_held, (LONG)held);
+}
+
+// Raw Input has one keyboard registration per process. Returns 1 and its
+// target window if there is one, 0 if not, -1 if it can't be read.
+static int keyboard_registration(HWND* target) {
+  RAWINPUTDEVICE devices[KEYBOARD_MAX_REGISTRATIONS];
+  UINT count = KEYBOARD_MAX_REGISTRATIONS;
+  UINT found = GetRegisteredRawInputDevices(devices, &count,
+                                            sizeof(devices[0]));
+
+  if (found == (UINT)-1) {
+    return -1;
+  }
+  for (UINT i = 0; i < found; i++) {
+    if (devices[i].usUsagePage == 0x01 && devices[i].usUsage == 0x06) {
+      *target = devices[i].hwndTarget;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// A later RegisterRawInputDevices by the game silently replaces ours and
+// WM_INPUT stops arriving: hand the keys over to polling
+static void keyboard_check_registration(HWND hwnd) {
+  HWND target = NULL;
+
+  if (keyboard_registration(&target) == 1 && target == hwnd) {
+    return;
+  }
+
+  dprintf("SimGEKI: The game took over Raw keyboard input, polling keys.\n");
+  KillTimer(hwnd, KEYBOARD_CHECK_TIMER);
+  keyboard_raw_active = false;
+  InterlockedExchange(&keyboard_held, 0);
+  InterlockedExchange(&keyboard_pressed, 0);
+  PostQuitMessage(0);
+}
+
+// Raw Input reports the generic VK_SHIFT, VK_CONTROL and VK_MENU; bindings
+// may name a side (VK_LSHIFT..VK_RMENU), as GetAsyncKeyState() tells apart
+static uint8_t keyboard_sided_vkey(const RAWKEYBOARD* key) {
+  bool right = (key->Flags & RI_KEY_E0) != 0;
+
+  switch (key->VKey) {
+    case VK_SHIFT:
+      // Both shifts are plain scan codes: 0x2A left, 0x36 right
+      return key->MakeCode == 0x36 ? VK_RSHIFT : VK_LSHIFT;
+    case VK_CONTROL:
+      return right ? VK_RCONTROL : VK_LCONTROL;
+    case VK_MENU:
+      return right ? VK_RMENU : VK_LMENU;
+    default:
+      return (uint8_t)key->VKey;
+  }
+}
+
+static LRESULT CALLBACK keyboard_window_proc(HWND hwnd,
+                                             UINT msg,
+                                             WPARAM wparam,
+                                             LPARAM lparam) {
+  if (msg == WM_INPUT) {
+    RAWINPUT raw;
+    UINT size = sizeof(raw);
+
+    if (GetRawInputData((HRAWINPUT)lparam, RID_INPUT, &raw, &size,
+                        sizeof(RAWINPUTHEADER)) != (UINT)-1 &&
+        raw.header.dwType == RIM_TYPEKEYBOARD &&
+        raw.data.keyboard.VKey < 256) {
+      bool down = (raw.data.keyboard.Flags & RI_KEY_BREAK) == 0;
+      uint8_t sided = keyboard_sided_vkey(&raw.data.keyboard);
+
+      // A modifier marks both its generic and its sided code
+      keyboard_on_key((uint8_t)raw.data.keyboard.VKey, down);
+      if (sided != raw.data.keyboard.VKey) {
+        keyboard_on_key(sided, down);
+      }
+    }
+  } else if (msg == WM_TIMER && wparam == KEYBOARD_CHECK_TIMER) {
+    keyboard_check_registration(hwnd);
+    return 0;
+  }
+
+  return DefWindowProcA(hwnd, msg, wparam, lparam);
+}
+
+static DWORD WINAPI keyboard_thread_proc(LPVOID param) {
+  HANDLE ready_event = (HANDLE)param;
+  HINSTANCE instance = GetModuleHandleA(NULL);
+  HWND game_target = NULL;
+
+  // Registering would redirect the game's own keyboard WM_INPUT to our
+  // window, Unity players register theirs early
+  if (keyboard_registration(&game_target) == 1) {
+    dprintf("SimGEKI: The game reads the keyboard through Raw Input, "
+            "polling keys.\n");
+    SetEvent(ready_event);
+    return 1;
+  }
+
+  WNDCLASSA wc;
+  memset(&wc, 0, sizeof(wc));
+  wc.lpfnWndProc = keyboard_window_proc;
+  wc.hInstance = instance;
+  wc.lpszClassName = KEYBOARD_WINDOW_CLASS;
+  RegisterClassA(&wc);
+
+  // Message-only window: never shown, only receives WM_INPUT
+  HWND hwnd = CreateWindowExA(0, KEYBOARD_WINDOW_CLASS, NULL, 0, 0, 0, 0, 0,
+                              HWND_MESSAGE, NULL, instance, NULL);
+
+  RAWINPUTDEVICE rid;
+  rid.usUsagePage = 0x01;  // Generic desktop
+  rid.usUsage = 0x06;      // Keyboard
+  rid.dwFlags = RIDEV_INPUTSINK;  // This window never has the focus
+  rid.hwndTarget = hwnd;
+
+  if (hwnd == NULL || !RegisterRawInputDevices(&rid, 1, sizeof(rid))) {
+    dprintf("SimGEKI: Raw keyboard input unavailable (%lu), polling keys.\n",
+            (unsigned long)GetLastError());
+    if (hwnd != NULL) {
+      DestroyWindow(hwnd);
+    }
+    SetEvent(ready_event);
+    return 1;
+  }
+
+  keyboard_raw_active = true;
+  SetEvent(ready_event);
+  SetTimer(hwnd, KEYBOARD_CHECK_TIMER, KEYBOARD_CHECK_MS, NULL);
+
+  MSG msg;
+  while (GetMessageA(&msg, NULL, 0, 0) > 0) {
+    DispatchMessageA(&msg);
+  }
+
+  keyboard_raw_active = false;
+  DestroyWindow(hwnd);
+  return 0;
+}
+
+HRESULT keyboard_init(void) {
+  if (!cfg.keyboard_enabled || keyboard_thread != NULL) {
+    return S_OK;
+  }
+
+  keyboard_build_map();
+
+  HANDLE ready_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (ready_event == NULL) {
+    return HRESULT_FROM_WIN32(GetLastError());
+  }
+
+  keyboard_thread =
+      CreateThread(NULL, 0, keyboard_thread_proc, ready_event, 0, NULL);
+  if (keyboard_thread == NULL) {
+    CloseHandle(ready_event);
+    return HRESULT_FROM_WIN32(GetLastError());
+  }
+
+  // Registration is quick; waiting keeps the first polls deterministic
+  WaitForSingleObject(ready_event, INFINITE);
+  CloseHandle(ready_event);
+
+  if (keyboard_raw_active) {
+    dprintf("SimGEKI: Raw keyboard input listener started.\n");
+  }
+  return S_OK;
+}
+
+HRESULT keyboard_reload(void) {
+  if (keyboard_thread == NULL) {
+    return keyboard_init();
+  }
+
+  // A key that loses its mapping while held is released with the next key
+  // event
+  keyboard_build_map();
+  return S_OK;
+}
+
+uint32_t keyboard_fold(void) {
+  if (!cfg.keyboard_enabled) {
+    return 0;
+  }
+
+  if (!keyboard_raw_active) {
+    // Fallback: sample each mapped key once for this poll
+    const keyboard_layout_t* layout = keyboard_active;
+    uint32_t held = 0;
+    for (int i = 0; layout != NULL && i < layout->key_count; i++) {
+      if (GetAsyncKeyState(layout->keys[i]) & 0x8000) {
+        held |= layout->map[layout->keys[i]];
+      }
+    }
+    return held;
+  }
+
+  uint32_t pressed = (uint32_t)InterlockedExchange(&keyboard_pressed, 0);
+  return (uint32_t)keyboard_held | pressed;
+}
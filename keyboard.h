@@ -0,0 +1,28 @@
+#pragma once
+
+#include <windows.h>
+
+#include <stdint.h>
+
+/* Keyboard input backend. A listener thread receives WM_INPUT (Raw Input)
+   messages and keeps the mapped key state up to date, so reading it costs
+   one atomic load per poll. Keys map to buttons in the decode.h layout
+   through a 256-entry table built from the cfg.*_keycode fields. */
+
+/* Build the keycode table and start the listener thread. If Raw Input is
+   unavailable, or the game registered its own Raw Input keyboard (there is
+   one per process, ours would take its WM_INPUT away), keyboard_fold()
+   falls back to sampling the mapped keys with GetAsyncKeyState, once per
+   call. The listener checks its registration every second and falls back
+   the same way when the game registers later and replaces it. Safe to call
+   more than once. */
+HRESULT keyboard_init(void);
+
+/* Rebuild the keycode table from cfg after a config reload, and start the
+   listener if the keyboard was just enabled. Called on one thread at a
+   time; the listener switches to the new table in one step. */
+HRESULT keyboard_reload(void);
+
+/* Buttons held now, plus every button pressed since the last call, in the
+   decode.h layout. Returns 0 when the keyboard is disabled. */
+uint32_t keyboard_fold(void);
@@ -0,0 +1,385 @@
+#include "platform.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util/dprintf.h"
+
+#include "config.h"
+#include "led.h"
+#include "mu3io.h"
+#include "stats.h"
+
+typedef union {
+  HidconfigData report;  // SP_LED_SET report
+  struct {
+    uint8_t rgb[LED_STREAM_LEDS * 3];  // Zero past the last LED
+    uint8_t leds;
+  } stream;  // Streamed board 0 frame
+} led_frame_t;
+
+typedef struct {
+  CRITICAL_SECTION lock;
+  bool stream;  // Frames are streamed with SP_LED_STREAM
+  led_frame_t last_sent;
+  bool has_last_sent;
+  led_frame_t pending;  // Newest frame held back by the rate limit
+  bool has_pending;
+  LONGLONG pending_qpc;  // When the pending frame was submitted
+  LONGLONG last_send_qpc;
+  HANDLE flush_timer;  // One-shot timer-queue timer for the trailing flush
+  uint8_t seq;         // Sequence number of the last streamed frame
+} led_board_t;
+
+// Retry period of a trailing flush the output queue did not take
+#define LED_FLUSH_RETRY_MS 4
+
+static led_board_t led_boards[LED_BOARD_COUNT];
+static volatile LONG led_initialized = 0;
+static LONGLONG qpc_freq = 1;
+
+static led_stats_t led_stats;
+
+// Submit time of the frames on their way to the device, read back by
+// led_on_written() on the output worker for the completion latency
+static volatile LONG64 report_submit_qpc[LED_BOARD_COUNT];
+static volatile LONG64 stream_submit_qpc[256];
+
+static size_t led_frame_size(const led_board_t* board) {
+  return board->stream ? sizeof(board->last_sent.stream)
+                       : sizeof(board->last_sent.report);
+}
+
+// Queue the chunks of a streamed frame that differ from the last one sent,
+// all of them if full. Caller holds board->lock.
+static bool led_send_stream_locked(led_board_t* board,
+                                   const led_frame_t* frame,
+                                   LONGLONG submit_qpc,
+                                   bool full) {
+  const uint8_t* rgb = frame->stream.rgb;
+  uint8_t frame_leds = frame->stream.leds;
+  uint8_t changed[LED_STREAM_CHUNKS];
+  int count = 0;
+
+  // The previous frame is still in the output queue: queued behind it, this
+  // one could commit first or commit the other's chunks. Hold it back as
+  // the pending frame, led_on_written() sends it once that one is written.
+  if (hid_led_stream_queued()) {
+    if (frame != &board->pending) {
+      if (!board->has_pending) {
+        board->pending_qpc = submit_qpc;
+      }
+      memcpy(&board->pending, frame, sizeof(frame->stream));
+      board->has_pending = true;
+      InterlockedIncrement(&led_stats.deferred);
+    }
+    return false;
+  }
+
+  // A different LED count (new pillar layout) changes every chunk
+  full = full || !board->has_last_sent ||
+         board->last_sent.stream.leds != frame_leds;
+
+  for (uint8_t chunk = 0; chunk * LED_STREAM_CHUNK_LEDS < frame_leds;
+       chunk++) {
+    size_t offset = (size_t)chunk * LED_STREAM_CHUNK_LEDS * 3;
+    size_t leds = frame_leds - chunk * LED_STREAM_CHUNK_LEDS;
+    if (leds > LED_STREAM_CHUNK_LEDS) {
+      leds = LED_STREAM_CHUNK_LEDS;
+    }
+    if (full || memcmp(rgb + offset, board->last_sent.stream.rgb + offset,
+                       leds * 3) != 0) {
+      changed[count++] = chunk;
+    } else {
+      InterlockedIncrement(&led_stats.chunks_unchanged);
+    }
+  }
+
+  if (count == 0) {
+    return true;
+  }
+
+  uint8_t seq = (uint8_t)(board->seq + 1);
+  InterlockedExchange64(&stream_submit_qpc[seq], submit_qpc);
+
+  HidconfigData data = {0};
+  data.reportID = HIDCONFIG_REPORT_ID;
+  data.symbol = 0x02;
+  data.command = SP_LED_STREAM;
+  data.board_id = 0x00;
+  data.stream_seq = seq;
+
+  for (int i = 0; i < count; i++) {
+    uint8_t first = (uint8_t)(changed[i] * LED_STREAM_CHUNK_LEDS);
+    uint8_t leds = frame_leds - first > LED_STREAM_CHUNK_LEDS
+                       ? LED_STREAM_CHUNK_LEDS
+                       : (uint8_t)(frame_leds - first);
+    data.stream_offset = first;
+    data.stream_count = leds;
+    data.stream_flags = i == count - 1 ? LED_STREAM_COMMIT : 0;
+    memset(data.led_stream, 0, sizeof(data.led_stream));
+    memcpy(data.led_stream, rgb + first * 3, leds * 3);
+    if (hid_write_data((const char*)&data, sizeof(data)) != S_OK) {
+      // The chunks already queued carry seq but no commit. Give that number
+      // up and send the next frame whole under a new one, so no commit ever
+      // covers these stale chunks.
+      board->seq = seq;
+      board->has_last_sent = false;
+      return false;
+    }
+    InterlockedIncrement(&led_stats.chunks);
+  }
+
+  board->seq = seq;
+  return true;
+}
+
+// Caller holds board->lock. Returns false if the frame was not queued.
+static bool led_send_locked(led_board_t* board, const led_frame_t* frame,
+                            LONGLONG submit_qpc, LONGLONG now, bool full) {
+  if (board->stream) {
+    if (!led_send_stream_locked(board, frame, submit_qpc, full)) {
+      return false;
+    }
+  } else {
+    InterlockedExchange64(&report_submit_qpc[board - led_boards], submit_qpc);
+    if (hid_write_data((const char*)&frame->report, sizeof(frame->report)) !=
+        S_OK) {
+      // Not connected or queue full: keep comparing against the old frame
+      // so this one is retried on the next call
+      return false;
+    }
+  }
+
+  memcpy(&board->last_sent, frame, led_frame_size(board));
+  board->has_last_sent = true;
+  board->last_send_qpc = now;
+  board->has_pending = false;
+  InterlockedIncrement(&led_stats.sent);
+  return true;
+}
+
+static LONGLONG led_now(void) {
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  return now.QuadPart;
+}
+
+#ifdef _WIN32
+static void CALLBACK led_flush_timer_proc(PVOID param, BOOLEAN fired);
+
+// Caller holds board->lock
+static bool led_arm_flush_locked(led_board_t* board, DWORD due_ms) {
+  if (!CreateTimerQueueTimer(&board->flush_timer, NULL, led_flush_timer_proc,
+                             board, due_ms, 0, WT_EXECUTEONLYONCE)) {
+    dprintf("SimGEKI: Failed to arm LED flush timer: %lu\n",
+            (unsigned long)GetLastError());
+    board->flush_timer = NULL;
+    return false;
+  }
+  return true;
+}
+
+static void CALLBACK led_flush_timer_proc(PVOID param, BOOLEAN fired) {
+  led_board_t* board = (led_board_t*)param;
+  (void)fired;
+
+  EnterCriticalSection(&board->lock);
+  // Non-blocking delete from inside the callback; the timer is only marked
+  DeleteTimerQueueTimer(NULL, board->flush_timer, NULL);
+  board->flush_timer = NULL;
+  if (board->has_pending) {
+    if (led_send_locked(board, &board->pending, board->pending_qpc,
+                        led_now(), false)) {
+      InterlockedIncrement(&led_stats.flushed);
+    } else {
+      // Queue full, or not connected yet: the trailing frame must still go
+      // out, try again a little later
+      DWORD due_ms = cfg.led_max_rate != 0 ? 1000 / cfg.led_max_rate : 0;
+      led_arm_flush_locked(board, due_ms > LED_FLUSH_RETRY_MS
+                                      ? due_ms
+                                      : LED_FLUSH_RETRY_MS);
+    }
+  }
+  LeaveCriticalSection(&board->lock);
+}
+#endif  // _WIN32
+
+void led_init(void) {
+  if (InterlockedCompareExchange(&led_initialized, 1, 0) != 0) {
+    return;
+  }
+
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  qpc_freq = freq.QuadPart;
+
+  for (size_t i = 0; i < LED_BOARD_COUNT; i++) {
+    InitializeCriticalSection(&led_boards[i].lock);
+  }
+}
+
+static void led_submit_frame(uint8_t board_id,
+                             const led_frame_t* frame,
+                             bool stream) {
+  led_init();
+
+  led_board_t* board = &led_boards[board_id];
+  EnterCriticalSection(&board->lock);
+
+  if (board->stream != stream) {
+    // Switched between reports and streaming: nothing to compare against
+    board->stream = stream;
+    board->has_last_sent = false;
+    board->has_pending = false;
+  }
+
+  if (board->has_last_sent &&
+      memcmp(&board->last_sent, frame, led_frame_size(board)) == 0) {
+    // Back to what the device already shows: nothing left to flush
+    board->has_pending = false;
+    InterlockedIncrement(&led_stats.unchanged);
+    LeaveCriticalSection(&board->lock);
+    return;
+  }
+
+  LONGLONG now = led_now();
+  LONGLONG interval =
+      cfg.led_max_rate != 0 ? qpc_freq / cfg.led_max_rate : 0;
+  LONGLONG elapsed = now - board->last_send_qpc;
+
+  if (!board->has_last_sent || elapsed >= interval) {
+    led_send_locked(board, frame, now, now, false);
+  } else {
+    // A frame replaced while held back is late since the first submit
+    if (!board->has_pending) {
+      board->pending_qpc = now;
+    }
+    memcpy(&board->pending, frame, led_frame_size(board));
+    board->has_pending = true;
+    InterlockedIncrement(&led_stats.deferred);
+
+#ifdef _WIN32
+    if (board->flush_timer == NULL) {
+      // Round up so the flush never lands before the interval has passed
+      DWORD due_ms =
+          (DWORD)(((interval - elapsed) * 1000 + qpc_freq - 1) / qpc_freq);
+      if (!led_arm_flush_locked(board, due_ms)) {
+        led_send_locked(board, frame, now, now, false);
+      }
+    }
+#else
+    // Host builds have no timer queue: the held-back frame goes out with
+    // the next submit after the interval, or with led_resync()
+#endif  // _WIN32
+  }
+
+  LeaveCriticalSection(&board->lock);
+}
+
+void led_submit(uint8_t board_id, const HidconfigData* data) {
+  if (board_id >= LED_BOARD_COUNT || data == NULL) {
+    return;
+  }
+
+  led_frame_t frame;
+  frame.report = *data;
+  led_submit_frame(board_id, &frame, false);
+}
+
+void led_submit_stream(const uint8_t* rgb, uint8_t leds) {
+  if (rgb == NULL || leds == 0 || leds > LED_STREAM_LEDS) {
+    return;
+  }
+
+  led_frame_t frame;
+  memset(&frame.stream, 0, sizeof(frame.stream));
+  memcpy(frame.stream.rgb, rgb, leds * 3);
+  frame.stream.leds = leds;
+  led_submit_frame(0, &frame, true);
+}
+
+// A chunk of the newest streamed frame was written: send the frame held back
+// behind it once none of its chunks is left in the queue (it may have been
+// cut short without a commit), unless the rate limit's flush timer already
+// takes care of it. Frames that are still being queued have a newer
+// sequence number.
+static void led_stream_written(uint8_t seq) {
+  led_board_t* board = &led_boards[0];
+
+  EnterCriticalSection(&board->lock);
+  if (board->stream && board->has_pending && board->seq == seq &&
+      board->flush_timer == NULL) {
+    led_send_locked(board, &board->pending, board->pending_qpc, led_now(),
+                    false);
+  }
+  LeaveCriticalSection(&board->lock);
+}
+
+void led_on_written(const uint8_t* dat, size_t length, LONGLONG now) {
+  const HidconfigData* data = (const HidconfigData*)dat;
+
+  if (length < sizeof(*data) || data->reportID != HIDCONFIG_REPORT_ID) {
+    return;
+  }
+
+  switch (data->command) {
+    case SP_LED_SET:
+      InterlockedExchangeAdd64(&led_stats.bytes, (LONG64)length);
+      if (data->board_id < LED_BOARD_COUNT) {
+        stats_record(STATS_LED_FRAME,
+                     InterlockedCompareExchange64(
+                         &report_submit_qpc[data->board_id], 0, 0),
+                     now);
+      }
+      break;
+    case SP_LED_STREAM:
+      InterlockedExchangeAdd64(&led_stats.bytes, (LONG64)length);
+      if (data->stream_flags & LED_STREAM_COMMIT) {
+        stats_record(STATS_LED_FRAME,
+                     InterlockedCompareExchange64(
+                         &stream_submit_qpc[data->stream_seq], 0, 0),
+                     now);
+      }
+      led_stream_written(data->stream_seq);
+      break;
+    default:
+      break;
+  }
+}
+
+void led_resync(void) {
+  if (led_initialized == 0) {
+    return;
+  }
+
+  for (size_t i = 0; i < LED_BOARD_COUNT; i++) {
+    led_board_t* board = &led_boards[i];
+    EnterCriticalSection(&board->lock);
+    if (board->has_pending) {
+      led_send_locked(board, &board->pending, board->pending_qpc, led_now(),
+                      true);
+    } else if (board->has_last_sent) {
+      led_frame_t frame = board->last_sent;
+      LONGLONG now = led_now();
+      led_send_locked(board, &frame, now, now, true);
+    }
+    LeaveCriticalSection(&board->lock);
+  }
+}
+
+void led_get_stats(led_stats_t* stats) {
+  if (stats == NULL) {
+    return;
+  }
+
+  stats->sent = InterlockedCompareExchange(&led_stats.sent, 0, 0);
+  stats->unchanged = InterlockedCompareExchange(&led_stats.unchanged, 0, 0);
+  stats->deferred = InterlockedCompareExchange(&led_stats.deferred, 0, 0);
+  stats->flushed = InterlockedCompareExchange(&led_stats.flushed, 0, 0);
+  stats->chunks = InterlockedCompareExchange(&led_stats.chunks, 0, 0);
+  stats->chunks_unchanged =
+      InterlockedCompareExchange(&led_stats.chunks_unchanged, 0, 0);
+  stats->bytes = InterlockedCompareExchange64(&led_stats.bytes, 0, 0);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "platform.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mu3io.h"
+
+#define LED_BOARD_COUNT 2
+
+typedef struct {
+  LONG sent;       // Frames handed to the output queue
+  LONG unchanged;  // Frames skipped because they matched the last sent one
+  LONG deferred;   // Frames held back by the rate limit
+  LONG flushed;    // Held-back frames sent by the trailing flush timer
+  LONG chunks;            // SP_LED_STREAM chunks queued
+  LONG chunks_unchanged;  // Chunks skipped because they did not change
+  LONG64 bytes;           // LED report bytes written to the device
+} led_stats_t;
+
+/* Prepare per-board state. Safe to call more than once. */
+void led_init(void);
+
+/* Send a complete SP_LED_SET report for a board, unless it is identical to
+   the last report sent for that board. Reports arriving faster than the
+   configured led_max_rate are held back; the newest held-back report is
+   always flushed once the rate limit allows it. */
+void led_submit(uint8_t board, const HidconfigData* data);
+
+/* Same for a full board 0 frame of leds (at most LED_STREAM_LEDS) RGB
+   values, sent as SP_LED_STREAM chunks; only the chunks that changed since
+   the last frame sent are queued. */
+void led_submit_stream(const uint8_t* rgb, uint8_t leds);
+
+/* A report was written to the device at now (QPC): counts LED bytes and
+   records the completion latency of frames. Called by the output worker. */
+void led_on_written(const uint8_t* dat, size_t length, LONGLONG now);
+
+/* Send the newest frame of every board again, e.g. after a reconnect, since
+   the device lost whatever it was showing. */
+void led_resync(void);
+
+void led_get_stats(led_stats_t* stats);
@@ -0,0 +1,178 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lever.h"
+
+// tau = 1 / (2 pi fc): microseconds per 0.01 Hz of cutoff
+#define LEVER_TAU_US_CHZ 15915494u
+// Longest gap between two samples that is still filtered as one step
+#define LEVER_MAX_DT_US 100000
+
+static int32_t abs32(int32_t v) {
+  return v < 0 ? -v : v;
+}
+
+// Smoothing factor of a first order low-pass at cutoff (0.01 Hz) for a
+// sample dt_us after the previous one, in 0.16 fixed point
+static uint32_t lever_alpha(uint64_t cutoff, uint32_t dt_us) {
+  if (cutoff == 0) {
+    cutoff = 1;
+  }
+  uint64_t tau_us = LEVER_TAU_US_CHZ / cutoff;
+  return (uint32_t)(((uint64_t)dt_us << 16) / (dt_us + tau_us));
+}
+
+void lever_filter_init(lever_filter_t* filter,
+                       const lever_filter_params_t* params) {
+  memset(filter, 0, sizeof(*filter));
+  filter->params = *params;
+}
+
+int16_t lever_filter_update(lever_filter_t* filter,
+                            int16_t raw,
+                            int64_t time_us) {
+  const lever_filter_params_t* p = &filter->params;
+
+  if (!filter->primed) {
+    filter->primed = true;
+    filter->last_us = time_us;
+    filter->raw_prev = raw;
+    filter->x_q8 = (int32_t)raw * 256;
+    filter->output = raw;
+    filter->anchor = raw;
+    return raw;
+  }
+
+  int64_t dt64 = time_us - filter->last_us;
+  uint32_t dt = dt64 <= 0                ? 1
+                : dt64 > LEVER_MAX_DT_US ? LEVER_MAX_DT_US
+                                         : (uint32_t)dt64;
+  filter->last_us = time_us;
+
+  // Speed estimate, low-passed at the fixed d_cutoff
+  int64_t step_speed = (int64_t)(raw - filter->raw_prev) * 1000000 / dt;
+  filter->raw_prev = raw;
+  filter->speed +=
+      (int32_t)(((step_speed - filter->speed) *
+                 (int64_t)lever_alpha(p->d_cutoff, dt)) >> 16);
+
+  // The faster the lever moves, the higher the cutoff
+  uint64_t cutoff =
+      p->min_cutoff + (uint64_t)p->beta * (uint32_t)abs32(filter->speed) / 1000;
+  filter->x_q8 += (int32_t)((((int64_t)raw * 256 - filter->x_q8) *
+                             (int64_t)lever_alpha(cutoff, dt)) >> 16);
+
+  // Latency bound: no further behind than half a report at this speed, but
+  // never tighter than the roller noise the low-pass has to smooth out
+  int32_t bound =
+      (int32_t)((uint64_t)abs32(filter->speed) * dt / 2000000);
+  if (bound < LEVER_LAG_FLOOR) {
+    bound = LEVER_LAG_FLOOR;
+  }
+  int32_t x = (filter->x_q8 + 128) >> 8;
+  if (x < raw - bound) {
+    x = raw - bound;
+    filter->x_q8 = x * 256;
+  } else if (x > raw + bound) {
+    x = raw + bound;
+    filter->x_q8 = x * 256;
+  }
+
+  if (p->deadzone == 0) {
+    filter->output = x;
+  } else if (filter->resting) {
+    if (abs32(x - filter->output) > p->deadzone + p->hysteresis) {
+      filter->resting = false;
+      filter->anchor = x;
+      filter->still_us = 0;
+      filter->output = x;
+    }
+  } else {
+    filter->output = x;
+    if (abs32(x - filter->anchor) <= p->deadzone) {
+      filter->still_us += dt;
+      if (filter->still_us >= LEVER_REST_US) {
+        filter->resting = true;
+      }
+    } else {
+      filter->anchor = x;
+      filter->still_us = 0;
+    }
+  }
+
+  return (int16_t)(filter->output < INT16_MIN   ? INT16_MIN
+                   : filter->output > INT16_MAX ? INT16_MAX
+                                                : filter->output);
+}
+
+void lever_velocity_reset(lever_velocity_t* velocity) {
+  memset(velocity, 0, sizeof(*velocity));
+}
+
+int16_t lever_velocity_update(lever_velocity_t* velocity,
+                              int16_t pos,
+                              int64_t time_us) {
+  int newest = velocity->newest;
+
+  if (velocity->count > 0 &&
+      time_us - velocity->time_us[newest] > LEVER_VELOCITY_MAX_GAP_US) {
+    velocity->count = 0;
+  }
+
+  newest = (newest + 1) % LEVER_VELOCITY_SAMPLES;
+  velocity->newest = newest;
+  velocity->pos[newest] = pos;
+  velocity->time_us[newest] = time_us;
+  if (velocity->count < LEVER_VELOCITY_SAMPLES) {
+    velocity->count++;
+  }
+  if (velocity->count < 2) {
+    return 0;
+  }
+
+  // Least-squares slope, relative to the newest sample to keep the sums small
+  int64_t n = velocity->count, st = 0, sx = 0, stt = 0, stx = 0;
+  for (int i = 0; i < velocity->count; i++) {
+    int idx = (newest - i + LEVER_VELOCITY_SAMPLES) % LEVER_VELOCITY_SAMPLES;
+    int64_t t = velocity->time_us[idx] - time_us;
+    int64_t x = velocity->pos[idx] - pos;
+    st += t;
+    sx += x;
+    stt += t * t;
+    stx += t * x;
+  }
+
+  int64_t den = n * stt - st * st;
+  if (den <= 0) {
+    return 0;
+  }
+  int64_t v = (n * stx - st * sx) * (1000 * LEVER_VELOCITY_SCALE) / den;
+  return (int16_t)(v < INT16_MIN ? INT16_MIN : v > INT16_MAX ? INT16_MAX : v);
+}
+
+int16_t lever_predict(const lever_predict_params_t* params,
+                      int16_t pos,
+                      int16_t velocity,
+                      int64_t age_us) {
+  int64_t ahead = age_us + params->lead_us;
+
+  if (velocity == 0 || ahead <= 0) {
+    return pos;
+  }
+  if (ahead > params->horizon_us) {
+    ahead = params->horizon_us;
+  }
+
+  int64_t delta = (int64_t)velocity * ahead / (1000 * LEVER_VELOCITY_SCALE);
+  if (delta > params->max_delta) {
+    delta = params->max_delta;
+  } else if (delta < -(int64_t)params->max_delta) {
+    delta = -(int64_t)params->max_delta;
+  }
+
+  int64_t predicted = pos + delta;
+  return (int16_t)(predicted < INT16_MIN   ? INT16_MIN
+                   : predicted > INT16_MAX ? INT16_MAX
+                                           : predicted);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Lever processing, integer only.
+
+   Adaptive filter: a One-Euro style low-pass whose cutoff rises with the
+   lever speed, so slow movements are smoothed and fast swipes pass through,
+   followed by two guards:
+
+   - The output never trails the input by more than half a report of
+     movement at the current speed (or LEVER_LAG_FLOOR units, whichever is
+     more), so the filter cannot add a full report interval of latency, not
+     even at the start of a swipe.
+   - Once the lever has stayed within deadzone units for LEVER_REST_US, the
+     output is held still until the input moves more than
+     deadzone + hysteresis away from it. This removes the shimmer of worn
+     rollers at rest. */
+
+// How long the lever must stay inside the deadzone before it is at rest
+#define LEVER_REST_US 20000
+// The latency bound never holds the output closer to the input than this:
+// about the lag of the low-pass on a steady movement, so slow drags keep
+// their smoothing
+#define LEVER_LAG_FLOOR 16
+
+typedef struct {
+  uint16_t min_cutoff;  // Cutoff at rest, in 0.01 Hz
+  uint16_t beta;        // Extra cutoff per lever unit/ms of speed, 0.01 Hz
+  uint16_t d_cutoff;    // Cutoff of the speed estimate, in 0.01 Hz
+  uint16_t deadzone;    // Movement ignored at rest, in lever units
+  uint16_t hysteresis;  // Extra movement needed to leave rest
+} lever_filter_params_t;
+
+// 1 Hz at rest, +10 Hz per unit/ms, speed smoothed at 20 Hz, for a roller
+// with a few units of noise
+#define LEVER_FILTER_DEFAULTS \
+  {                           \
+      .min_cutoff = 100,      \
+      .beta = 1000,           \
+      .d_cutoff = 2000,       \
+      .deadzone = 8,          \
+      .hysteresis = 4,        \
+  }
+
+typedef struct {
+  lever_filter_params_t params;
+  bool primed;
+  bool resting;
+  int64_t last_us;
+  int32_t raw_prev;
+  int32_t x_q8;      // Filtered position, 24.8 fixed point
+  int32_t speed;     // Filtered speed, lever units per second
+  int32_t output;
+  int32_t anchor;    // Output when the current still period began
+  uint32_t still_us;
+} lever_filter_t;
+
+/* Reset the filter and set its parameters. */
+void lever_filter_init(lever_filter_t* filter,
+                       const lever_filter_params_t* params);
+
+/* Filter one lever sample taken at time_us (any monotonic microsecond
+   clock). Returns the position to report. */
+int16_t lever_filter_update(lever_filter_t* filter,
+                            int16_t raw,
+                            int64_t time_us);
+
+/* Motion prediction. The velocity is a least-squares slope over the last
+   LEVER_VELOCITY_SAMPLES positions and travels with the input snapshot; when
+   the game reads the lever, the position is extrapolated by the time since
+   the report arrived (plus a fixed lead for the USB transfer), at most
+   horizon_us ahead and max_delta units away from the reported position. */
+
+#define LEVER_VELOCITY_SAMPLES 4
+// Samples further apart than this do not describe one movement
+#define LEVER_VELOCITY_MAX_GAP_US 20000
+// Velocity unit: 1/8 lever unit per ms, +-4096 units/ms in an int16_t
+#define LEVER_VELOCITY_SCALE 8
+
+typedef struct {
+  uint16_t horizon_us;  // Never extrapolate further than this
+  uint16_t max_delta;   // Never move further than this from the report
+  uint16_t lead_us;     // Added to the report age, e.g. USB transfer time
+} lever_predict_params_t;
+
+#define LEVER_PREDICT_DEFAULTS \
+  {                            \
+      .horizon_us = 8000,      \
+      .max_delta = 0x800,      \
+      .lead_us = 0,            \
+  }
+
+typedef struct {
+  int32_t pos[LEVER_VELOCITY_SAMPLES];
+  int64_t time_us[LEVER_VELOCITY_SAMPLES];
+  int count;
+  int newest;
+} lever_velocity_t;
+
+void lever_velocity_reset(lever_velocity_t* velocity);
+
+/* Add a sample and return the current velocity, in
+   1/LEVER_VELOCITY_SCALE units per ms. */
+int16_t lever_velocity_update(lever_velocity_t* velocity,
+                              int16_t pos,
+                              int64_t time_us);
+
+/* Position velocity would have reached age_us after pos was reported. */
+int16_t lever_predict(const lever_predict_params_t* params,
+                      int16_t pos,
+                      int16_t velocity,
+                      int64_t age_us);
@@ -0,0 +1,681 @@
+#include "calib.h"
+#include "lever.h"
+#include "mu3io.h"
+#include "platform.h"
+#include "trace.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Host-native test and benchmark of the lever filter, motion prediction and
+   calibration.
+   The tests run a lever session (a worn, jittery roller at rest, fast
+   swipes, slow drags) through a trace file and evaluate both on the recorded
+   reports, the same way "lever_test recording.trace [poll_hz]" evaluates a
+   trace captured on a cabinet. */
+
+#define BENCH_SAMPLES 20000000
+#define SESSION_TRACE "lever_test.trace"
+#define REPORT_US 1000  // Nominal report interval of the session
+#define EVAL_POLL_HZ 240  // Simulated game polls for the prediction error
+// Polls where the lever moves faster than this (units/ms) count as swipes
+#define EVAL_SWIPE_SPEED 100
+
+static const lever_filter_params_t test_params = LEVER_FILTER_DEFAULTS;
+static const lever_predict_params_t test_predict = LEVER_PREDICT_DEFAULTS;
+
+typedef struct {
+  int samples;
+  int moving;             // Samples that moved more than the jitter
+  double max_lag;         // Added latency, in report intervals
+  double total_lag;
+  int rest_samples;       // Samples inside still periods (after settling)
+  int rest_changes;       // Output changes during those
+  int raw_rest_changes;   // Input changes during those
+} lever_eval_t;
+
+typedef struct {
+  int polls;
+  int swipe_polls;
+  double hold_error;       // Mean absolute error of the reported position
+  double predict_error;    // Same, with prediction
+  double swipe_hold_error;  // Both again, only while the lever moves fast
+  double swipe_predict_error;
+  int max_hold_error;
+  int max_predict_error;
+} predict_eval_t;
+
+typedef struct {
+  int64_t time_us;
+  int pos;
+} lever_sample_t;
+
+void print_separator(const char* title) {
+  printf("\n========== %s ==========\n", title);
+}
+
+static uint32_t lfsr = 0xACE1u;
+
+static int jitter(int amplitude) {
+  lfsr = lfsr * 1103515245u + 12345u;
+  return (int)((lfsr >> 16) % (uint32_t)(2 * amplitude + 1)) - amplitude;
+}
+
+static void record_lever(LONGLONG* qpc, int position) {
+  HidconfigData data;
+  memset(&data, 0, sizeof(data));
+  data.reportID = HIDCONFIG_REPORT_ID;
+  data.command = SP_INPUT_GET;
+  data.roller_value_sp = (uint16_t)(position + 0x8000);
+  // QPC of the trace is in ns on the host; reports arrive with some jitter
+  *qpc += (REPORT_US + jitter(50)) * 1000LL;
+  trace_report(TRACE_IN, *qpc, &data, sizeof(data));
+}
+
+// A short play session: rest with +-3 units of roller noise, swipes across
+// most of the range, a slow drag and rest again
+static bool record_session(const char* path) {
+  LONGLONG qpc = 0;
+  int pos = 0x100;
+
+  if (trace_open(path) != S_OK) {
+    return false;
+  }
+  for (int i = 0; i < 300; i++) {
+    record_lever(&qpc, pos + jitter(3));
+  }
+  for (int swipe = 0; swipe < 4; swipe++) {
+    int target = swipe % 2 == 0 ? 0x6000 : -0x6000;
+    int speed = 300 + swipe * 200;  // units per report
+    while (pos != target) {
+      int step = target > pos ? speed : -speed;
+      pos = abs(target - pos) < speed ? target : pos + step;
+      record_lever(&qpc, pos + jitter(3));
+    }
+    for (int i = 0; i < 100; i++) {
+      record_lever(&qpc, pos + jitter(3));
+    }
+  }
+  while (pos < 0) {
+    pos += 10;
+    record_lever(&qpc, pos + jitter(3));
+  }
+  for (int i = 0; i < 300; i++) {
+    record_lever(&qpc, pos + jitter(3));
+  }
+  trace_close();
+  return true;
+}
+
+static bool evaluate_trace(const char* path,
+                           const lever_filter_params_t* params,
+                           lever_eval_t* eval) {
+  trace_reader_t reader;
+  trace_record_t record;
+  lever_filter_t filter;
+  int prev_raw = 0, prev_out = 0;
+  int still = 0, still_anchor = 0;
+
+  if (trace_reader_open(&reader, path) != S_OK) {
+    printf("Not a trace file: %s\n", path);
+    return false;
+  }
+
+  memset(eval, 0, sizeof(*eval));
+  lever_filter_init(&filter, params);
+
+  while (trace_reader_next(&reader, &record)) {
+    const HidconfigData* data = (const HidconfigData*)record.data;
+    if (record.direction != TRACE_IN || record.length != sizeof(*data) ||
+        data->reportID != HIDCONFIG_REPORT_ID ||
+        data->command != SP_INPUT_GET) {
+      continue;
+    }
+
+    int raw = (int)data->roller_value_sp - 0x8000;
+    int64_t time_us = record.qpc * 1000000 / reader.qpc_freq;
+    int out = lever_filter_update(&filter, (int16_t)raw, time_us);
+
+    if (eval->samples > 0) {
+      int step = raw - prev_raw;
+      // Movement well above the roller noise: how far back in time is the
+      // output, assuming the lever moved linearly since the last report?
+      if (abs(step) > 2 * (params->deadzone + params->hysteresis)) {
+        double lag = (double)(raw - out) / step;
+        if (lag < 0) {
+          lag = 0;  // Output is ahead (only on overshoot of the noise)
+        }
+        eval->moving++;
+        eval->total_lag += lag;
+        if (lag > eval->max_lag) {
+          eval->max_lag = lag;
+        }
+      }
+      if (abs(raw - still_anchor) > params->deadzone) {
+        still_anchor = raw;
+        still = 0;
+      } else if (++still > LEVER_REST_US / REPORT_US + 5) {
+        // Settled: the output should not move any more
+        eval->rest_samples++;
+        eval->rest_changes += out != prev_out;
+        eval->raw_rest_changes += raw != prev_raw;
+      }
+    }
+
+    prev_raw = raw;
+    prev_out = out;
+    eval->samples++;
+  }
+
+  trace_reader_close(&reader);
+  return true;
+}
+
+// Input reports of a trace as lever samples, NULL if there are none
+static lever_sample_t* load_samples(const char* path, int* count) {
+  trace_reader_t reader;
+  trace_record_t record;
+  int capacity = 4096;
+  lever_sample_t* samples;
+
+  *count = 0;
+  if (trace_reader_open(&reader, path) != S_OK) {
+    printf("Not a trace file: %s\n", path);
+    return NULL;
+  }
+
+  samples = malloc(capacity * sizeof(*samples));
+  while (samples != NULL && trace_reader_next(&reader, &record)) {
+    const HidconfigData* data = (const HidconfigData*)record.data;
+    if (record.direction != TRACE_IN || record.length != sizeof(*data) ||
+        data->reportID != HIDCONFIG_REPORT_ID ||
+        data->command != SP_INPUT_GET) {
+      continue;
+    }
+    if (*count == capacity) {
+      capacity *= 2;
+      lever_sample_t* grown = realloc(samples, capacity * sizeof(*samples));
+      if (grown == NULL) {
+        break;
+      }
+      samples = grown;
+    }
+    samples[*count].time_us = record.qpc * 1000000 / reader.qpc_freq;
+    samples[*count].pos = (int)data->roller_value_sp - 0x8000;
+    (*count)++;
+  }
+
+  trace_reader_close(&reader);
+  if (*count == 0) {
+    free(samples);
+    return NULL;
+  }
+  return samples;
+}
+
+/* Simulate a game polling the lever at poll_hz: at each poll compare the
+   newest reported position, and the prediction from it, with where the lever
+   actually was at that moment (interpolated between the reports around it,
+   delayed by lead_us to match the USB transfer the prediction assumes). */
+static bool evaluate_prediction(const char* path,
+                                const lever_predict_params_t* params,
+                                int poll_hz,
+                                predict_eval_t* eval) {
+  lever_velocity_t velocity;
+  int count;
+  lever_sample_t* samples = load_samples(path, &count);
+
+  memset(eval, 0, sizeof(*eval));
+  if (samples == NULL) {
+    return false;
+  }
+
+  lever_velocity_reset(&velocity);
+  int16_t v = lever_velocity_update(&velocity, (int16_t)samples[0].pos,
+                                    samples[0].time_us);
+  int newest = 0;
+  int64_t poll_us = 1000000 / poll_hz;
+
+  for (int64_t t = samples[0].time_us + poll_us;; t += poll_us) {
+    while (newest + 1 < count && samples[newest + 1].time_us <= t) {
+      newest++;
+      v = lever_velocity_update(&velocity, (int16_t)samples[newest].pos,
+                                samples[newest].time_us);
+    }
+
+    // Truth: the lever position lead_us after the poll
+    int64_t truth_t = t + params->lead_us;
+    int next = newest;
+    while (next + 1 < count && samples[next].time_us < truth_t) {
+      next++;
+    }
+    if (samples[next].time_us < truth_t) {
+      break;  // End of the trace
+    }
+    int prev = next > 0 ? next - 1 : 0;
+    double truth = samples[next].pos;
+    if (samples[next].time_us > samples[prev].time_us) {
+      truth = samples[prev].pos +
+              (double)(samples[next].pos - samples[prev].pos) *
+                  (double)(truth_t - samples[prev].time_us) /
+                  (double)(samples[next].time_us - samples[prev].time_us);
+    }
+
+    int hold = samples[newest].pos;
+    int predicted = lever_predict(params, (int16_t)hold, v,
+                                  t - samples[newest].time_us);
+    int hold_error = (int)(truth > hold ? truth - hold + 0.5
+                                        : hold - truth + 0.5);
+    int predict_error = (int)(truth > predicted ? truth - predicted + 0.5
+                                                : predicted - truth + 0.5);
+
+    eval->polls++;
+    eval->hold_error += hold_error;
+    eval->predict_error += predict_error;
+    if (hold_error > eval->max_hold_error) {
+      eval->max_hold_error = hold_error;
+    }
+    if (predict_error > eval->max_predict_error) {
+      eval->max_predict_error = predict_error;
+    }
+    if (abs(v) >= EVAL_SWIPE_SPEED * LEVER_VELOCITY_SCALE) {
+      eval->swipe_polls++;
+      eval->swipe_hold_error += hold_error;
+      eval->swipe_predict_error += predict_error;
+    }
+  }
+
+  if (eval->polls > 0) {
+    eval->hold_error /= eval->polls;
+    eval->predict_error /= eval->polls;
+  }
+  if (eval->swipe_polls > 0) {
+    eval->swipe_hold_error /= eval->swipe_polls;
+    eval->swipe_predict_error /= eval->swipe_polls;
+  }
+  free(samples);
+  return true;
+}
+
+static void print_predict_eval(const predict_eval_t* eval) {
+  printf("%d polls: error avg %.1f -> %.1f units, max %d -> %d\n",
+         eval->polls, eval->hold_error, eval->predict_error,
+         eval->max_hold_error, eval->max_predict_error);
+  printf("%d polls during swipes: error avg %.1f -> %.1f units\n",
+         eval->swipe_polls, eval->swipe_hold_error,
+         eval->swipe_predict_error);
+}
+
+static void print_eval(const lever_eval_t* eval) {
+  printf("%d samples, %d moving: added latency avg %.3f max %.3f reports\n",
+         eval->samples, eval->moving,
+         eval->moving > 0 ? eval->total_lag / eval->moving : 0.0,
+         eval->max_lag);
+  printf("At rest: %d samples, input changed %d times, output %d times\n",
+         eval->rest_samples, eval->raw_rest_changes, eval->rest_changes);
+}
+
+static bool test_session(void) {
+  print_separator("Recorded Session Test");
+
+  lever_eval_t eval;
+  predict_eval_t predict;
+  bool ok = true;
+
+  if (!record_session(SESSION_TRACE) ||
+      !evaluate_trace(SESSION_TRACE, &test_params, &eval) ||
+      !evaluate_prediction(SESSION_TRACE, &test_predict, EVAL_POLL_HZ,
+                           &predict)) {
+    remove(SESSION_TRACE);
+    return false;
+  }
+  remove(SESSION_TRACE);
+  print_eval(&eval);
+  print_predict_eval(&predict);
+
+  if (eval.moving == 0 || eval.max_lag >= 1.0) {
+    printf("Added latency must stay below one report interval\n");
+    ok = false;
+  }
+  if (eval.rest_samples == 0 || eval.rest_changes != 0) {
+    printf("Output shimmers at rest\n");
+    ok = false;
+  }
+  if (predict.swipe_polls == 0 ||
+      predict.swipe_predict_error * 2 > predict.swipe_hold_error ||
+      predict.predict_error > predict.hold_error) {
+    printf("Prediction does not reduce the lever error\n");
+    ok = false;
+  }
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+static bool test_rest_release(void) {
+  print_separator("Rest Release Test");
+
+  lever_filter_t filter;
+  int64_t t = 0;
+  int16_t out = 0;
+  bool ok = true;
+
+  lever_filter_init(&filter, &test_params);
+  for (int i = 0; i < 100; i++, t += REPORT_US) {
+    out = lever_filter_update(&filter, (int16_t)(jitter(3)), t);
+  }
+  if (!filter.resting) {
+    printf("Filter did not settle\n");
+    ok = false;
+  }
+
+  // Inside deadzone + hysteresis: still held
+  int16_t held = out;
+  out = lever_filter_update(&filter, (int16_t)(held + 10), t += REPORT_US);
+  if (out != held) {
+    printf("Left rest early: %d -> %d\n", held, out);
+    ok = false;
+  }
+
+  // A real swipe moves the output in the same report
+  out = lever_filter_update(&filter, 2000, t += REPORT_US);
+  if (out <= held + 10) {
+    printf("Swipe held back at rest: %d\n", out);
+    ok = false;
+  }
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+// Slow drags with +-3 units of roller noise and the deadzone off: only the
+// low-pass can smooth them, the output steps must be steadier than the input
+static bool test_slow_jitter(void) {
+  print_separator("Slow Movement Jitter Test");
+
+  static const int speeds[] = {0, 1, 4, 8};  // Units per 4 reports
+  lever_filter_params_t params = test_params;
+  bool ok = true;
+
+  params.deadzone = 0;
+  params.hysteresis = 0;
+  for (size_t s = 0; s < sizeof(speeds) / sizeof(speeds[0]); s++) {
+    lever_filter_t filter;
+    int64_t raw_noise = 0, out_noise = 0;
+    int prev_raw = 0, prev_out = 0, unchanged = 0, samples = 0;
+
+    lever_filter_init(&filter, &params);
+    for (int i = 0; i < 5000; i++) {
+      int ideal = i * speeds[s] / 4;
+      int raw = ideal + jitter(3);
+      int out = lever_filter_update(&filter, (int16_t)raw,
+                                    (int64_t)i * REPORT_US);
+      // Skip the settling time of the filter
+      if (i > 500) {
+        int ideal_step = ideal - (i - 1) * speeds[s] / 4;
+        raw_noise += abs(raw - prev_raw - ideal_step);
+        out_noise += abs(out - prev_out - ideal_step);
+        unchanged += out == raw;
+        samples++;
+      }
+      prev_raw = raw;
+      prev_out = out;
+    }
+
+    printf("%d units/4 reports: step noise %.2f -> %.2f units, output == "
+           "input in %d/%d samples\n",
+           speeds[s], (double)raw_noise / samples,
+           (double)out_noise / samples, unchanged, samples);
+    if (out_noise * 2 > raw_noise) {
+      printf("Jitter passes through\n");
+      ok = false;
+    }
+  }
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+static bool test_predict_clamp(void) {
+  print_separator("Prediction Clamp Test");
+
+  lever_velocity_t velocity;
+  int16_t v = 0;
+  bool ok = true;
+
+  // 500 units/ms, steady
+  lever_velocity_reset(&velocity);
+  for (int i = 0; i < LEVER_VELOCITY_SAMPLES; i++) {
+    v = lever_velocity_update(&velocity, (int16_t)(i * 500),
+                              (int64_t)i * REPORT_US);
+  }
+  if (v != 500 * LEVER_VELOCITY_SCALE) {
+    printf("Velocity: expected %d, got %d\n", 500 * LEVER_VELOCITY_SCALE, v);
+    ok = false;
+  }
+
+  int16_t p = lever_predict(&test_predict, 0, v, 1000);
+  if (p != 500) {
+    printf("1 ms ahead: expected 500, got %d\n", p);
+    ok = false;
+  }
+  p = lever_predict(&test_predict, 0, v, 1000000);
+  if (p != test_predict.max_delta) {
+    printf("Far ahead: expected clamp to %d, got %d\n",
+           test_predict.max_delta, p);
+    ok = false;
+  }
+  p = lever_predict(&test_predict, 0x7F00, v, test_predict.horizon_us);
+  if (p != INT16_MAX) {
+    printf("Range end: expected %d, got %d\n", INT16_MAX, p);
+    ok = false;
+  }
+
+  // A pause longer than the gap limit forgets the old movement
+  v = lever_velocity_update(&velocity, 2000, 100000);
+  if (v != 0) {
+    printf("Velocity after a pause: expected 0, got %d\n", v);
+    ok = false;
+  }
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+// Streamed value for a raw position under the device offset
+static uint16_t stream_value(uint16_t raw, uint16_t offset) {
+  return (uint16_t)(raw - offset);
+}
+
+static bool test_calibration(void) {
+  print_separator("Calibration Test");
+
+  // A sensor whose range crosses the wrap point, with some noise
+  const uint16_t offset = 0x1234;
+  const uint16_t center = 0xFF00;
+  int64_t t = 0;
+  bool ok = true, done = false;
+  calib_points_t points;
+
+  calib_init(NULL);
+  calib_start();
+  if (calib_state() != CALIB_WAIT_OFFSET) {
+    printf("Learning started before the roller data reply\n");
+    ok = false;
+  }
+  calib_on_roller_data(stream_value(center, offset), center);
+
+  // Rest at the center, sweep to both ends, come back and rest
+  int lowest = 0, highest = 0;
+  for (int i = 0; i < 200; i++, t += REPORT_US) {
+    done |= calib_observe(stream_value((uint16_t)(center + jitter(3)), offset),
+                          t);
+  }
+  for (int d = 0; d > -0x3000; d -= 200, t += REPORT_US) {
+    done |= calib_observe(stream_value((uint16_t)(center + d), offset), t);
+    lowest = d < lowest ? d : lowest;
+  }
+  for (int d = -0x3000; d < 0x3800; d += 200, t += REPORT_US) {
+    done |= calib_observe(stream_value((uint16_t)(center + d), offset), t);
+    lowest = d < lowest ? d : lowest;
+    highest = d > highest ? d : highest;
+  }
+  for (int d = highest; d > 0; d -= 200, t += REPORT_US) {
+    done |= calib_observe(stream_value((uint16_t)(center + d), offset), t);
+  }
+  for (int i = 0; i < 1000 && !done; i++, t += REPORT_US) {
+    done |= calib_observe(stream_value((uint16_t)(center + jitter(3)), offset),
+                          t);
+  }
+
+  if (!done || !calib_points(&points)) {
+    printf("Calibration did not finish\n");
+    printf("FAILED\n");
+    return false;
+  }
+  printf("min %04X center %04X max %04X\n", points.min, points.center,
+         points.max);
+  // The sweep covered exactly [center + lowest, center + highest]
+  if (abs((int16_t)(uint16_t)(points.center - center)) > 3 ||
+      (uint16_t)(points.min - center) != (uint16_t)lowest ||
+      (uint16_t)(points.max - center) != (uint16_t)highest) {
+    printf("Unexpected points\n");
+    ok = false;
+  }
+
+  // Ends and center land on the game's range, monotonic in between
+  if (calib_map(stream_value(points.center, offset)) != 0 ||
+      calib_map(stream_value(points.min, offset)) != -CALIB_RANGE ||
+      calib_map(stream_value(points.max, offset)) != CALIB_RANGE) {
+    printf("Mapping: center %d, min %d, max %d\n",
+           calib_map(stream_value(points.center, offset)),
+           calib_map(stream_value(points.min, offset)),
+           calib_map(stream_value(points.max, offset)));
+    ok = false;
+  }
+  int prev = INT32_MIN;
+  for (int d = -0x8000; d < 0x8000; d++) {
+    int mapped =
+        calib_map(stream_value((uint16_t)(points.center + d), offset));
+    if (mapped < prev) {
+      printf("Not monotonic at %d\n", d);
+      ok = false;
+      break;
+    }
+    prev = mapped;
+  }
+
+  // The device applies the new offset: the table follows its reply
+  uint16_t new_offset = calib_device_offset(&points);
+  calib_on_roller_data(stream_value(points.center, new_offset),
+                       points.center);
+  if (stream_value(points.center, new_offset) != 0x8000 ||
+      calib_map(0x8000) != 0) {
+    printf("Offset %04X: center maps to %d\n", new_offset,
+           calib_map(0x8000));
+    ok = false;
+  }
+
+  // Invalid stored points are rejected
+  calib_points_t bad = {.min = 0x8000, .center = 0x8100, .max = 0x9000};
+  calib_init(&bad);
+  if (calib_state() != CALIB_OFF) {
+    printf("Accepted a calibration without enough travel\n");
+    ok = false;
+  }
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+static void bench_filter(void) {
+  print_separator("Filter Benchmark");
+
+  lever_filter_t filter;
+  volatile int16_t sink = 0;
+  LARGE_INTEGER start, end;
+  int pos = 0, dir = 37;
+
+  lever_filter_init(&filter, &test_params);
+  QueryPerformanceCounter(&start);
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    pos += dir;
+    if (pos > 0x7000 || pos < -0x7000) {
+      dir = -dir;
+    }
+    sink = lever_filter_update(&filter, (int16_t)(pos + (i & 3)),
+                               (int64_t)i * REPORT_US);
+  }
+  QueryPerformanceCounter(&end);
+  (void)sink;
+
+  printf("%d samples: %.2f ns/sample\n", BENCH_SAMPLES,
+         (double)(end.QuadPart - start.QuadPart) / BENCH_SAMPLES);
+}
+
+static void bench_predict(void) {
+  print_separator("Prediction Benchmark");
+
+  lever_velocity_t velocity;
+  volatile int16_t sink = 0;
+  LARGE_INTEGER start, mid, end;
+  int pos = 0, dir = 37;
+  int16_t v = 0;
+
+  lever_velocity_reset(&velocity);
+  QueryPerformanceCounter(&start);
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    pos += dir;
+    if (pos > 0x7000 || pos < -0x7000) {
+      dir = -dir;
+    }
+    v = lever_velocity_update(&velocity, (int16_t)pos, (int64_t)i * REPORT_US);
+  }
+  QueryPerformanceCounter(&mid);
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    sink = lever_predict(&test_predict, (int16_t)i, v, i & 0x3FF);
+  }
+  QueryPerformanceCounter(&end);
+  (void)sink;
+
+  printf("Velocity: %.2f ns/report, prediction: %.2f ns/read\n",
+         (double)(mid.QuadPart - start.QuadPart) / BENCH_SAMPLES,
+         (double)(end.QuadPart - mid.QuadPart) / BENCH_SAMPLES);
+}
+
+int main(int argc, char** argv) {
+  printf("========================================\n");
+  printf("           SimGEKI lever test\n");
+  printf("========================================\n");
+
+  if (argc >= 2) {
+    // Evaluate the default parameters on a trace recorded on a cabinet
+    lever_eval_t eval;
+    predict_eval_t predict;
+    int poll_hz = argc >= 3 ? atoi(argv[2]) : EVAL_POLL_HZ;
+    print_separator(argv[1]);
+    if (!evaluate_trace(argv[1], &test_params, &eval) ||
+        !evaluate_prediction(argv[1], &test_predict,
+                             poll_hz > 0 ? poll_hz : EVAL_POLL_HZ,
+                             &predict)) {
+      return 1;
+    }
+    print_eval(&eval);
+    print_predict_eval(&predict);
+    return 0;
+  }
+
+  bool ok = test_session();
+  ok = test_rest_release() && ok;
+  ok = test_slow_jitter() && ok;
+  ok = test_predict_clamp() && ok;
+  ok = test_calibration() && ok;
+  bench_filter();
+  bench_predict();
+
+  print_separator(ok ? "PASSED" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -17,313 +17,587 @@
 #include "util/dprintf.h"
 
 #include "mu3io.h"
+#include "color.h"
 #include "config.h"
+#include "decode.h"
 #include "hid.h"
+#include "hotplug.h"
+#include "hub.h"
+#include "input.h"
+#include "keyboard.h"
+#include "led.h"
+#include "report.h"
+#include "session.h"
+#include "stats.h"
+#include "trace.h"
+#include "tracepoint.h"
+#include "transport.h"
+#include "writeq.h"
 
 #define REPORT_SIZE 64  // 1B ReportID + 63B 数据
 
-// USB reconnection and timeout constants
-#define USB_RECONNECT_POLL_INTERVAL 60  // Polls between reconnection attempts
+// USB timeout constants
 #define USB_WRITE_TIMEOUT_MS 1000  // Write operation timeout in milliseconds
 
-static uint8_t mu3_opbtn = 0;
-static uint8_t mu3_left_btn = 0;
-static uint8_t mu3_right_btn = 0;
-static int16_t mu3_lever_pos = 0;
+// Reader thread constants
+#define READER_WAIT_MS 100          // Max time the reader sleeps on the read event
 
-static uint8_t dummy_mu3_opbtn;
-static uint8_t dummy_mu3_left_btn;
-static uint8_t dummy_mu3_right_btn;
+// Signals posted to the completion port worker
+enum {
+  IO_KEY_CONNECTED = 1,  // The reconnect worker opened the device
+  IO_KEY_WRITE,          // Reports were queued for output
+  IO_KEY_HUB_LED,        // The hub client submitted an LED frame
+  IO_KEY_REMATCH,        // The device IDs changed
+};
+
+// Input latched by the last mu3_io_poll(), read by mu3_io_get_*
+static volatile input_snapshot_t polled_snapshot = 0;
+// Decode time of the newest report in polled_snapshot, 0 if unknown
+static volatile LONG64 polled_qpc = 0;
+// Set by every poll, cleared by the first getter that reads the result
+static volatile LONG polled_unconsumed = 0;
 
 static char hid_path[1024];
 static size_t hid_path_size = 1024;
+// Match key hid_path belongs to; a new VID/PID/MI starts from its own cache
+static char hid_path_key[48];
+// The device IDs changed, the read side reconnects with the new ones
+static volatile LONG usb_rematch = 0;
+
+// Lever prediction, republished whole on a config reload. Immutable once
+// published (never freed, a reader may still hold it), NULL while prediction
+// is off. Only a reload that changes the parameters makes a new copy, which
+// bounds the leak by the number of such ini edits.
+static lever_predict_params_t* volatile lever_predict_active = NULL;
+
+static volatile bool usb_connected = false;
+static transport_t hid = {.ops = &transport_win32_ops};
+
+// Serializes writes on the output worker against usb_cleanup()
+static CRITICAL_SECTION write_lock;
+// Keeps the transport open while usb_cleanup() cancels a write, without
+// waiting for the write_lock that write holds
+static CRITICAL_SECTION cancel_lock;
+static HANDLE reader_thread = NULL;
+
+// [io] completionPort: the reader thread is the completion port worker and
+// also issues the writes, there is no output worker thread
+static bool io_engine = false;
+// A wake-up for queued writes is posted and not yet handled
+static volatile LONG io_write_wake = 0;
+static HANDLE io_hub_wait = NULL;
 
-static char hid_read_buf[REPORT_SIZE];
+// Clean up USB resources
+static void usb_cleanup(void) {
+  if (usb_connected) {
+    TP(TP_DISCONNECT, hid.last_error, 0, 0);
+    hub_publish_disconnect();
+  }
+  usb_connected = false;
+  // A write the device does not take holds write_lock for up to
+  // USB_WRITE_TIMEOUT_MS; in polled mode this runs on the game thread
+  EnterCriticalSection(&cancel_lock);
+  transport_cancel_write(&hid);
+  LeaveCriticalSection(&cancel_lock);
+  EnterCriticalSection(&write_lock);
+  EnterCriticalSection(&cancel_lock);
+  transport_close(&hid);
+  LeaveCriticalSection(&cancel_lock);
+  LeaveCriticalSection(&write_lock);
+  session_disconnected();
+  writeq_clear();
+}
 
-static uint8_t poll_state = 0;
-static bool usb_connected = false;
-static bool usb_init_attempted = false;
-HANDLE hid_handle = NULL;
-OVERLAPPED ov_read = {0};
-OVERLAPPED ov_write = {0};
+// Send the learnt lever offset again (the device may have been power
+// cycled) and ask for the roller data: its reply tells the calibration which
+// offset the device actually applies
+static void usb_sync_lever_calib(void) {
+  HidconfigData data = {0};
+  calib_points_t points;
 
-// #define DEBUG
-// #define DEBUG_TEXT_ONLY
+  data.reportID = HIDCONFIG_REPORT_ID;
+  data.symbol = 0x01;
+  if (calib_points(&points)) {
+    data.command = ROLLER_SET_OFFSET;
+    data.roller_value = calib_device_offset(&points);
+    hid_write_data((const char*)&data, sizeof(data));
+  }
+  if (calib_state() != CALIB_OFF) {
+    data.command = ROLLER_GET_DATA;
+    data.roller_value = 0;
+    hid_write_data((const char*)&data, sizeof(data));
+  }
+}
 
-// Check if error code indicates USB device disconnection
-static bool is_usb_disconnection_error(DWORD error) {
-  return (error == ERROR_BAD_COMMAND || error == ERROR_NOT_READY ||
-          error == ERROR_DEVICE_NOT_CONNECTED || error == ERROR_GEN_FAILURE ||
-          error == ERROR_OPERATION_ABORTED);
+// A new lever calibration was learnt on the report thread
+static void on_lever_calibrated(const calib_points_t* points) {
+  config_save_lever_calib(points);
+  usb_sync_lever_calib();
 }
 
-void keyboard_dummy() {
-  dummy_mu3_opbtn = mu3_opbtn;
-  dummy_mu3_left_btn = mu3_left_btn;
-  dummy_mu3_right_btn = mu3_right_btn;
+// Initialize USB device
+static HRESULT usb_init(void) {
+  // Clean up any existing connection first
+  usb_cleanup();
 
-  if (GetAsyncKeyState(cfg.test_keycode) & 0x8000) {
-    dummy_mu3_opbtn |= MU3_IO_OPBTN_TEST;
-  }
-  if (GetAsyncKeyState(cfg.coin_keycode) & 0x8000) {
-    dummy_mu3_opbtn |= MU3_IO_OPBTN_COIN;
-  }
-  if (GetAsyncKeyState(cfg.service_keycode) & 0x8000) {
-    dummy_mu3_opbtn |= MU3_IO_OPBTN_SERVICE;
-  }
-  if (GetAsyncKeyState(cfg.gamebtn_L1_keycode) & 0x8000) {
-    dummy_mu3_left_btn |= MU3_IO_GAMEBTN_1;
+  dprintf("SimGEKI: Attempting to connect USB device...\n");
+
+  LARGE_INTEGER start;
+  QueryPerformanceCounter(&start);
+
+  // Whatever connects from here on uses the current IDs
+  InterlockedExchange(&usb_rematch, 0);
+  const config_hid_match_t* match = config_hid_match();
+
+  // First attempt with these IDs: start from the path the last run used
+  if (strcmp(hid_path_key, match->key) != 0) {
+    strcpy_s(hid_path_key, sizeof(hid_path_key), match->key);
+    hid_path[0] = '\0';
+    config_load_hid_path(match->key, hid_path, sizeof(hid_path));
   }
-  if (GetAsyncKeyState(cfg.gamebtn_L2_keycode) & 0x8000) {
-    dummy_mu3_left_btn |= MU3_IO_GAMEBTN_2;
+
+  // The last good path usually still works, a single open revalidates it
+  bool from_cache = false;
+  hid.read_depth = cfg.read_buffers;
+  if (hid_path[0] != '\0') {
+    from_cache = transport_open(&hid, hid_path) == TRANSPORT_OK;
   }
-  if (GetAsyncKeyState(cfg.gamebtn_L3_keycode) & 0x8000) {
-    dummy_mu3_left_btn |= MU3_IO_GAMEBTN_3;
+
+  if (!from_cache) {
+    // Full enumeration only when the cached path is gone
+    char old_path[sizeof(hid_path)];
+    strcpy_s(old_path, sizeof(old_path), hid_path);
+
+    hid_path_size = sizeof(hid_path);
+    if (GetHidPathByVidPidMi(match->vid, match->pid, match->mi, hid_path,
+                             &hid_path_size) != S_OK) {
+      dprintf("SimGEKI: USB device not found. VID: %s, PID: %s, MI: %s\n",
+              match->vid, match->pid, match->mi);
+      // Keep the old path, the device may come back under the same one
+      strcpy_s(hid_path, sizeof(hid_path), old_path);
+      return S_FALSE;
+    }
+
+    dprintf("SimGEKI: HID Path: %s\n", hid_path);
+
+    // Try to open the HID device
+    if (transport_open(&hid, hid_path) != TRANSPORT_OK) {
+      dlog(DLOG_ERROR, "SimGEKI: Failed to open HID device: %lu\n",
+           (unsigned long)hid.last_error);
+      return S_FALSE;
+    }
+
+    if (strcmp(old_path, hid_path) != 0) {
+      config_save_hid_path(match->key, hid_path);
+    }
   }
-  if (GetAsyncKeyState(cfg.gamebtn_Lside_keycode) & 0x8000) {
-    dummy_mu3_left_btn |= MU3_IO_GAMEBTN_SIDE;
+
+  dprintf("SimGEKI: HID device opened successfully.\n");
+
+  // Start first async read. The completion port worker arms its reads
+  // itself once told about the connection, it is the only one to touch them.
+  if (!io_engine && transport_read_start(&hid) != TRANSPORT_OK) {
+    DWORD error = hid.last_error;
+    usb_cleanup();
+    return HRESULT_FROM_WIN32(error);
   }
-  if (GetAsyncKeyState(cfg.gamebtn_Lmenu_keycode) & 0x8000) {
-    dummy_mu3_left_btn |= MU3_IO_GAMEBTN_MENU;
+
+  // The first tick of the new session sends SP_INPUT_GET_START
+  session_connected(stats_now());
+
+  // Handles must be visible before other threads see the connected flag
+  MemoryBarrier();
+  usb_connected = true;
+  stats_milestone(STATS_MILESTONE_DEVICE_READY);
+  if (io_engine) {
+    transport_iocp_post(IO_KEY_CONNECTED);
+  }
+
+  LARGE_INTEGER end;
+  QueryPerformanceCounter(&end);
+  int64_t init_us = stats_elapsed_us(start.QuadPart, end.QuadPart);
+  TP(TP_CONNECT, init_us, from_cache, 0);
+  dprintf("SimGEKI: USB device initialized successfully in %.2f ms (%s).\n",
+          (double)init_us / 1000.0,
+          from_cache ? "cached path" : "enumerated");
+
+  // The device lost its LED state, show the current frames again
+  led_resync();
+  usb_sync_lever_calib();
+  return S_OK;
+}
+
+// Outcome of one write, with the HRESULT the output queue counts.
+// A disconnection seen here is only logged: the pending read fails as well
+// and the read side (poll or reader thread) owns the teardown.
+static HRESULT hid_write_finished(const uint8_t* dat,
+                                  size_t length,
+                                  transport_status_t status) {
+  HRESULT hr = S_OK;
+
+  TP(TP_WRITE, length > 1 ? dat[0] << 8 | dat[1] : 0, length, status);
+  switch (status) {
+    case TRANSPORT_OK: {
+      LONGLONG now = stats_now();
+      trace_report(TRACE_OUT, now, dat, length);
+      led_on_written(dat, length, now);
+      break;
+    }
+    case TRANSPORT_TIMEOUT:
+      dlog(DLOG_WARN, "SimGEKI: Write operation timeout or failed.\n");
+      hr = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+      break;
+    case TRANSPORT_DISCONNECTED:
+      dlog(DLOG_WARN, "SimGEKI: WriteFile failed: %lu\n",
+           (unsigned long)hid.last_error);
+      dlog(DLOG_WARN, "SimGEKI: USB device appears to be disconnected.\n");
+      hr = HRESULT_FROM_WIN32(hid.last_error);
+      break;
+    default:
+      dlog(DLOG_ERROR, "SimGEKI: WriteFile failed: %lu\n",
+           (unsigned long)hid.last_error);
+      hr = HRESULT_FROM_WIN32(hid.last_error);
+      break;
   }
-  if (GetAsyncKeyState(cfg.gamebtn_R1_keycode) & 0x8000) {
-    dummy_mu3_right_btn |= MU3_IO_GAMEBTN_1;
+  return hr;
+}
+
+// Blocking write of one report, only called on the output worker thread.
+static HRESULT hid_write_report(const uint8_t* dat, size_t length) {
+  EnterCriticalSection(&write_lock);
+
+  if (!usb_connected || !hid.is_open) {
+    LeaveCriticalSection(&write_lock);
+    return S_FALSE;
   }
-  if (GetAsyncKeyState(cfg.gamebtn_R2_keycode) & 0x8000) {
-    dummy_mu3_right_btn |= MU3_IO_GAMEBTN_2;
+
+  transport_status_t status =
+      transport_write(&hid, dat, length, USB_WRITE_TIMEOUT_MS);
+  HRESULT hr = hid_write_finished(dat, length, status);
+
+  LeaveCriticalSection(&write_lock);
+  return hr;
+}
+
+// Only the newest pending LED frame per board and the newest start/stop
+// request are worth sending; everything else keeps its place in the queue.
+// Streamed chunks are never merged, a chunk replaced in place could commit
+// one frame with another's chunks: led.c holds a new frame back until the
+// previous one left the queue instead, and finds it by its tag.
+static uint32_t hid_coalesce_key(const char* dat, size_t length) {
+  const HidconfigData* data = (const HidconfigData*)dat;
+
+  if (length < REPORT_SIZE || data->reportID != HIDCONFIG_REPORT_ID) {
+    return WRITEQ_NO_COALESCE;
+  }
+
+  switch (data->command) {
+    case SP_LED_SET:
+      return ((uint32_t)data->command << 8) | data->board_id;
+    case SP_LED_STREAM:
+      return WRITEQ_TAG | ((uint32_t)data->command << 8) | data->board_id;
+    case SP_INPUT_GET_START:
+    case SP_INPUT_GET_END:
+      return (uint32_t)data->command << 8;
+    default:
+      return WRITEQ_NO_COALESCE;
   }
-  if (GetAsyncKeyState(cfg.gamebtn_R3_keycode) & 0x8000) {
-    dummy_mu3_right_btn |= MU3_IO_GAMEBTN_3;
+}
+
+bool hid_led_stream_queued(void) {
+  return writeq_pending(WRITEQ_TAG | ((uint32_t)SP_LED_STREAM << 8));
+}
+
+// Queue a report for the output worker; never blocks on the device.
+HRESULT hid_write_data(const char* dat, size_t length) {
+  if (!usb_connected) {
+    return S_FALSE;
   }
-  if (GetAsyncKeyState(cfg.gamebtn_Rside_keycode) & 0x8000) {
-    dummy_mu3_right_btn |= MU3_IO_GAMEBTN_SIDE;
+
+  return writeq_submit(dat, length, hid_coalesce_key(dat, length));
+}
+
+// 发送HID数据要求设备开始持续上报 (queued, the session retries it)
+static void usb_send_input_start(void) {
+  HidconfigData data = {0};
+  data.reportID = HIDCONFIG_REPORT_ID;
+  data.symbol = 0x01;
+  data.command = SP_INPUT_GET_START;
+  hid_write_data((const char*)&data, sizeof(data));
+}
+
+// Drain and decode every completed read.
+// Returns false if the device was disconnected and has been cleaned up.
+static bool usb_drain_reads(void) {
+  if (usb_rematch != 0) {
+    dprintf("SimGEKI: Device IDs changed, reconnecting.\n");
+    usb_cleanup();
+    hotplug_request_reconnect();
+    return false;
   }
-  if (GetAsyncKeyState(cfg.gamebtn_Rmenu_keycode) & 0x8000) {
-    dummy_mu3_right_btn |= MU3_IO_GAMEBTN_MENU;
+  if (report_drain(&hid) == TRANSPORT_DISCONNECTED) {
+    usb_cleanup();
+    hotplug_request_reconnect();
+    return false;
   }
+  return true;
 }
 
-HRESULT hid_on_data(char* dat, size_t length) {
-  HidconfigData* data = (HidconfigData*)dat;
-  if (length == 64) {
-#ifdef DEBUG
-    for (size_t i = 0; i < length; i++) {
-      printf("%02X ", (unsigned char)dat[i]);
+// Reader thread: blocks on the read event and decodes every report as it
+// lands, so mu3_io_poll() only has to fold the pending events. As hub owner
+// it also wakes up for LED frames submitted by the client process.
+static DWORD WINAPI reader_thread_proc(LPVOID param) {
+  (void)param;
+  DWORD wait_ms = 0;
+  HANDLE events[2];
+
+  dprintf("SimGEKI: Reader thread started.\n");
+
+  for (;;) {
+    if (!usb_connected) {
+      // The reconnect worker brings the device back
+      hotplug_wait_connected(READER_WAIT_MS);
+      continue;
     }
-    printf("\n");
-    printf("SimGEKI: HID data received, reportID: %02X, command: %02X\n",
-           data->reportID, data->command);
-#endif  // DEBUG
-    if (data->reportID == HIDCONFIG_REPORT_ID) {
-      switch (data->command) {
-        case SP_INPUT_GET:  // 获取输入状态
-          mu3_opbtn = 0;
-          if (data->input_status & BT_COIN) {
-            mu3_opbtn |= MU3_IO_OPBTN_COIN;  // 硬币投币按钮
-          }
-          if (data->input_status & BT_TEST) {
-            mu3_opbtn |= MU3_IO_OPBTN_TEST;  // 测试按钮
-          }
-          if (data->input_status & BT_SERVICE) {
-            mu3_opbtn |= MU3_IO_OPBTN_SERVICE;  // 服务按钮
-          }
-          // 读取游戏按钮状态
-          mu3_left_btn = 0;
-          mu3_right_btn = 0;
-          if (data->input_status & BT_R_A) {
-            mu3_right_btn |= MU3_IO_GAMEBTN_1;  // 右侧按钮1
-          }
-          if (data->input_status & BT_R_B) {
-            mu3_right_btn |= MU3_IO_GAMEBTN_2;  // 右侧按钮2
-          }
-          if (data->input_status & BT_R_C) {
-            mu3_right_btn |= MU3_IO_GAMEBTN_3;  // 右侧按钮3
-          }
-          if (data->input_status & BT_L_A) {
-            mu3_left_btn |= MU3_IO_GAMEBTN_1;  // 左侧按钮1
-          }
-          if (data->input_status & BT_L_B) {
-            mu3_left_btn |= MU3_IO_GAMEBTN_2;  // 左侧按钮2
-          }
-          if (data->input_status & BT_L_C) {
-            mu3_left_btn |= MU3_IO_GAMEBTN_3;  // 左侧按钮3
-          }
-          if (data->input_status & BT_LSIDE) {
-            mu3_left_btn |= MU3_IO_GAMEBTN_SIDE;  // 左侧侧键
-          }
-          if (data->input_status & BT_RSIDE) {
-            mu3_right_btn |= MU3_IO_GAMEBTN_SIDE;  // 右侧侧键
-          }
-          if (data->input_status & BT_RMENU) {
-            mu3_right_btn |= MU3_IO_GAMEBTN_MENU;  // 右侧菜单键
-          }
-          if (data->input_status & BT_LMENU) {
-            mu3_left_btn |= MU3_IO_GAMEBTN_MENU;  // 左侧菜单键
-          }
-          mu3_left_btn ^= MU3_IO_GAMEBTN_SIDE;
-          mu3_right_btn ^= MU3_IO_GAMEBTN_SIDE;
-          // 读取摇杆位置
-          uint16_t lever_pos = 0;
-          lever_pos = data->roller_value_sp;
-          mu3_lever_pos = ((int32_t)lever_pos) - 0x8000;
-#ifdef DEBUG
-          dprintf("SimGEKI: Lever position: %04X\n", lever_pos);
-          dprintf("SimGEKI: Operator buttons: %02X\n", mu3_opbtn);
-          dprintf("SimGEKI: Left game buttons: %02X\n", mu3_left_btn);
-          dprintf("SimGEKI: Right game buttons: %02X\n", mu3_right_btn);
-#endif  // DEBUG
-          break;
-        case SP_LED_SET:  // 设置LED状态
-          // 这里可以处理LED数据，如果需要的话
-          // 目前不需要处理LED数据
-          break;
-        case SP_INPUT_GET_START:
-          poll_state = 1;
-          dprintf("SimGEKI: Start poll listening\n");
-          break;
-        case SP_INPUT_GET_END:
-          poll_state = 0;
-          dprintf("SimGEKI: Stop poll listening\n");
-          break;
-        default:
-          dprintf("SimGEKI: Unknown HID command: %02X\n", data->command);
-          return E_FAIL;
+
+    events[0] = hid.read_event;
+    events[1] = hub_led_event();
+    DWORD wait = WaitForMultipleObjects(events[1] != NULL ? 2 : 1, events,
+                                        FALSE, wait_ms);
+    stats_count_io(STATS_IO_CALL, 1);
+    stats_count_io(STATS_IO_WAIT, 1);
+    if (wait == WAIT_OBJECT_0) {
+      if (!usb_drain_reads()) {
+        continue;
       }
     }
+    hub_drain_leds();
+
+    // Wake up again in time for the next start retry or gap check
+    wait_ms = session_tick(stats_now());
+    if (wait_ms > READER_WAIT_MS) {
+      wait_ms = READER_WAIT_MS;
+    }
   }
-  return S_OK;
+
+  return 0;
 }
 
-// Clean up USB resources
-static void usb_cleanup(void) {
-  if (ov_write.hEvent != NULL) {
-    CloseHandle(ov_write.hEvent);
-    ov_write.hEvent = NULL;
+// writeq_submit() in completion port mode: wake the worker once per batch
+// of queued reports
+static void io_wake_writes(void) {
+  if (InterlockedExchange(&io_write_wake, 1) == 0) {
+    transport_iocp_post(IO_KEY_WRITE);
   }
-  if (ov_read.hEvent != NULL) {
-    CloseHandle(ov_read.hEvent);
-    ov_read.hEvent = NULL;
+}
+
+// Hand queued reports to free write slots, and give up on writes the device
+// has not taken within the timeout
+static void io_issue_writes(void) {
+  uint8_t report[WRITEQ_REPORT_SIZE];
+  size_t length;
+
+  InterlockedExchange(&io_write_wake, 0);
+  EnterCriticalSection(&write_lock);
+  while (usb_connected && hid.is_open && transport_iocp_write_ready(&hid) &&
+         writeq_take(report, &length)) {
+    transport_status_t status =
+        transport_write(&hid, report, length, USB_WRITE_TIMEOUT_MS);
+    if (status != TRANSPORT_PENDING) {
+      writeq_done(hid_write_finished(report, length, status));
+    }
   }
-  if (hid_handle != NULL && hid_handle != INVALID_HANDLE_VALUE) {
-    CloseHandle(hid_handle);
-    hid_handle = NULL;
+  if (usb_connected && hid.is_open) {
+    transport_iocp_expire_writes(&hid, USB_WRITE_TIMEOUT_MS);
   }
-  usb_connected = false;
-  poll_state = 0;
+  LeaveCriticalSection(&write_lock);
 }
 
-// Initialize USB device
-static HRESULT usb_init(void) {
-  // Clean up any existing connection first
-  usb_cleanup();
+static VOID CALLBACK io_hub_led_signalled(PVOID param, BOOLEAN timed_out) {
+  (void)param;
+  (void)timed_out;
+  transport_iocp_post(IO_KEY_HUB_LED);
+}
 
-  dprintf("SimGEKI: Attempting to connect USB device...\n");
+// Completion port worker, in place of the reader thread and the output
+// worker: read and write completions and the other threads' signals all come
+// through the port, so this is the only place the thread sleeps. Several
+// completions are taken per wake-up and up to TRANSPORT_IOCP_WRITES writes
+// are in flight.
+static DWORD WINAPI io_thread_proc(LPVOID param) {
+  transport_iocp_event_t events[TRANSPORT_IOCP_BATCH];
+  DWORD wait_ms = READER_WAIT_MS;
+  (void)param;
+
+  dprintf("SimGEKI: Completion port worker started.\n");
+
+  for (;;) {
+    size_t count = transport_iocp_wait(events, TRANSPORT_IOCP_BATCH, wait_ms);
+    bool connected = false;
+
+    for (size_t i = 0; i < count; i++) {
+      transport_iocp_event_t* e = &events[i];
+      switch (e->kind) {
+        case TRANSPORT_IOCP_WRITE:
+          writeq_done(hid_write_finished(e->data, e->length, e->status));
+          break;
+        case TRANSPORT_IOCP_SIGNAL:
+          connected = connected || e->key == IO_KEY_CONNECTED;
+          break;
+        default:
+          // Reads are drained below; completions of a closed connection
+          // need nothing
+          break;
+      }
+    }
 
-  char vid_full[16] = {0};
-  char pid_full[16] = {0};
-  char mi_full[16] = {0};
-  snprintf(vid_full, sizeof(vid_full), "VID_%s", cfg.vid_num);
-  snprintf(pid_full, sizeof(pid_full), "PID_%s", cfg.pid_num);
-  snprintf(mi_full, sizeof(mi_full), "MI_%s", cfg.mi_num);
-
-  // Try to get HID device path
-  hid_path_size = sizeof(hid_path);
-  if (GetHidPathByVidPidMi(vid_full, pid_full, mi_full, hid_path,
-                           &hid_path_size) != S_OK) {
-    dprintf("SimGEKI: USB device not found. VID: %s, PID: %s, MI: %s\n",
-            vid_full, pid_full, mi_full);
-    return S_FALSE;
-  }
+    wait_ms = READER_WAIT_MS;
+    if (!usb_connected) {
+      // The reconnect worker signals the next connection. Nothing can be
+      // written until then, let the next write wake the worker again.
+      InterlockedExchange(&io_write_wake, 0);
+      continue;
+    }
 
-  dprintf("SimGEKI: HID Path: %s\n", hid_path);
+    // A new connection: arm its reads here, the only thread touching them
+    if (connected && transport_read_start(&hid) != TRANSPORT_OK) {
+      dlog(DLOG_ERROR, "SimGEKI: Failed to start reading: %lu\n",
+           (unsigned long)hid.last_error);
+      usb_cleanup();
+      hotplug_request_reconnect();
+      continue;
+    }
+    if (!usb_drain_reads()) {
+      continue;
+    }
+    hub_drain_leds();
+    io_issue_writes();
 
-  // Try to open the HID device
-  hid_handle = CreateFileA(hid_path, GENERIC_READ | GENERIC_WRITE,
-                           FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
-                           OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
-  if (hid_handle == INVALID_HANDLE_VALUE) {
-    dprintf("SimGEKI: Failed to open HID device.\n");
-    hid_handle = NULL;
-    return S_FALSE;
+    // Wake up again in time for the next start retry or gap check
+    wait_ms = session_tick(stats_now());
+    if (wait_ms > READER_WAIT_MS) {
+      wait_ms = READER_WAIT_MS;
+    }
   }
 
-  dprintf("SimGEKI: HID device opened successfully.\n");
+  return 0;
+}
 
-  // Create event for async read
-  ov_read.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-  if (!ov_read.hEvent) {
-    CloseHandle(hid_handle);
-    hid_handle = NULL;
-    return HRESULT_FROM_WIN32(GetLastError());
+static void reader_thread_start(void) {
+  if (reader_thread != NULL) {
+    return;
   }
 
-  // Create event for async write
-  ov_write.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-  if (!ov_write.hEvent) {
-    CloseHandle(ov_read.hEvent);
-    ov_read.hEvent = NULL;
-    CloseHandle(hid_handle);
-    hid_handle = NULL;
-    return HRESULT_FROM_WIN32(GetLastError());
+  reader_thread = CreateThread(
+      NULL, 0, io_engine ? io_thread_proc : reader_thread_proc, NULL, 0, NULL);
+  if (reader_thread == NULL) {
+    dlog(DLOG_ERROR,
+         "SimGEKI: Failed to start reader thread: %lu, falling back to "
+         "polled mode.\n",
+         (unsigned long)GetLastError());
+    return;
   }
+  SetThreadPriority(reader_thread, THREAD_PRIORITY_HIGHEST);
 
-  // Start first async read
-  ResetEvent(ov_read.hEvent);
-  if (!ReadFile(hid_handle, hid_read_buf, REPORT_SIZE, NULL, &ov_read) &&
-      GetLastError() != ERROR_IO_PENDING) {
-    usb_cleanup();
-    return HRESULT_FROM_WIN32(GetLastError());
+  // Hub owner: LED frames of the client wake the worker through the port
+  if (io_engine && hub_led_event() != NULL &&
+      !RegisterWaitForSingleObject(&io_hub_wait, hub_led_event(),
+                                   io_hub_led_signalled, NULL, INFINITE,
+                                   WT_EXECUTEINWAITTHREAD)) {
+    dlog(DLOG_ERROR, "SimGEKI: Failed to wait for hub LED frames: %lu\n",
+         (unsigned long)GetLastError());
   }
-
-  usb_connected = true;
-  dprintf("SimGEKI: USB device initialized successfully.\n");
-  return S_OK;
 }
 
-HRESULT hid_write_data(const char* dat, size_t length) {
-#ifdef DEBUG_TEXT_ONLY
-  dprintf("SimGEKI: HID write data.\n");
-  return S_OK;
-#endif  // DEBUG_TEXT_ONLY
-  if (!usb_connected || hid_handle == NULL ||
-      hid_handle == INVALID_HANDLE_VALUE) {
-    return S_FALSE;
+// Only the process that talks to the device records its reports
+static void trace_start(void) {
+  if (cfg.trace_path[0] != '\0') {
+    trace_open(cfg.trace_path);
   }
+}
 
-  // 异步写：重置写事件并发起 WriteFile
-  ResetEvent(ov_write.hEvent);
-  DWORD written;
-  if (!WriteFile(hid_handle, dat, (DWORD)length, &written, &ov_write) &&
-      GetLastError() != ERROR_IO_PENDING) {
-    DWORD error = GetLastError();
-    dprintf("SimGEKI: WriteFile failed: %lu\n", (unsigned long)error);
-    // Check if device disconnected
-    if (is_usb_disconnection_error(error)) {
-      dprintf("SimGEKI: USB device appears to be disconnected.\n");
-      usb_cleanup();
-    }
-    return HRESULT_FROM_WIN32(error);
+static void tp_dump_at_exit(void) {
+  tp_dump(cfg.tp_dump_path);
+}
+
+// Trace points are per process: the hub client records its own
+static void tp_init(void) {
+  static bool dump_at_exit = false;
+
+  if (cfg.tp_mask == 0) {
+    tp_stop();
+    return;
+  }
+  if (tp_start(cfg.tp_mask, cfg.tp_records) != S_OK) {
+    dlog(DLOG_ERROR, "SimGEKI: Failed to allocate the trace point ring.\n");
+    return;
   }
+  dprintf("SimGEKI: Trace points enabled (mask %02X).\n",
+          (unsigned)cfg.tp_mask);
+  if (cfg.tp_dump_path[0] != '\0' && !dump_at_exit) {
+    atexit(tp_dump_at_exit);
+    dump_at_exit = true;
+  }
+}
 
-  // 等待写操作完成
-  DWORD waitResult = WaitForSingleObject(ov_write.hEvent, USB_WRITE_TIMEOUT_MS);
-  if (waitResult != WAIT_OBJECT_0) {
-    dprintf("SimGEKI: Write operation timeout or failed.\n");
-    return E_FAIL;
+static void lever_predict_publish(void) {
+  const lever_predict_params_t* active = lever_predict_active;
+  lever_predict_params_t* next = NULL;
+
+  if (cfg.lever_predict_enabled) {
+    if (active != NULL &&
+        memcmp(active, &cfg.lever_predict, sizeof(*active)) == 0) {
+      return;
+    }
+    next = (lever_predict_params_t*)malloc(sizeof(*next));
+    if (next == NULL) {
+      return;
+    }
+    *next = cfg.lever_predict;
   }
+  InterlockedExchangePointer((PVOID volatile*)&lever_predict_active, next);
+}
 
-  if (!GetOverlappedResult(hid_handle, &ov_write, &written, FALSE)) {
-    DWORD error = GetLastError();
-    dprintf("SimGEKI: Overlapped write failed: %lu\n", (unsigned long)error);
-    // Check if device disconnected
-    if (is_usb_disconnection_error(error)) {
-      dprintf("SimGEKI: USB device appears to be disconnected.\n");
-      usb_cleanup();
+// simgeki_io.ini was saved: apply what changed, on the watcher thread
+static void on_config_reload(const MU3IO_CONFIG* old) {
+  dprintf_set_level(cfg.log_level);
+  if (cfg.tp_mask != old->tp_mask) {
+    tp_init();
+  }
+  color_configure(&cfg.led_color);
+  lever_predict_publish();
+  if (keyboard_reload() != S_OK) {
+    dlog(DLOG_ERROR, "SimGEKI: Failed to start keyboard input.\n");
+  }
+
+  if (hub_role() != HUB_ROLE_CLIENT &&
+      (strcmp(cfg.vid_num, old->vid_num) != 0 ||
+       strcmp(cfg.pid_num, old->pid_num) != 0 ||
+       strcmp(cfg.mi_num, old->mi_num) != 0)) {
+    InterlockedExchange(&usb_rematch, 1);
+    if (io_engine) {
+      transport_iocp_post(IO_KEY_REMATCH);
     }
-    return E_FAIL;
   }
+}
 
-  return S_OK;
+// The hub owner process exited and this process takes over the device. The
+// reconnect worker connects in the background, so nothing runs on the game
+// thread.
+static void on_hub_promote(void) {
+  trace_start();
+  hotplug_start(usb_init, false);
+  reader_thread_start();
+}
+
+static void mu3_io_init_done(void) {
+  stats_milestone(STATS_MILESTONE_INIT_DONE);
+  mu3_io_stats_t stats;
+  stats_get(&stats);
+  dprintf("SimGEKI: IO init done in %.2f ms, device %s.\n",
+          (double)stats.init_us / 1000.0,
+          usb_connected ? "ready" : "connecting in the background");
+  dprintf("SimGEKI: ---  End  configuration ---\n");
 }
 
 uint16_t mu3_io_get_api_version(void) {
@@ -331,209 +605,241 @@ uint16_t mu3_io_get_api_version(void) {
 }
 
 HRESULT mu3_io_init(void) {
-#ifdef DEBUG_TEXT_ONLY
-  dprintf("SimGEKI: MU3 IO Init.\n");
-  return S_OK;
-#endif  // DEBUG_TEXT_ONLY
+  stats_init();
   dprintf("SimGEKI: --- Begin configuration ---\n");
   dprintf("SimGEKI: IO init...\n");
 
+  InitializeCriticalSection(&write_lock);
+  InitializeCriticalSection(&cancel_lock);
   config_load_from_ini();
-#ifdef DEBUG
-  dprintf("SimGEKI: Keyboard enabled: %s\n",
-          cfg.keyboard_enabled != 0 ? "Yes" : "No");
-  dprintf("SimGEKI: VID: %s, PID: %s, MI: %s\n", cfg.vid_num, cfg.pid_num,
-          cfg.mi_num);
-
-  dprintf("SimGEKI: Test keycode: 0x%02X\n", cfg.test_keycode);
-  dprintf("SimGEKI: Service keycode: 0x%02X\n", cfg.service_keycode);
-  dprintf("SimGEKI: Coin keycode: 0x%02X\n", cfg.coin_keycode);
-
-#endif  // DEBUG
-
-  // Initialize USB device, but don't fail if it's not connected
-  HRESULT hr = usb_init();
-  if (hr == S_OK) {
-    dprintf("SimGEKI: USB device connected and initialized.\n");
-  } else {
-    dprintf("SimGEKI: USB device not connected, will retry during polling.\n");
+  dprintf_set_level(cfg.log_level);
+  tp_init();
+  color_configure(&cfg.led_color);
+  lever_predict_publish();
+  decode_init();
+  if (keyboard_init() != S_OK) {
+    dlog(DLOG_ERROR, "SimGEKI: Failed to start keyboard input.\n");
+  }
+  if (cfg.completion_port) {
+    io_engine = transport_iocp_start() == S_OK;
+    if (io_engine) {
+      transport_bind(&hid, &transport_iocp_ops);
+      dprintf("SimGEKI: Using the I/O completion port engine.\n");
+    } else {
+      dlog(DLOG_ERROR,
+           "SimGEKI: Failed to create the I/O completion port, using "
+           "events.\n");
+    }
+  }
+  if ((io_engine ? writeq_init_consumer(io_wake_writes)
+                 : writeq_init(hid_write_report)) != S_OK) {
+    dlog(DLOG_ERROR, "SimGEKI: Failed to start output worker.\n");
+  }
+  dlog(DLOG_DEBUG, "SimGEKI: Keyboard enabled: %s\n",
+       cfg.keyboard_enabled != 0 ? "Yes" : "No");
+  dlog(DLOG_DEBUG, "SimGEKI: VID: %s, PID: %s, MI: %s\n", cfg.vid_num,
+       cfg.pid_num, cfg.mi_num);
+  dlog(DLOG_DEBUG, "SimGEKI: Test keycode: 0x%02X\n", cfg.test_keycode);
+  dlog(DLOG_DEBUG, "SimGEKI: Service keycode: 0x%02X\n",
+       cfg.service_keycode);
+  dlog(DLOG_DEBUG, "SimGEKI: Coin keycode: 0x%02X\n", cfg.coin_keycode);
+  if (config_watch_start(on_config_reload) != S_OK) {
+    dlog(DLOG_WARN,
+         "SimGEKI: Failed to watch the config, changes need a restart.\n");
+  }
+
+  // Decoded reports also go to the hub (a no-op unless this is the owner)
+  report_set_input_hook(hub_publish_input);
+  report_set_lever_filter(cfg.lever_filter_enabled ? &cfg.lever_filter
+                                                   : NULL);
+  report_set_calib_hook(on_lever_calibrated);
+  session_init(usb_send_input_start, cfg.stream_timeout_ms);
+  calib_init(&cfg.lever_calib);
+  if (cfg.lever_calibrate) {
+    calib_start();
+  } else if (calib_state() == CALIB_ACTIVE) {
+    dprintf("SimGEKI: Lever calibration loaded.\n");
+  } else if (cfg.lever_calib.center != 0) {
+    dlog(DLOG_WARN,
+         "SimGEKI: Lever calibration in ini is invalid, ignored.\n");
+  }
+  if (cfg.shared_hub_enabled && hub_init(on_hub_promote) != S_OK) {
+    dprintf("SimGEKI: Shared hub unavailable, using the device directly.\n");
+  }
+  if (hub_role() == HUB_ROLE_CLIENT) {
+    // Another process owns the device; inputs and LEDs go through the hub
+    mu3_io_init_done();
+    return S_OK;
   }
-  usb_init_attempted = true;
-  dprintf("SimGEKI: ---  End  configuration ---\n");
-  return S_OK;
-}
 
-// Update input state
-HRESULT mu3_io_poll(void) {
-#ifdef DEBUG_TEXT_ONLY
-  dprintf("SimGEKI: MU3 IO Poll.\n");
-  return S_OK;
-#endif  // DEBUG_TEXT_ONLY
-#ifdef DEBUG
-  // dprintf("SimGEKI: MU3 IO Polling\n");
-#endif  // DEBUG
+  trace_start();
 
-  // If USB is not connected, try to connect
-  if (!usb_connected) {
-    // Only try to reconnect every ~60 polls to avoid spamming
-    static int reconnect_counter = 0;
-    reconnect_counter++;
-    if (reconnect_counter >= USB_RECONNECT_POLL_INTERVAL) {
-      reconnect_counter = 0;
-      HRESULT hr = usb_init();
-      if (hr == S_OK) {
-        dprintf("SimGEKI: USB device reconnected successfully.\n");
-      }
-    }
-    return S_OK;
+  // Enumeration and the first open run on the reconnect worker, the game
+  // keeps booting with neutral inputs meanwhile
+  if (hotplug_start(usb_init, false) != S_OK) {
+    dlog(DLOG_ERROR, "SimGEKI: Failed to start reconnect worker.\n");
   }
 
-  DWORD bytes = 0;
-  int packet_count = 0;
-  char last_packet[REPORT_SIZE];
-  size_t last_packet_size = 0;
-
-  // 循环读取所有可用的包，只保留最后一个
-  while (GetOverlappedResult(hid_handle, &ov_read, &bytes, FALSE)) {
-    packet_count++;
-
-    // 保存当前包作为最后一个包
-    memcpy(last_packet, hid_read_buf, bytes);
-    last_packet_size = bytes;
-
-    // 立即发起下一次异步读
-    ResetEvent(ov_read.hEvent);
-    if (!ReadFile(hid_handle, hid_read_buf, REPORT_SIZE, NULL, &ov_read)) {
-      DWORD error = GetLastError();
-      if (error != ERROR_IO_PENDING) {
-        dprintf("SimGEKI: ReadFile failed: %lu\n", (unsigned long)error);
-        // Check if device disconnected
-        if (is_usb_disconnection_error(error)) {
-          dprintf("SimGEKI: USB device disconnected.\n");
-          usb_cleanup();
-          return S_OK;
-        }
-        break;
-      }
-    }
+  // The hub owner must keep reading even if its own game thread stops
+  // polling, since the client depends on it
+  if (cfg.reader_thread_enabled || io_engine ||
+      hub_role() == HUB_ROLE_OWNER) {
+    reader_thread_start();
   }
+  mu3_io_init_done();
+  return S_OK;
+}
 
-  // Check if the last GetOverlappedResult failed due to disconnection
-  if (packet_count == 0) {
-    DWORD error = GetLastError();
-    if (error != ERROR_IO_INCOMPLETE && error != ERROR_SUCCESS) {
-      // Check if device disconnected
-      if (is_usb_disconnection_error(error)) {
-        dprintf("SimGEKI: USB device disconnected (error: %lu).\n",
-                (unsigned long)error);
-        usb_cleanup();
-        return S_OK;
-      }
-    }
+HRESULT mu3_io_wait_ready(uint32_t timeout_ms) {
+  if (hub_role() == HUB_ROLE_CLIENT) {
+    return hub_wait_input(timeout_ms) ? S_OK : S_FALSE;
   }
+  if (usb_connected) {
+    return S_OK;
+  }
+  return hotplug_wait_connected(timeout_ms) ? S_OK : S_FALSE;
+}
 
-// 如果有包被丢弃，打印日志
-#ifdef DEBUG
-  if (packet_count > 1) {
-    dprintf("SimGEKI: Discarded %d packets, processing only the latest one\n",
-            packet_count - 1);
+// Latch the input for this poll, with the keyboard sampled once and merged in
+static void poll_latch(input_snapshot_t snapshot, LONGLONG decode_qpc) {
+  snapshot |= (input_snapshot_t)keyboard_fold();
+  snapshot_store(&polled_snapshot, snapshot);
+  TP(TP_POLL,
+     SNAPSHOT_OPBTN(snapshot) | SNAPSHOT_LEFT(snapshot) << 8 |
+         SNAPSHOT_RIGHT(snapshot) << 16,
+     (uint16_t)SNAPSHOT_LEVER(snapshot), 0);
+  InterlockedExchange64(&polled_qpc, decode_qpc);
+  InterlockedExchange(&polled_unconsumed, 1);
+}
+
+// The game reads the input of this poll: record how old it is, once per poll
+static void poll_consumed(void) {
+  if (InterlockedExchange(&polled_unconsumed, 0) != 0) {
+    stats_record(STATS_DECODE_TO_CONSUME,
+                 InterlockedCompareExchange64(&polled_qpc, 0, 0),
+                 stats_now());
   }
-#endif
+}
 
-  // 只处理最后一个包
-  if (packet_count > 0) {
-    hid_on_data(last_packet, last_packet_size);
+// Update input state
+HRESULT mu3_io_poll(void) {
+  static LONGLONG last_poll_qpc = 0;
+  LONGLONG now = stats_now();
+  stats_record(STATS_POLL_INTERVAL, last_poll_qpc, now);
+  last_poll_qpc = now;
+
+  // Hub client: the owner process reads the device for us
+  if (hub_role() == HUB_ROLE_CLIENT) {
+    LONGLONG decode_qpc;
+    input_snapshot_t snapshot = hub_fold_input(&decode_qpc);
+    if (decode_qpc != 0) {
+      stats_milestone(STATS_MILESTONE_DEVICE_READY);
+    }
+    poll_latch(snapshot, decode_qpc);
+    return S_OK;
   }
 
-  // 发送HID数据要求设备开始持续上报
-  if (poll_state == 0) {
-    HidconfigData data = {0};
-    data.reportID = HIDCONFIG_REPORT_ID;
-    data.symbol = 0x01;
-    data.command = SP_INPUT_GET_START;
-    hid_write_data((const char*)&data, sizeof(data));
+  // Reader thread mode: inputs are already decoded, just latch them.
+  // Otherwise drain here; while disconnected the reconnect worker is on it,
+  // never enumerate on the game thread.
+  if (reader_thread == NULL && usb_connected && usb_drain_reads()) {
+    session_tick(now);
   }
+  stats_end_poll();
 
+  input_snapshot_t snapshot = input_fold_pending();
+  poll_latch(snapshot, input_folded_qpc());
   return S_OK;
 }
 
 void mu3_io_get_opbtns(uint8_t* opbtn) {
-#ifdef DEBUG_TEXT_ONLY
-  dprintf("SimGEKI: MU3 IO Get Operator Buttons.\n");
-  if (opbtn != NULL) {
-    *opbtn = 0;
-  }
-  return;
-#endif  // DEBUG_TEXT_ONLY
-#ifdef DEBUG
-  // dprintf("SimGEKI: MU3 IO Get Operator Buttons\n");
-#endif  // DEBUG
+  dlog(DLOG_TRACE, "SimGEKI: MU3 IO Get Operator Buttons\n");
   static uint8_t prevent_mu3_opbtn = 0;
+  uint8_t mu3_opbtn = SNAPSHOT_OPBTN(snapshot_load(&polled_snapshot));
   if (opbtn != NULL) {
-    if (cfg.keyboard_enabled) {
-      keyboard_dummy();
-      *opbtn = 0;
-      *opbtn = dummy_mu3_opbtn;
-      if ((dummy_mu3_opbtn & MU3_IO_OPBTN_COIN) &&
-          (prevent_mu3_opbtn & MU3_IO_OPBTN_COIN)) {
-        *opbtn &= ~MU3_IO_OPBTN_COIN;  // 禁止重复投币
-      }
-    } else {
-      *opbtn = 0;
-      *opbtn = mu3_opbtn;
-      if ((mu3_opbtn & MU3_IO_OPBTN_COIN) &&
-          (prevent_mu3_opbtn & MU3_IO_OPBTN_COIN)) {
-        *opbtn &= ~MU3_IO_OPBTN_COIN;  // 禁止重复投币
-      }
+    *opbtn = mu3_opbtn;
+    if ((mu3_opbtn & MU3_IO_OPBTN_COIN) &&
+        (prevent_mu3_opbtn & MU3_IO_OPBTN_COIN)) {
+      *opbtn &= ~MU3_IO_OPBTN_COIN;  // 禁止重复投币
     }
   }
-  prevent_mu3_opbtn = cfg.keyboard_enabled != 0 ? dummy_mu3_opbtn : mu3_opbtn;
+  prevent_mu3_opbtn = mu3_opbtn;
 }
 
 void mu3_io_get_gamebtns(uint8_t* left, uint8_t* right) {
-#ifdef DEBUG_TEXT_ONLY
-  dprintf("SimGEKI: MU3 IO Get Game Buttons.\n");
+  dlog(DLOG_TRACE, "SimGEKI: MU3 IO Get Game Buttons\n");
+  input_snapshot_t snapshot = snapshot_load(&polled_snapshot);
+  poll_consumed();
   if (left != NULL) {
-    *left = 0;
+    *left = SNAPSHOT_LEFT(snapshot);
   }
   if (right != NULL) {
-    *right = 0;
-  }
-  return;
-#endif  // DEBUG_TEXT_ONLY
-#ifdef DEBUG
-  // dprintf("SimGEKI: MU3 IO Get Game Buttons\n");
-#endif  // DEBUG
-  if (left != NULL) {
-    *left = cfg.keyboard_enabled != 0 ? dummy_mu3_left_btn : mu3_left_btn;
-  }
-  if (right != NULL) {
-    *right = cfg.keyboard_enabled != 0 ? dummy_mu3_right_btn : mu3_right_btn;
+    *right = SNAPSHOT_RIGHT(snapshot);
   }
 }
 
 void mu3_io_get_lever(int16_t* pos) {
-#ifdef DEBUG_TEXT_ONLY
-  dprintf("SimGEKI: MU3 IO Get Lever Position.\n");
+  dlog(DLOG_TRACE, "SimGEKI: MU3 IO Get Lever Position\n");
   if (pos != NULL) {
-    *pos = 0;
+    input_snapshot_t snapshot = snapshot_load(&polled_snapshot);
+    *pos = SNAPSHOT_LEVER(snapshot);
+
+    // Extrapolate to now: the report is already this old
+    LONGLONG decode_qpc = InterlockedCompareExchange64(&polled_qpc, 0, 0);
+    const lever_predict_params_t* predict = lever_predict_active;
+    if (predict != NULL && decode_qpc != 0) {
+      *pos = lever_predict(predict, *pos,
+                           SNAPSHOT_LEVER_VELOCITY(snapshot),
+                           stats_elapsed_us(decode_qpc, stats_now()));
+    }
   }
-  return;
-#endif  // DEBUG_TEXT_ONLY
-#ifdef DEBUG
-  // dprintf("SimGEKI: MU3 IO Get Lever Position\n");
-#endif  // DEBUG
-  if (pos != NULL) {
-    *pos = mu3_lever_pos;
+  poll_consumed();
+}
+
+HRESULT mu3_io_get_stats(mu3_io_stats_t* stats) {
+  if (stats == NULL) {
+    return E_POINTER;
+  }
+
+  stats_get(stats);
+  return S_OK;
+}
+
+void mu3_io_dump_stats(void) {
+  stats_dump();
+  if (cfg.tp_dump_path[0] != '\0') {
+    tp_dump(cfg.tp_dump_path);
   }
 }
 
 HRESULT mu3_io_led_init(void) {
   dprintf("SimGEKI: MU3 IO LED init...\n");
+  led_init();
   return S_OK;
 }
 
 void mu3_io_led_set_colors(uint8_t board, uint8_t* rgb) {
+  // Board 0: gamma, brightness, pillar downsampling and current limit, on
+  // the caller's thread
+  uint8_t frame[LED_STREAM_LEDS * 3];
+  uint8_t leds = 0;
+  if (board == 0x00 && rgb != NULL) {
+    leds = color_transform(rgb, frame);
+  }
+
+  // Board 0 streaming: the full frame, chunked by led.c
+  if (board == 0x00 && cfg.led_stream != 0) {
+    if (rgb == NULL) {
+      return;
+    }
+    if (hub_role() == HUB_ROLE_CLIENT) {
+      hub_submit_led_stream(frame, leds);
+    } else {
+      led_submit_stream(frame, leds);
+    }
+    return;
+  }
+
   // 发送HID数据要求设备更新LED
   HidconfigData data = {0};
   data.reportID = HIDCONFIG_REPORT_ID;
@@ -547,43 +853,45 @@ void mu3_io_led_set_colors(uint8_t board, uint8_t* rgb) {
       if (rgb == NULL) {
         return;
       }
-      data.led_rgb_left[0][0] = rgb[0];
-      data.led_rgb_left[0][1] = rgb[1];
-      data.led_rgb_left[0][2] = rgb[2];
-      data.led_rgb_left[1][0] = rgb[0];
-      data.led_rgb_left[1][1] = rgb[1];
-      data.led_rgb_left[1][2] = rgb[2];
-      data.led_rgb_left[2][0] = rgb[0];
-      data.led_rgb_left[2][1] = rgb[1];
-      data.led_rgb_left[2][2] = rgb[2];
-      data.led_rgb_left[3][0] = rgb[3];
-      data.led_rgb_left[3][1] = rgb[4];
-      data.led_rgb_left[3][2] = rgb[5];
-      data.led_rgb_left[4][0] = rgb[3];
-      data.led_rgb_left[4][1] = rgb[4];
-      data.led_rgb_left[4][2] = rgb[5];
-      data.led_rgb_left[5][0] = rgb[3];
-      data.led_rgb_left[5][1] = rgb[4];
-      data.led_rgb_left[5][2] = rgb[5];
-
-      data.led_rgb_right[0][0] = rgb[180];
-      data.led_rgb_right[0][1] = rgb[181];
-      data.led_rgb_right[0][2] = rgb[182];
-      data.led_rgb_right[1][0] = rgb[180];
-      data.led_rgb_right[1][1] = rgb[181];
-      data.led_rgb_right[1][2] = rgb[182];
-      data.led_rgb_right[2][0] = rgb[180];
-      data.led_rgb_right[2][1] = rgb[181];
-      data.led_rgb_right[2][2] = rgb[182];
-      data.led_rgb_right[3][0] = rgb[177];
-      data.led_rgb_right[3][1] = rgb[178];
-      data.led_rgb_right[3][2] = rgb[179];
-      data.led_rgb_right[4][0] = rgb[177];
-      data.led_rgb_right[4][1] = rgb[178];
-      data.led_rgb_right[4][2] = rgb[179];
-      data.led_rgb_right[5][0] = rgb[177];
-      data.led_rgb_right[5][1] = rgb[178];
-      data.led_rgb_right[5][2] = rgb[179];
+      // Side buttons: the first and the last two LEDs
+      const uint8_t* right = &frame[(leds - 2) * 3];
+      data.led_rgb_left[0][0] = frame[0];
+      data.led_rgb_left[0][1] = frame[1];
+      data.led_rgb_left[0][2] = frame[2];
+      data.led_rgb_left[1][0] = frame[0];
+      data.led_rgb_left[1][1] = frame[1];
+      data.led_rgb_left[1][2] = frame[2];
+      data.led_rgb_left[2][0] = frame[0];
+      data.led_rgb_left[2][1] = frame[1];
+      data.led_rgb_left[2][2] = frame[2];
+      data.led_rgb_left[3][0] = frame[3];
+      data.led_rgb_left[3][1] = frame[4];
+      data.led_rgb_left[3][2] = frame[5];
+      data.led_rgb_left[4][0] = frame[3];
+      data.led_rgb_left[4][1] = frame[4];
+      data.led_rgb_left[4][2] = frame[5];
+      data.led_rgb_left[5][0] = frame[3];
+      data.led_rgb_left[5][1] = frame[4];
+      data.led_rgb_left[5][2] = frame[5];
+
+      data.led_rgb_right[0][0] = right[3];
+      data.led_rgb_right[0][1] = right[4];
+      data.led_rgb_right[0][2] = right[5];
+      data.led_rgb_right[1][0] = right[3];
+      data.led_rgb_right[1][1] = right[4];
+      data.led_rgb_right[1][2] = right[5];
+      data.led_rgb_right[2][0] = right[3];
+      data.led_rgb_right[2][1] = right[4];
+      data.led_rgb_right[2][2] = right[5];
+      data.led_rgb_right[3][0] = right[0];
+      data.led_rgb_right[3][1] = right[1];
+      data.led_rgb_right[3][2] = right[2];
+      data.led_rgb_right[4][0] = right[0];
+      data.led_rgb_right[4][1] = right[1];
+      data.led_rgb_right[4][2] = right[2];
+      data.led_rgb_right[5][0] = right[0];
+      data.led_rgb_right[5][1] = right[1];
+      data.led_rgb_right[5][2] = right[2];
       break;
     // 7C
     case 0x01:
@@ -599,10 +907,15 @@ void mu3_io_led_set_colors(uint8_t board, uint8_t* rgb) {
       }
       break;
     default:
-      dprintf("SimGEKI: mu3_io_led_set_colors: Invalid board ID: %02X\n",
-              board);
+      dlog(DLOG_WARN,
+           "SimGEKI: mu3_io_led_set_colors: Invalid board ID: %02X\n",
+           board);
       return;
       break;
   }
-  hid_write_data((const char*)&data, sizeof(data));
+  if (hub_role() == HUB_ROLE_CLIENT) {
+    hub_submit_led(board, &data);
+  } else {
+    led_submit(board, &data);
+  }
 }
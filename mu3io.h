@@ -10,9 +10,14 @@
    - 0x0101: Added mu3_io_led_init and mu3_io_set_leds
 */
 
-#include <windows.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* windows.h, or the Win32 subset used by host-native builds (tests,
+   benchmarks) elsewhere. */
+#include "platform.h"
+
 #ifdef MU3IO_EXPORTS
 #define MU3IO_API __declspec(dllexport)
 #else
@@ -87,10 +92,22 @@ enum {
   SP_INPUT_GET = 0xE1,  // Special input get command, for pc dll
   SP_INPUT_GET_START = 0xE2,
   SP_INPUT_GET_END = 0xE3,
+  SP_LED_STREAM = 0xE4,  // Part of a full board 0 frame, see below
 
   UPDATE_FIRMWARE = 0xF1,
   CMD_NOT_SUPPORT = 0xFF,
 };
+/* SP_LED_STREAM: board 0 frames with all 61 LEDs. A frame is cut into
+   chunks of up to LED_STREAM_CHUNK_LEDS LEDs; each chunk carries the frame
+   sequence number and the index of its first LED. Chunks that did not change
+   since the last frame are not sent. The last chunk sent for a frame has
+   LED_STREAM_COMMIT set: the device shows its buffer when it gets it. */
+#define LED_STREAM_LEDS 61
+#define LED_STREAM_CHUNK_LEDS 16
+#define LED_STREAM_CHUNKS \
+  ((LED_STREAM_LEDS + LED_STREAM_CHUNK_LEDS - 1) / LED_STREAM_CHUNK_LEDS)
+#define LED_STREAM_COMMIT 0x01
+
 typedef uint8_t LED_7C_Tag;
 enum {
   LED_7C_L1 = 0x00,
@@ -141,6 +158,13 @@ typedef struct {
           uint8_t led_rgb_uart[4][3];   // RGB port colors, 4 LEDs per port each
                                         // with R, G, B values
         };
+        struct {
+          uint8_t stream_seq;     // Frame sequence number
+          uint8_t stream_offset;  // Index of the first LED in this chunk
+          uint8_t stream_count;   // LEDs in this chunk
+          uint8_t stream_flags;   // LED_STREAM_COMMIT on the last chunk
+          uint8_t led_stream[LED_STREAM_CHUNK_LEDS][3];  // R, G, B values
+        };
       };
     };
     struct {
@@ -280,4 +304,91 @@ MU3IO_API HRESULT mu3_io_led_init(void);
 
 MU3IO_API void mu3_io_led_set_colors(uint8_t board, uint8_t* rgb);
 
-HRESULT hid_write_data(const char* dat, size_t length);
\ No newline at end of file
+/* SimGEKI extension, not part of the MU3 IO API: input latency statistics.
+
+   Each histogram counts samples in log2 buckets of microseconds: bucket 0
+   holds samples below 1 us, bucket i (i > 0) samples in [2^(i-1), 2^i) us,
+   and the last bucket everything above. */
+
+#define MU3_IO_STATS_BUCKETS 24
+
+typedef struct {
+  uint32_t count;
+  uint32_t max_us;
+  uint64_t total_us;
+  uint32_t buckets[MU3_IO_STATS_BUCKETS];
+} mu3_io_histogram_t;
+
+/* Report classes, in the order of mu3_io_report_counts_t arrays. */
+enum {
+  MU3_IO_REPORT_INPUT,   // SP_INPUT_GET
+  MU3_IO_REPORT_START,   // SP_INPUT_GET_START acknowledge
+  MU3_IO_REPORT_END,     // SP_INPUT_GET_END acknowledge
+  MU3_IO_REPORT_LED,     // SP_LED_SET / SP_LED_STREAM echo
+  MU3_IO_REPORT_ROLLER,  // ROLLER_GET_DATA / ROLLER_SET_OFFSET replies
+  MU3_IO_REPORT_OTHER,   // Anything else
+  MU3_IO_REPORT_CLASSES
+};
+
+/* Reports that arrived between two mu3_io_poll() calls are counted towards
+   the second one. Every report is handled when it is read: control packets
+   never hide an input report that came before them in the same poll. */
+typedef struct {
+  uint32_t polls;
+  uint32_t total[MU3_IO_REPORT_CLASSES];
+  uint32_t polls_with[MU3_IO_REPORT_CLASSES];    // Polls with at least one
+  uint32_t max_per_poll[MU3_IO_REPORT_CLASSES];
+} mu3_io_report_counts_t;
+
+typedef struct {
+  // Read completion seen by the drain loop -> report decoded
+  mu3_io_histogram_t report_to_decode;
+  // Newest report of a poll decoded -> first read by mu3_io_get_gamebtns()
+  // or mu3_io_get_lever() after that poll
+  mu3_io_histogram_t decode_to_consume;
+  // Interval between two mu3_io_poll() calls
+  mu3_io_histogram_t poll_interval;
+  // mu3_io_led_set_colors() -> the frame's last report written to the device
+  mu3_io_histogram_t led_frame;
+  // Reports received, by class, and how they were spread over the polls
+  mu3_io_report_counts_t reports;
+  // Debug log messages dropped because the log buffers were full
+  uint32_t log_dropped;
+  // From the start of mu3_io_init() until it returned, and until the device
+  // was first connected (hub client: first input from the owner), 0 = not
+  // yet
+  uint32_t init_us;
+  uint32_t ready_us;
+  // Device I/O system calls (reads, writes, event resets and signals, waits)
+  // and blocking waits of the I/O threads that returned, each one a context
+  // switch when it slept. Divide by the reports received to compare the
+  // event and completion port engines ([io] completionPort).
+  uint32_t io_calls;
+  uint32_t io_waits;
+} mu3_io_stats_t;
+
+/* Copy the statistics gathered since mu3_io_init(). Counters are updated
+   without locks, so a copy taken while the game runs may be off by the few
+   samples recorded during the copy.
+
+   Returns E_POINTER if stats is NULL. */
+
+MU3IO_API HRESULT mu3_io_get_stats(mu3_io_stats_t* stats);
+
+/* Write the statistics to the debug log (dprintf). */
+
+MU3IO_API void mu3_io_dump_stats(void);
+
+/* SimGEKI extension: mu3_io_init() only loads the config and returns; the
+   device is opened by a background worker, and until then all buttons read
+   as released and the lever as centered (keyboard input works right away).
+
+   Wait up to timeout_ms for the device. Returns S_OK once it is connected
+   (hub client: once the owner process delivered input), S_FALSE on timeout
+   or before mu3_io_init(). */
+
+MU3IO_API HRESULT mu3_io_wait_ready(uint32_t timeout_ms);
+
+HRESULT hid_write_data(const char* dat, size_t length);
+/* Are SP_LED_STREAM chunks still waiting in the output queue? */
+bool hid_led_stream_queued(void);
\ No newline at end of file
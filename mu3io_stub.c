@@ -0,0 +1,82 @@
+#ifndef MU3IO_EXPORTS
+#define MU3IO_EXPORTS
+#endif
+
+#include <windows.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "util/dprintf.h"
+
+#include "mu3io.h"
+
+// The MU3 IO API without a device: every entry point logs its call and
+// reports no input, so the game and the hook chain can be brought up on a
+// machine without the board. Built as build/mu3io_stub.dll by `make dll-stub`.
+
+uint16_t mu3_io_get_api_version(void) {
+  return 0x0101;
+}
+
+HRESULT mu3_io_init(void) {
+  dprintf("SimGEKI: MU3 IO Init (stub, no device).\n");
+  return S_OK;
+}
+
+HRESULT mu3_io_poll(void) {
+  dprintf("SimGEKI: MU3 IO Poll.\n");
+  return S_OK;
+}
+
+void mu3_io_get_opbtns(uint8_t* opbtn) {
+  dprintf("SimGEKI: MU3 IO Get Operator Buttons.\n");
+  if (opbtn != NULL) {
+    *opbtn = 0;
+  }
+}
+
+void mu3_io_get_gamebtns(uint8_t* left, uint8_t* right) {
+  dprintf("SimGEKI: MU3 IO Get Game Buttons.\n");
+  if (left != NULL) {
+    *left = 0;
+  }
+  if (right != NULL) {
+    *right = 0;
+  }
+}
+
+void mu3_io_get_lever(int16_t* pos) {
+  dprintf("SimGEKI: MU3 IO Get Lever.\n");
+  if (pos != NULL) {
+    *pos = 0;
+  }
+}
+
+HRESULT mu3_io_led_init(void) {
+  dprintf("SimGEKI: MU3 IO LED Init.\n");
+  return S_OK;
+}
+
+void mu3_io_led_set_colors(uint8_t board, uint8_t* rgb) {
+  (void)rgb;
+  dprintf("SimGEKI: MU3 IO LED Set Colors, board %u.\n", board);
+}
+
+HRESULT mu3_io_get_stats(mu3_io_stats_t* stats) {
+  if (stats == NULL) {
+    return E_POINTER;
+  }
+
+  memset(stats, 0, sizeof(*stats));
+  return S_OK;
+}
+
+void mu3_io_dump_stats(void) {
+  dprintf("SimGEKI: No statistics without a device.\n");
+}
+
+HRESULT mu3_io_wait_ready(uint32_t timeout_ms) {
+  (void)timeout_ms;
+  return S_OK;
+}
@@ -0,0 +1,938 @@
+#include "config.h"
+#include "decode.h"
+#include "input.h"
+#include "led.h"
+#include "mu3io.h"
+#include "report.h"
+#include "session.h"
+#include "stats.h"
+#include "trace.h"
+#include "tracepoint.h"
+#include "transport.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Host-native test and benchmark of the report pipeline (transport ->
+   report_drain -> decode -> input ring -> poll fold) and the LED pacing, on
+   top of the loopback transport. With "--hidraw /dev/hidrawN [seconds]" the
+   same pipeline reads a real controller instead. */
+
+#define BENCH_REPORTS 2000000
+#define BENCH_LED_FRAMES 200000
+
+MU3IO_CONFIG cfg = {
+    .led_max_rate = 0,
+};
+
+// Where led.c sends its frames
+static transport_t* led_transport = NULL;
+// The last reports written, for the LED stream test
+#define CAPTURE_REPORTS 8
+static HidconfigData captured[CAPTURE_REPORTS];
+static int captured_count = 0;
+// Pretend streamed chunks are still waiting in the output queue
+static bool led_stream_queued = false;
+// Fail every write after this many succeeded (-1: never)
+static int writes_left = -1;
+
+bool hid_led_stream_queued(void) {
+  return led_stream_queued;
+}
+
+HRESULT hid_write_data(const char* dat, size_t length) {
+  if (led_transport == NULL) {
+    return S_FALSE;
+  }
+  if (writes_left == 0) {
+    return E_FAIL;
+  }
+  if (writes_left > 0) {
+    writes_left--;
+  }
+  if (transport_write(led_transport, (const uint8_t*)dat, length, 1000) !=
+      TRANSPORT_OK) {
+    return E_FAIL;
+  }
+  if (captured_count < CAPTURE_REPORTS && length == sizeof(HidconfigData)) {
+    memcpy(&captured[captured_count++], dat, length);
+  }
+  // Written synchronously: the output worker's completion is now
+  led_on_written((const uint8_t*)dat, length, stats_now());
+  return S_OK;
+}
+
+void print_separator(const char* title) {
+  printf("\n========== %s ==========\n", title);
+}
+
+static double now_ns(void) {
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  return (double)now.QuadPart;
+}
+
+static void make_input_report(HidconfigData* data,
+                              uint16_t input_status,
+                              uint16_t roller) {
+  memset(data, 0, sizeof(*data));
+  data->reportID = HIDCONFIG_REPORT_ID;
+  data->command = SP_INPUT_GET;
+  data->roller_value_sp = roller;
+  data->input_status = input_status;
+}
+
+static bool test_pipeline(void) {
+  print_separator("Pipeline Test");
+
+  transport_t dev = {.ops = &transport_loopback_ops};
+  HidconfigData data;
+  bool ok = true;
+
+  transport_open(&dev, NULL);
+  transport_read_start(&dev);
+
+  // Acknowledge of the start request switches to streaming
+  memset(&data, 0, sizeof(data));
+  data.reportID = HIDCONFIG_REPORT_ID;
+  data.command = SP_INPUT_GET_START;
+  transport_loopback_inject(&dev, &data, sizeof(data));
+
+  // A tap of L1 that is released again before the poll, then lever right
+  make_input_report(&data, BT_L_A, 0x8000);
+  transport_loopback_inject(&dev, &data, sizeof(data));
+  make_input_report(&data, 0, 0x9000);
+  transport_loopback_inject(&dev, &data, sizeof(data));
+
+  if (report_drain(&dev) != TRANSPORT_OK) {
+    printf("report_drain failed\n");
+    ok = false;
+  }
+  if (!session_streaming()) {
+    printf("Start acknowledge not seen\n");
+    ok = false;
+  }
+
+  input_snapshot_t polled = input_fold_pending();
+  uint8_t left = SNAPSHOT_LEFT(polled);
+  if ((left & MU3_IO_GAMEBTN_1) == 0) {
+    printf("Tap between two polls was lost (left %02X)\n", left);
+    ok = false;
+  }
+  if (SNAPSHOT_LEVER(polled) != 0x1000) {
+    printf("Lever: expected 0x1000, got %04X\n",
+           (unsigned)(uint16_t)SNAPSHOT_LEVER(polled));
+    ok = false;
+  }
+
+  // Nothing new: the tap must not be reported twice
+  polled = input_fold_pending();
+  if (SNAPSHOT_LEFT(polled) & MU3_IO_GAMEBTN_1) {
+    printf("Tap reported twice\n");
+    ok = false;
+  }
+  stats_end_poll();
+
+  // Input followed by an LED echo and an acknowledge in the same poll: the
+  // control packets are handled and the input still applies
+  mu3_io_stats_t before, after;
+  stats_get(&before);
+  make_input_report(&data, BT_R_A, 0x7000);
+  transport_loopback_inject(&dev, &data, sizeof(data));
+  memset(&data, 0, sizeof(data));
+  data.reportID = HIDCONFIG_REPORT_ID;
+  data.command = SP_LED_SET;
+  transport_loopback_inject(&dev, &data, sizeof(data));
+  data.command = SP_INPUT_GET_START;
+  transport_loopback_inject(&dev, &data, sizeof(data));
+  report_drain(&dev);
+  polled = input_fold_pending();
+  stats_end_poll();
+  stats_get(&after);
+  if ((SNAPSHOT_RIGHT(polled) & MU3_IO_GAMEBTN_1) == 0 ||
+      SNAPSHOT_LEVER(polled) != -0x1000) {
+    printf("Input before control packets lost (right %02X, lever %04X)\n",
+           SNAPSHOT_RIGHT(polled), (unsigned)(uint16_t)SNAPSHOT_LEVER(polled));
+    ok = false;
+  }
+  const mu3_io_report_counts_t* b = &before.reports;
+  const mu3_io_report_counts_t* a = &after.reports;
+  if (a->polls != b->polls + 1 ||
+      a->total[MU3_IO_REPORT_INPUT] != b->total[MU3_IO_REPORT_INPUT] + 1 ||
+      a->total[MU3_IO_REPORT_LED] != b->total[MU3_IO_REPORT_LED] + 1 ||
+      a->total[MU3_IO_REPORT_START] != b->total[MU3_IO_REPORT_START] + 1) {
+    printf("Report counters off: input %u, LED %u, start %u in %u polls\n",
+           a->total[MU3_IO_REPORT_INPUT], a->total[MU3_IO_REPORT_LED],
+           a->total[MU3_IO_REPORT_START], a->polls);
+    ok = false;
+  }
+
+  session_disconnected();
+  transport_close(&dev);
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+static int session_sends = 0;
+
+static void count_start(void) {
+  session_sends++;
+}
+
+static bool expect_session(const char* step,
+                           session_state_t state,
+                           int sends) {
+  if (session_state() == state && session_sends == sends) {
+    return true;
+  }
+  printf("%s: expected %s after %d starts, got %s after %d\n", step,
+         session_state_name(state), sends, session_state_name(session_state()),
+         session_sends);
+  return false;
+}
+
+static bool test_session(void) {
+  print_separator("Session Test");
+
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  LONGLONG ms = freq.QuadPart / 1000;
+  LONGLONG t0 = 1000 * ms;
+  bool ok = true;
+
+  session_sends = 0;
+  session_init(count_start, 250);
+  session_connected(t0);
+  ok = expect_session("connected", SESSION_IDLE, 0) && ok;
+
+  // Unanswered starts are re-sent after 20, 40, 80 ms...
+  session_tick(t0);
+  ok = expect_session("first tick", SESSION_START_SENT, 1) && ok;
+  session_tick(t0 + 10 * ms);
+  ok = expect_session("before retry", SESSION_START_SENT, 1) && ok;
+  session_tick(t0 + 20 * ms);
+  ok = expect_session("first retry", SESSION_START_SENT, 2) && ok;
+  session_tick(t0 + 50 * ms);
+  ok = expect_session("backed off", SESSION_START_SENT, 2) && ok;
+  session_tick(t0 + 60 * ms);
+  ok = expect_session("second retry", SESSION_START_SENT, 3) && ok;
+
+  // ...until reports flow, even without an acknowledge
+  session_on_input(t0 + 70 * ms);
+  ok = expect_session("first input", SESSION_STREAMING, 3) && ok;
+  if (session_first_input_us() != 70000) {
+    printf("First input after %lld us, expected 70000\n",
+           (long long)session_first_input_us());
+    ok = false;
+  }
+
+  // A device that goes silent without SP_INPUT_GET_END is restarted
+  session_tick(t0 + 300 * ms);
+  ok = expect_session("short gap", SESSION_STREAMING, 3) && ok;
+  session_tick(t0 + 330 * ms);
+  ok = expect_session("long gap", SESSION_STALE, 4) && ok;
+  session_tick(t0 + 340 * ms);
+  ok = expect_session("stale retry", SESSION_STALE, 4) && ok;
+  session_on_start_ack(t0 + 345 * ms);
+  ok = expect_session("restarted", SESSION_STREAMING, 4) && ok;
+
+  // A deliberate stop is answered with a new start
+  session_on_end(t0 + 350 * ms);
+  session_tick(t0 + 350 * ms);
+  ok = expect_session("after end", SESSION_START_SENT, 5) && ok;
+
+  // Retries settle at the maximum interval
+  LONGLONG now = t0 + 350 * ms;
+  for (int i = 0; i < 20; i++) {
+    uint32_t wait = session_tick(now);
+    if (wait > SESSION_RETRY_MAX_MS) {
+      printf("Retry interval %u ms above the maximum\n", wait);
+      ok = false;
+    }
+    now += wait * ms;
+  }
+  if (session_sends < 15) {
+    printf("Only %d starts sent while retrying\n", session_sends);
+    ok = false;
+  }
+
+  session_disconnected();
+  ok = expect_session("disconnected", SESSION_IDLE, session_sends) && ok;
+
+  session_init(NULL, SESSION_GAP_MS);
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+static bool test_trace(void) {
+  print_separator("Trace Test");
+
+  const char* path = "pipeline_test.trace";
+  trace_reader_t reader;
+  trace_record_t record;
+  HidconfigData data;
+  bool ok = true;
+
+  if (trace_open(path) != S_OK) {
+    printf("Failed to create %s\n", path);
+    return false;
+  }
+  for (int i = 0; i < 3; i++) {
+    make_input_report(&data, (uint16_t)(BT_L_A << i), (uint16_t)(0x8000 + i));
+    trace_report(i == 1 ? TRACE_OUT : TRACE_IN, 1000 + i, &data,
+                 sizeof(data));
+  }
+  trace_close();
+  // Not recording any more
+  trace_report(TRACE_IN, 2000, &data, sizeof(data));
+
+  if (trace_reader_open(&reader, path) != S_OK) {
+    printf("Failed to reopen %s\n", path);
+    remove(path);
+    return false;
+  }
+  int count = 0;
+  while (trace_reader_next(&reader, &record)) {
+    make_input_report(&data, (uint16_t)(BT_L_A << count),
+                      (uint16_t)(0x8000 + count));
+    if (record.qpc != 1000 + count ||
+        record.direction != (count == 1 ? TRACE_OUT : TRACE_IN) ||
+        record.length != sizeof(data) ||
+        memcmp(record.data, &data, sizeof(data)) != 0) {
+      printf("Record %d does not match\n", count);
+      ok = false;
+    }
+    count++;
+  }
+  if (count != 3) {
+    printf("Expected 3 records, read %d\n", count);
+    ok = false;
+  }
+  trace_reader_close(&reader);
+  remove(path);
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+static bool test_tracepoints(void) {
+  print_separator("Trace Point Test");
+
+  const char* path = "pipeline_test.tpt.trace";
+  transport_t dev = {.ops = &transport_loopback_ops};
+  HidconfigData data;
+  tp_record_t records[64];
+  tp_reader_t reader;
+  tp_record_t record;
+  bool ok = true;
+
+  if (tp_parse_mask("report, Decode,drain") !=
+          (1u << TP_REPORT | 1u << TP_DECODE | 1u << TP_DRAIN) ||
+      tp_parse_mask("all") != TP_ALL || tp_parse_mask("0x3") != 3) {
+    printf("Event list parsed wrong\n");
+    ok = false;
+  }
+
+  // Off: nothing is recorded
+  TP(TP_POLL, 1, 2, 3);
+  if (tp_snapshot(records, 64) != 0) {
+    printf("Recorded while off\n");
+    ok = false;
+  }
+
+  tp_start(1u << TP_REPORT | 1u << TP_DECODE | 1u << TP_DRAIN, 64);
+  transport_open(&dev, NULL);
+  transport_read_start(&dev);
+  for (int i = 0; i < 3; i++) {
+    make_input_report(&data, 0, (uint16_t)(0x8000 + i));
+    transport_loopback_inject(&dev, &data, sizeof(data));
+  }
+  report_drain(&dev);
+  transport_close(&dev);
+  TP(TP_POLL, 0, 0, 0);  // Not selected
+
+  // Each report is seen, then decoded; the drain pass comes last
+  size_t count = tp_snapshot(records, 64);
+  if (count != 7 || records[6].event != TP_DRAIN || records[6].a != 3) {
+    printf("Expected 3 report/decode pairs and a drain of 3, got %zu\n",
+           count);
+    ok = false;
+  } else {
+    for (int i = 0; i < 3; i++) {
+      if (records[i * 2].event != TP_REPORT ||
+          records[i * 2].a != (HIDCONFIG_REPORT_ID << 8 | SP_INPUT_GET) ||
+          records[i * 2 + 1].event != TP_DECODE ||
+          records[i * 2 + 1].b != 0x8000u + i ||
+          records[i * 2 + 1].qpc < records[i * 2].qpc) {
+        printf("Record pair %d does not match\n", i);
+        ok = false;
+      }
+    }
+  }
+
+  // Overwritten: only the newest 64 are left, in order
+  for (uint32_t i = 0; i < 100; i++) {
+    TP(TP_DRAIN, i, 0, 0);
+  }
+  count = tp_snapshot(records, 64);
+  if (count != 64 || records[0].a != 36 || records[63].a != 99) {
+    printf("Wrapped ring holds %zu records, %u..%u\n", count,
+           (unsigned)records[0].a, (unsigned)records[count - 1].a);
+    ok = false;
+  }
+  tp_stop();
+
+  // Dump round trip
+  if (tp_dump(path) != S_OK || tp_reader_open(&reader, path) != S_OK) {
+    printf("Failed to dump to %s\n", path);
+    remove(path);
+    return false;
+  }
+  uint32_t read = 0;
+  while (tp_reader_next(&reader, &record)) {
+    if (read < 64 && memcmp(&record, &records[read], sizeof(record)) != 0) {
+      printf("Dumped record %u does not match\n", (unsigned)read);
+      ok = false;
+    }
+    read++;
+  }
+  if (read != 64 || reader.count != 64) {
+    printf("Dump holds %u records, header says %u\n", (unsigned)read,
+           (unsigned)reader.count);
+    ok = false;
+  }
+  tp_reader_close(&reader);
+  remove(path);
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+// Input reports seen by the decode hook, in order
+#define HOOK_REPORTS 64
+static int16_t hook_levers[HOOK_REPORTS];
+static double hook_ns[HOOK_REPORTS];
+static int hook_count = 0;
+
+static void record_input(input_snapshot_t state,
+                         uint32_t pressed,
+                         LONGLONG qpc) {
+  (void)pressed;
+  (void)qpc;
+  if (hook_count < HOOK_REPORTS) {
+    hook_levers[hook_count] = SNAPSHOT_LEVER(state);
+    hook_ns[hook_count] = now_ns();
+  }
+  hook_count++;
+}
+
+// Every read depth hands the reports over once each and in order, also when
+// a burst does not fill the last batch
+static bool test_read_depth(void) {
+  print_separator("Read Depth Test");
+
+  static const uint8_t depths[] = {1, 3, 4, TRANSPORT_MAX_READS};
+  HidconfigData data;
+  bool ok = true;
+
+  report_set_input_hook(record_input);
+  for (size_t d = 0; d < sizeof(depths); d++) {
+    transport_t dev = {.ops = &transport_loopback_ops};
+    dev.read_depth = depths[d];
+    transport_open(&dev, NULL);
+    transport_read_start(&dev);
+
+    hook_count = 0;
+    int sent = 0;
+    for (int burst = 1; burst <= 9; burst += 4) {
+      for (int i = 0; i < burst; i++, sent++) {
+        make_input_report(&data, 0, (uint16_t)(0x8000 + sent));
+        transport_loopback_inject(&dev, &data, sizeof(data));
+      }
+      if (report_drain(&dev) != TRANSPORT_OK) {
+        ok = false;
+      }
+    }
+
+    bool in_order = hook_count == sent;
+    for (int i = 0; in_order && i < sent; i++) {
+      in_order = hook_levers[i] == i;
+    }
+    if (!in_order) {
+      printf("Depth %u: %d of %d reports, out of order or repeated\n",
+             (unsigned)depths[d], hook_count, sent);
+      ok = false;
+    }
+    input_fold_pending();
+    stats_end_poll();
+    transport_close(&dev);
+  }
+  report_set_input_hook(NULL);
+
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+// What a 60 Hz poll finds queued: the reports of one frame at 1 kHz, and at
+// 8 kHz as many as the HID driver keeps (32 input buffers by default)
+#define BENCH_POLL_HZ 60
+#define BENCH_DRIVER_REPORTS 32
+#define BENCH_DRAINS 500
+// Issuing one ReadFile, emulated on the loopback (an assumption, not a
+// measurement of a real device)
+#define BENCH_READ_COST_NS 5000
+
+// Age of the reports when a poll drains them, from the start of the drain
+// to each report being handed over and decoded
+static void bench_read_depth(void) {
+  print_separator("Read Depth Benchmark (emulated)");
+
+  static const uint32_t rates[] = {1000, 8000};
+  static const uint8_t depths[] = {1, 4, TRANSPORT_MAX_READS};
+  HidconfigData data;
+
+  printf("ReadFile cost emulated at %.1f us per read, %d drains each\n",
+         BENCH_READ_COST_NS / 1000.0, BENCH_DRAINS);
+  report_set_input_hook(record_input);
+  for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+    int burst = (int)(rates[r] / BENCH_POLL_HZ);
+    if (burst > BENCH_DRIVER_REPORTS) {
+      burst = BENCH_DRIVER_REPORTS;
+    }
+
+    for (size_t d = 0; d < sizeof(depths); d++) {
+      transport_t dev = {.ops = &transport_loopback_ops};
+      double newest = 0, mean = 0;
+
+      dev.read_depth = depths[d];
+      transport_open(&dev, NULL);
+      transport_loopback_set_read_cost(&dev, BENCH_READ_COST_NS);
+      transport_read_start(&dev);
+
+      for (int n = 0; n < BENCH_DRAINS; n++) {
+        for (int i = 0; i < burst; i++) {
+          make_input_report(&data, 0, (uint16_t)(0x8000 + i));
+          transport_loopback_inject(&dev, &data, sizeof(data));
+        }
+        hook_count = 0;
+        double start = now_ns();
+        report_drain(&dev);
+        input_fold_pending();
+        stats_end_poll();
+
+        newest += hook_ns[burst - 1] - start;
+        for (int i = 0; i < burst; i++) {
+          mean += (hook_ns[i] - start) / burst;
+        }
+      }
+
+      printf("%4u Hz, %2d reports/poll, %2u reads: newest %6.1f us, "
+             "mean %6.1f us\n",
+             (unsigned)rates[r], burst, (unsigned)depths[d],
+             newest / BENCH_DRAINS / 1000.0, mean / BENCH_DRAINS / 1000.0);
+      transport_close(&dev);
+    }
+  }
+  report_set_input_hook(NULL);
+}
+
+// Cost of a trace point while its event is off and on
+static void bench_tracepoints(void) {
+  print_separator("Trace Point Benchmark");
+
+  const int points = 10000000;
+  double start = now_ns();
+  for (int i = 0; i < points; i++) {
+    TP(TP_POLL, i, 0, 0);
+  }
+  double off = (now_ns() - start) / points;
+
+  tp_start(TP_ALL, TP_DEFAULT_RECORDS);
+  start = now_ns();
+  for (int i = 0; i < points; i++) {
+    TP(TP_POLL, i, 0, 0);
+  }
+  double on = (now_ns() - start) / points;
+  tp_stop();
+
+  printf("Off: %.2f ns/point, on: %.1f ns/point\n", off, on);
+}
+
+// Reports per poll: an 8 kHz device read by a 1 kHz poll loop
+#define BENCH_BATCH 8
+
+static void bench_pipeline(bool traced) {
+  print_separator(traced ? "Pipeline Benchmark (all trace points on)"
+                         : "Pipeline Benchmark");
+
+  transport_t dev = {.ops = &transport_loopback_ops};
+  HidconfigData data, echo;
+  uint32_t lfsr = 0xACE1u;
+  volatile input_snapshot_t sink = 0;
+  double inject_ns = 0;
+
+  memset(&echo, 0, sizeof(echo));
+  echo.reportID = HIDCONFIG_REPORT_ID;
+  echo.command = SP_LED_SET;
+
+  transport_open(&dev, NULL);
+  transport_read_start(&dev);
+  if (traced) {
+    tp_start(TP_ALL, TP_DEFAULT_RECORDS);
+  }
+
+  double start = now_ns();
+  for (int i = 0; i < BENCH_REPORTS; i += BENCH_BATCH) {
+    double batch_start = now_ns();
+    for (int j = 0; j < BENCH_BATCH; j++) {
+      lfsr = lfsr * 1103515245u + 12345u;
+      make_input_report(&data, (uint16_t)(lfsr >> 16), (uint16_t)lfsr);
+      transport_loopback_inject(&dev, &data, sizeof(data));
+    }
+    // The LED frame of every game frame is echoed after the inputs
+    transport_loopback_inject(&dev, &echo, sizeof(echo));
+    inject_ns += now_ns() - batch_start;
+
+    report_drain(&dev);
+    sink = input_fold_pending();
+    stats_end_poll();
+  }
+  double elapsed = now_ns() - start - inject_ns;
+  (void)sink;
+  tp_stop();
+
+  printf("%d reports, %d per poll + LED echo: %.1f ns/report, %.1f ns/poll\n",
+         BENCH_REPORTS, BENCH_BATCH, elapsed / BENCH_REPORTS,
+         elapsed * BENCH_BATCH / BENCH_REPORTS);
+  printf("Ring overflows: %u\n", input_dropped_events());
+  transport_close(&dev);
+}
+
+static void bench_led(void) {
+  print_separator("LED Benchmark");
+
+  transport_t dev = {.ops = &transport_loopback_ops};
+  HidconfigData frame;
+  led_stats_t stats;
+  uint64_t reports = 0, bytes = 0;
+
+  transport_open(&dev, NULL);
+  led_transport = &dev;
+  led_init();
+
+  memset(&frame, 0, sizeof(frame));
+  frame.reportID = HIDCONFIG_REPORT_ID;
+  frame.command = SP_LED_SET;
+
+  // Every fourth frame repeats the previous one, like an idle attract screen
+  double start = now_ns();
+  for (int i = 0; i < BENCH_LED_FRAMES; i++) {
+    if (i % 4 != 0) {
+      frame.led_rgb_left[i % 6][i % 3] = (uint8_t)i;
+    }
+    led_submit(0, &frame);
+  }
+  double elapsed = now_ns() - start;
+
+  led_get_stats(&stats);
+  transport_loopback_written(&dev, &reports, &bytes);
+  printf("%d frames in %.1f ms: %.1f ns/frame\n", BENCH_LED_FRAMES,
+         elapsed / 1e6, elapsed / BENCH_LED_FRAMES);
+  printf("Sent %ld, unchanged %ld, %llu bytes written\n", (long)stats.sent,
+         (long)stats.unchanged, (unsigned long long)bytes);
+
+  led_transport = NULL;
+  transport_close(&dev);
+}
+
+static void fill_led_frame(uint8_t* rgb, int frame) {
+  for (int led = 0; led < LED_STREAM_LEDS; led++) {
+    uint8_t* c = &rgb[led * 3];
+    if (led >= 25 && led <= 35) {
+      // Billboard: a pattern scrolling every frame
+      c[0] = (uint8_t)((led + frame) * 23);
+      c[1] = (uint8_t)((led + frame) * 7);
+      c[2] = 0x40;
+    } else if (led >= 2 && led <= 58) {
+      // Pillars: a slow pulse, new color every fourth frame
+      c[0] = c[1] = c[2] = (uint8_t)(frame / 4 * 16);
+    } else {
+      // Side buttons: steady
+      c[0] = 0xFF;
+      c[1] = 0x80;
+      c[2] = 0x00;
+    }
+  }
+}
+
+static bool expect_chunks(const char* step, int count, uint8_t last_offset) {
+  if (captured_count != count) {
+    printf("%s: expected %d chunks, got %d\n", step, count, captured_count);
+    return false;
+  }
+  for (int i = 0; i < count; i++) {
+    const HidconfigData* c = &captured[i];
+    bool last = i == count - 1;
+    if (c->command != SP_LED_STREAM ||
+        ((c->stream_flags & LED_STREAM_COMMIT) != 0) != last ||
+        c->stream_seq != captured[0].stream_seq) {
+      printf("%s: chunk %d malformed\n", step, i);
+      return false;
+    }
+  }
+  if (count > 0 && captured[count - 1].stream_offset != last_offset) {
+    printf("%s: last chunk at LED %u, expected %u\n", step,
+           captured[count - 1].stream_offset, last_offset);
+    return false;
+  }
+  return true;
+}
+
+static bool test_led_stream(void) {
+  print_separator("LED Stream Test");
+
+  transport_t dev = {.ops = &transport_loopback_ops};
+  uint8_t rgb[LED_STREAM_LEDS * 3];
+  bool ok = true;
+
+  transport_open(&dev, NULL);
+  led_transport = &dev;
+  led_init();
+
+  // First frame: every chunk, the last one commits
+  fill_led_frame(rgb, 0);
+  captured_count = 0;
+  led_submit_stream(rgb, LED_STREAM_LEDS);
+  ok = expect_chunks("first frame", LED_STREAM_CHUNKS,
+                     (LED_STREAM_CHUNKS - 1) * LED_STREAM_CHUNK_LEDS) &&
+       ok;
+  if (ok && (captured[3].stream_count != LED_STREAM_LEDS - 48 ||
+             memcmp(captured[3].led_stream, &rgb[48 * 3],
+                    (LED_STREAM_LEDS - 48) * 3) != 0)) {
+    printf("Last chunk does not carry LEDs 48-60\n");
+    ok = false;
+  }
+  uint8_t first_seq = captured[0].stream_seq;
+
+  // One billboard LED: only its chunk, as a new frame
+  rgb[30 * 3] ^= 0xFF;
+  captured_count = 0;
+  led_submit_stream(rgb, LED_STREAM_LEDS);
+  ok = expect_chunks("one LED", 1, 16) && ok;
+  if (captured_count == 1 &&
+      (captured[0].stream_seq != (uint8_t)(first_seq + 1) ||
+       captured[0].led_stream[30 - 16][0] != rgb[30 * 3])) {
+    printf("One LED: wrong sequence or color\n");
+    ok = false;
+  }
+
+  // Nothing changed: nothing sent
+  captured_count = 0;
+  led_submit_stream(rgb, LED_STREAM_LEDS);
+  ok = expect_chunks("unchanged", 0, 0) && ok;
+
+  // Both side buttons: first and last chunk
+  rgb[0] ^= 0xFF;
+  rgb[60 * 3] ^= 0xFF;
+  captured_count = 0;
+  led_submit_stream(rgb, LED_STREAM_LEDS);
+  ok = expect_chunks("side buttons", 2, 48) && ok;
+
+  // After a reconnect the device needs everything again
+  captured_count = 0;
+  led_resync();
+  ok = expect_chunks("resync", LED_STREAM_CHUNKS, 48) && ok;
+  HidconfigData commit = captured[LED_STREAM_CHUNKS - 1];
+
+  // Frames submitted while that one still waits in the output queue are held
+  // back, and only the newest goes out whole once it is written
+  led_stream_queued = true;
+  rgb[40 * 3] ^= 0xFF;
+  captured_count = 0;
+  led_submit_stream(rgb, LED_STREAM_LEDS);
+  rgb[5 * 3] ^= 0xFF;
+  led_submit_stream(rgb, LED_STREAM_LEDS);
+  ok = expect_chunks("queued", 0, 0) && ok;
+  led_stream_queued = false;
+  led_on_written((const uint8_t*)&commit, sizeof(commit), stats_now());
+  ok = expect_chunks("after queued", 2, 32) && ok;
+  if (captured_count == 2 &&
+      (captured[0].stream_seq != (uint8_t)(commit.stream_seq + 1) ||
+       captured[0].led_stream[5][0] != rgb[5 * 3] ||
+       captured[1].led_stream[40 - 32][0] != rgb[40 * 3])) {
+    printf("After queued: wrong sequence or colors\n");
+    ok = false;
+  }
+
+  // A frame cut short leaves chunks without a commit: the next one must not
+  // commit them, so it goes out whole under a newer sequence number
+  rgb[2 * 3] ^= 0xFF;
+  rgb[50 * 3] ^= 0xFF;
+  captured_count = 0;
+  writes_left = 1;
+  led_submit_stream(rgb, LED_STREAM_LEDS);
+  writes_left = -1;
+  if (captured_count != 1 ||
+      (captured[0].stream_flags & LED_STREAM_COMMIT) != 0) {
+    printf("Cut short: expected one chunk without commit\n");
+    ok = false;
+  }
+  uint8_t cut_seq = captured[0].stream_seq;
+  captured_count = 0;
+  led_submit_stream(rgb, LED_STREAM_LEDS);
+  ok = expect_chunks("after cut short", LED_STREAM_CHUNKS, 48) && ok;
+  if (captured_count > 0 &&
+      captured[0].stream_seq != (uint8_t)(cut_seq + 1)) {
+    printf("After cut short: sequence number reused\n");
+    ok = false;
+  }
+
+  led_transport = NULL;
+  transport_close(&dev);
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return ok;
+}
+
+// A typical attract screen: 60 frames per second for 10 minutes
+#define BENCH_STREAM_FPS 60
+#define BENCH_STREAM_FRAMES (BENCH_STREAM_FPS * 600)
+
+static void bench_led_stream(void) {
+  print_separator("LED Stream Benchmark");
+
+  transport_t dev = {.ops = &transport_loopback_ops};
+  uint8_t rgb[LED_STREAM_LEDS * 3];
+  led_stats_t before, after;
+  mu3_io_stats_t latency;
+  uint64_t reports = 0, bytes = 0;
+
+  transport_open(&dev, NULL);
+  led_transport = &dev;
+  led_init();
+  led_get_stats(&before);
+
+  double elapsed = 0;
+  for (int i = 0; i < BENCH_STREAM_FRAMES; i++) {
+    fill_led_frame(rgb, i);
+    double start = now_ns();
+    led_submit_stream(rgb, LED_STREAM_LEDS);
+    elapsed += now_ns() - start;
+  }
+
+  led_get_stats(&after);
+  stats_get(&latency);
+  transport_loopback_written(&dev, &reports, &bytes);
+  double seconds = (double)BENCH_STREAM_FRAMES / BENCH_STREAM_FPS;
+  long chunks = after.chunks - before.chunks;
+  long skipped = after.chunks_unchanged - before.chunks_unchanged;
+  double per_second = (double)(after.bytes - before.bytes) / seconds;
+
+  printf("%d frames: %.1f ns/frame, %.2f of %d chunks sent per frame\n",
+         BENCH_STREAM_FRAMES, elapsed / BENCH_STREAM_FRAMES,
+         (double)chunks / BENCH_STREAM_FRAMES, LED_STREAM_CHUNKS);
+  printf("Chunks skipped unchanged: %ld (%.0f%%)\n", skipped,
+         100.0 * skipped / (chunks + skipped));
+  // A full-speed interrupt OUT endpoint moves one 64-byte report per ms,
+  // on its own pipe next to the 1 kHz input reports
+  printf("At %d fps: %.0f bytes/s, %.1f%% of a 1 kHz 64-byte OUT endpoint\n",
+         BENCH_STREAM_FPS, per_second, 100.0 * per_second / 64000.0);
+  if (latency.led_frame.count > 0) {
+    printf("Frame completion (submit -> commit written): avg %lu us, max "
+           "%lu us\n",
+           (unsigned long)(latency.led_frame.total_us /
+                           latency.led_frame.count),
+           (unsigned long)latency.led_frame.max_us);
+  }
+
+  led_transport = NULL;
+  transport_close(&dev);
+}
+
+#ifdef __linux__
+static transport_t* hidraw_transport = NULL;
+
+static void hidraw_send_start(void) {
+  HidconfigData start_req;
+  memset(&start_req, 0, sizeof(start_req));
+  start_req.reportID = HIDCONFIG_REPORT_ID;
+  start_req.symbol = 0x01;
+  start_req.command = SP_INPUT_GET_START;
+  transport_write(hidraw_transport, (const uint8_t*)&start_req,
+                  sizeof(start_req), 1000);
+}
+
+static int run_hidraw(const char* path, int seconds) {
+  print_separator("hidraw");
+
+  transport_t dev = {.ops = &transport_hidraw_ops};
+  if (transport_open(&dev, path) != TRANSPORT_OK) {
+    printf("Failed to open %s: errno %lu\n", path,
+           (unsigned long)dev.last_error);
+    return 1;
+  }
+  transport_read_start(&dev);
+  hidraw_transport = &dev;
+  session_init(hidraw_send_start, SESSION_GAP_MS);
+  session_connected(stats_now());
+
+  // Poll at ~1 kHz like a game thread would
+  for (int i = 0; i < seconds * 1000; i++) {
+    session_tick(stats_now());
+    if (report_drain(&dev) == TRANSPORT_DISCONNECTED) {
+      printf("Device disconnected\n");
+      break;
+    }
+    input_snapshot_t polled = input_fold_pending();
+    if (i % 1000 == 0) {
+      printf("buttons %06X lever %6d\n", (unsigned)SNAPSHOT_BUTTONS(polled),
+             SNAPSHOT_LEVER(polled));
+    }
+    Sleep(1);
+  }
+
+  transport_close(&dev);
+  fflush(stdout);
+  stats_dump();
+  return 0;
+}
+#endif  // __linux__
+
+int main(int argc, char** argv) {
+  printf("========================================\n");
+  printf("      SimGEKI report pipeline test\n");
+  printf("========================================\n");
+
+  stats_init();
+  decode_init();
+
+#ifdef __linux__
+  if (argc >= 3 && strcmp(argv[1], "--hidraw") == 0) {
+    return run_hidraw(argv[2], argc >= 4 ? atoi(argv[3]) : 10);
+  }
+#else
+  (void)argc;
+  (void)argv;
+#endif
+
+  bool ok = test_pipeline();
+  ok = test_session() && ok;
+  ok = test_led_stream() && ok;
+  ok = test_trace() && ok;
+  ok = test_tracepoints() && ok;
+  ok = test_read_depth() && ok;
+  bench_pipeline(false);
+  bench_pipeline(true);
+  bench_tracepoints();
+  bench_read_depth();
+  bench_led();
+  bench_led_stream();
+  // dprintf goes to stderr, keep the output in order
+  fflush(stdout);
+  stats_dump();
+
+  print_separator(ok ? "PASSED" : "FAILED");
+  return ok ? 0 : 1;
+}
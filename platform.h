@@ -0,0 +1,161 @@
+#pragma once
+
+/* The small slice of the Win32 API used by the portable modules (input,
+   stats, report, LED pacing, transports). On Windows this is just
+   <windows.h>; elsewhere it maps the same names onto C11-style GCC atomics,
+   clock_gettime and pthreads, so that the poll/decode/LED pipeline can be
+   built natively for host-side tests and benchmarks. */
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef int32_t BOOL;
+typedef uint8_t BYTE;
+typedef uint8_t BOOLEAN;
+typedef uint32_t DWORD;
+typedef uint32_t UINT;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef int64_t LONG64;
+typedef int64_t LONGLONG;
+typedef void* HANDLE;
+typedef void* PVOID;
+typedef int32_t HRESULT;
+
+typedef union {
+  LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+#define TRUE 1
+#define FALSE 0
+
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_FAIL ((HRESULT)0x80004005)
+#define E_POINTER ((HRESULT)0x80004003)
+#define E_INVALIDARG ((HRESULT)0x80070057)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000E)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+// errno values are small and positive, fold them like HRESULT_FROM_WIN32
+#define HRESULT_FROM_ERRNO(e) \
+  ((HRESULT)(((e) & 0x0000FFFF) | (7 << 16) | 0x80000000))
+
+static inline LONG InterlockedIncrement(volatile LONG* target) {
+  return __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedDecrement(volatile LONG* target) {
+  return __atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedExchange(volatile LONG* target, LONG value) {
+  return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedExchangeAdd(volatile LONG* target, LONG value) {
+  return __atomic_fetch_add(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedOr(volatile LONG* target, LONG value) {
+  return __atomic_fetch_or(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedCompareExchange(volatile LONG* target,
+                                              LONG value,
+                                              LONG comparand) {
+  __atomic_compare_exchange_n(target, &comparand, value, false,
+                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  return comparand;
+}
+
+static inline LONG64 InterlockedExchange64(volatile LONG64* target,
+                                           LONG64 value) {
+  return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG64 InterlockedExchangeAdd64(volatile LONG64* target,
+                                              LONG64 value) {
+  return __atomic_fetch_add(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG64 InterlockedCompareExchange64(volatile LONG64* target,
+                                                  LONG64 value,
+                                                  LONG64 comparand) {
+  __atomic_compare_exchange_n(target, &comparand, value, false,
+                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  return comparand;
+}
+
+static inline PVOID InterlockedExchangePointer(PVOID volatile* target,
+                                               PVOID value) {
+  return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline PVOID InterlockedCompareExchangePointer(PVOID volatile* target,
+                                                      PVOID value,
+                                                      PVOID comparand) {
+  __atomic_compare_exchange_n(target, &comparand, value, false,
+                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  return comparand;
+}
+
+#define MemoryBarrier() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+// QPC in nanoseconds from the monotonic clock
+static inline BOOL QueryPerformanceCounter(LARGE_INTEGER* count) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  count->QuadPart = (LONGLONG)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  return TRUE;
+}
+
+static inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* freq) {
+  freq->QuadPart = 1000000000LL;
+  return TRUE;
+}
+
+static inline void Sleep(DWORD ms) {
+  struct timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+  nanosleep(&ts, NULL);
+}
+
+// Distinct per thread, which is all the callers need
+static inline DWORD GetCurrentThreadId(void) {
+  uintptr_t self = (uintptr_t)pthread_self();
+  return (DWORD)((self >> 12) ^ (self >> 28));
+}
+
+typedef pthread_mutex_t CRITICAL_SECTION;
+
+// Recursive, like a Win32 critical section
+static inline void InitializeCriticalSection(CRITICAL_SECTION* cs) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(cs, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+static inline void DeleteCriticalSection(CRITICAL_SECTION* cs) {
+  pthread_mutex_destroy(cs);
+}
+
+static inline void EnterCriticalSection(CRITICAL_SECTION* cs) {
+  pthread_mutex_lock(cs);
+}
+
+static inline void LeaveCriticalSection(CRITICAL_SECTION* cs) {
+  pthread_mutex_unlock(cs);
+}
+
+#endif  // _WIN32
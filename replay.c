@@ -0,0 +1,218 @@
+#include "config.h"
+#include "decode.h"
+#include "input.h"
+#include "mu3io.h"
+#include "report.h"
+#include "stats.h"
+#include "trace.h"
+#include "transport.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Host-native replay of a HID report trace recorded with "trace =" in
+   simgeki_io.ini. The recorded input reports go through the same
+   decode -> lever filter -> input ring path as on the cabinet, stamped with
+   their recorded time, and a simulated game polls it at a fixed rate on the
+   trace's own clock, so the same trace always produces the same output:
+
+     replay trace.bin [--poll-hz N] [--realtime] [--filter]
+                                        one CSV line per poll, --filter
+                                        applies the default lever filter
+     replay trace.bin --bench [loops]   transport + decode throughput
+
+   Not reproduced: the coin anti-repeat of mu3_io_get_opbtns and keyboard
+   input, which live on the Windows side of mu3io.c. Written reports are
+   listed on stderr, they are not sent anywhere. */
+
+#define REPLAY_DEFAULT_POLL_HZ 1000
+#define REPLAY_DEFAULT_LOOPS 100
+
+MU3IO_CONFIG cfg;
+
+HRESULT hid_write_data(const char* dat, size_t length) {
+  (void)dat;
+  (void)length;
+  return S_FALSE;
+}
+
+bool hid_led_stream_queued(void) {
+  return false;
+}
+
+static void print_poll(LONGLONG t, LONGLONG freq) {
+  input_snapshot_t polled = input_fold_pending();
+  printf("%.3f,%02X,%02X,%02X,%d\n", (double)t * 1000.0 / (double)freq,
+         SNAPSHOT_OPBTN(polled), SNAPSHOT_LEFT(polled),
+         SNAPSHOT_RIGHT(polled), SNAPSHOT_LEVER(polled));
+}
+
+static int replay(const char* path, uint32_t poll_hz, bool realtime) {
+  trace_reader_t reader;
+  trace_record_t record;
+  LARGE_INTEGER host_freq;
+
+  if (trace_reader_open(&reader, path) != S_OK) {
+    fprintf(stderr, "Not a trace file: %s\n", path);
+    return 1;
+  }
+
+  QueryPerformanceFrequency(&host_freq);
+  LONGLONG freq = reader.qpc_freq;
+  LONGLONG poll_period = freq / poll_hz;
+  LONGLONG first = 0, next_poll = 0;
+  bool started = false;
+  LARGE_INTEGER wall_start;
+  QueryPerformanceCounter(&wall_start);
+
+  printf("time_ms,opbtn,left,right,lever\n");
+  while (trace_reader_next(&reader, &record)) {
+    if (!started) {
+      first = record.qpc;
+      next_poll = poll_period;
+      started = true;
+    }
+    LONGLONG t = record.qpc - first;
+
+    // Every poll that came due before this report sees what arrived so far
+    while (next_poll <= t) {
+      print_poll(next_poll, freq);
+      next_poll += poll_period;
+    }
+
+    if (realtime) {
+      // Keep the original spacing between reports (host clock in ns)
+      LARGE_INTEGER now;
+      LONGLONG due = (LONGLONG)((double)t * 1e9 / (double)freq);
+      for (;;) {
+        QueryPerformanceCounter(&now);
+        LONGLONG ahead = due - (now.QuadPart - wall_start.QuadPart);
+        if (ahead <= 0) {
+          break;
+        }
+        Sleep(ahead > 2000000 ? (DWORD)(ahead / 1000000) - 1 : 0);
+      }
+    }
+
+    if (record.direction == TRACE_OUT) {
+      fprintf(stderr, "out %.3f ms: command %02X\n",
+              (double)t * 1000.0 / (double)freq,
+              record.length > 1 ? record.data[1] : 0);
+      continue;
+    }
+    // Report time on the host clock, which the lever filter runs on
+    LONGLONG read_qpc =
+        (LONGLONG)((double)t * (double)host_freq.QuadPart / (double)freq);
+    hid_on_data_at((char*)record.data, record.length, read_qpc);
+  }
+
+  // Last poll after the end of the trace
+  print_poll(next_poll, freq);
+
+  trace_reader_close(&reader);
+  return 0;
+}
+
+static int bench(const char* path, int loops) {
+  trace_reader_t reader;
+  trace_record_t record;
+  transport_t dev = {.ops = &transport_loopback_ops};
+  uint64_t reports = 0;
+  double elapsed = 0;
+  volatile input_snapshot_t sink = 0;
+
+  if (trace_reader_open(&reader, path) != S_OK) {
+    fprintf(stderr, "Not a trace file: %s\n", path);
+    return 1;
+  }
+
+  // Load the input reports once, then time only the decode path
+  size_t count = 0, capacity = 1024;
+  trace_record_t* records = malloc(capacity * sizeof(*records));
+  while (records != NULL && trace_reader_next(&reader, &record)) {
+    if (record.direction != TRACE_IN) {
+      continue;
+    }
+    if (count == capacity) {
+      capacity *= 2;
+      trace_record_t* grown = realloc(records, capacity * sizeof(*records));
+      if (grown == NULL) {
+        break;
+      }
+      records = grown;
+    }
+    records[count++] = record;
+  }
+  trace_reader_close(&reader);
+  if (records == NULL || count == 0) {
+    fprintf(stderr, "No input reports in %s\n", path);
+    free(records);
+    return 1;
+  }
+
+  transport_open(&dev, NULL);
+  transport_read_start(&dev);
+
+  // Same batching as the pipeline benchmark: 8 reports per poll
+  for (int loop = 0; loop < loops; loop++) {
+    for (size_t i = 0; i < count; i += 8) {
+      size_t end = i + 8 < count ? i + 8 : count;
+      for (size_t j = i; j < end; j++) {
+        transport_loopback_inject(&dev, records[j].data, records[j].length);
+      }
+      LARGE_INTEGER start, stop;
+      QueryPerformanceCounter(&start);
+      report_drain(&dev);
+      sink = input_fold_pending();
+      QueryPerformanceCounter(&stop);
+      elapsed += (double)(stop.QuadPart - start.QuadPart);
+      reports += end - i;
+    }
+  }
+  (void)sink;
+
+  printf("%zu input reports x %d loops: %.1f ns/report\n", count, loops,
+         elapsed / (double)reports);
+
+  transport_close(&dev);
+  free(records);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  static const lever_filter_params_t lever_defaults = LEVER_FILTER_DEFAULTS;
+  uint32_t poll_hz = REPLAY_DEFAULT_POLL_HZ;
+  bool realtime = false;
+
+  if (argc < 2) {
+    fprintf(stderr,
+            "usage: %s trace.bin [--poll-hz N] [--realtime] [--filter]\n"
+            "       %s trace.bin --bench [loops]\n",
+            argv[0], argv[0]);
+    return 2;
+  }
+
+  stats_init();
+  decode_init();
+
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--bench") == 0) {
+      int loops = i + 1 < argc ? atoi(argv[i + 1]) : REPLAY_DEFAULT_LOOPS;
+      return bench(argv[1], loops > 0 ? loops : REPLAY_DEFAULT_LOOPS);
+    } else if (strcmp(argv[i], "--poll-hz") == 0 && i + 1 < argc) {
+      poll_hz = (uint32_t)atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--realtime") == 0) {
+      realtime = true;
+    } else if (strcmp(argv[i], "--filter") == 0) {
+      report_set_lever_filter(&lever_defaults);
+    }
+  }
+  if (poll_hz == 0) {
+    poll_hz = REPLAY_DEFAULT_POLL_HZ;
+  }
+
+  return replay(argv[1], poll_hz, realtime);
+}
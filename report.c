@@ -0,0 +1,192 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/dprintf.h"
+
+#include "calib.h"
+#include "decode.h"
+#include "input.h"
+#include "lever.h"
+#include "mu3io.h"
+#include "report.h"
+#include "session.h"
+#include "stats.h"
+#include "trace.h"
+#include "tracepoint.h"
+#include "transport.h"
+
+static report_input_hook_fn input_hook = NULL;
+static report_calib_hook_fn calib_hook = NULL;
+static bool lever_filter_enabled = false;
+static lever_filter_t lever_filter;
+static lever_velocity_t lever_velocity;
+static LONGLONG lever_qpc_freq = 0;
+
+void report_set_input_hook(report_input_hook_fn hook) {
+  input_hook = hook;
+}
+
+void report_set_calib_hook(report_calib_hook_fn hook) {
+  calib_hook = hook;
+}
+
+void report_set_lever_filter(const lever_filter_params_t* params) {
+  lever_filter_enabled = false;
+  if (params != NULL) {
+    lever_filter_init(&lever_filter, params);
+    lever_filter_enabled = true;
+  }
+}
+
+// QPC to microseconds, without overflowing on large counter values
+static int64_t lever_time_us(LONGLONG qpc) {
+  if (lever_qpc_freq == 0) {
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    lever_qpc_freq = freq.QuadPart;
+  }
+  return (qpc / lever_qpc_freq) * 1000000 +
+         (qpc % lever_qpc_freq) * 1000000 / lever_qpc_freq;
+}
+
+HRESULT hid_on_data(char* dat, size_t length) {
+  return hid_on_data_at(dat, length, stats_now());
+}
+
+// Every report is dispatched as it is read: control packets (acknowledges,
+// LED echoes) are handled on the spot and input reports go to the input
+// ring, so whatever arrives last in a poll, the newest input is applied.
+HRESULT hid_on_data_at(char* dat, size_t length, LONGLONG read_qpc) {
+  HidconfigData* data = (HidconfigData*)dat;
+  if (length != 64 || data->reportID != HIDCONFIG_REPORT_ID) {
+    stats_count_report(MU3_IO_REPORT_OTHER);
+  }
+  TP(TP_REPORT, length >= 2 ? data->reportID << 8 | data->command : 0,
+     length, 0);
+  if (length == 64) {
+    if (data->reportID == HIDCONFIG_REPORT_ID) {
+      switch (data->command) {
+        case SP_INPUT_GET: {  // 获取输入状态
+          // 按键查表解析，侧键取反已包含在表中
+          uint32_t buttons = decode_input_status(data->input_status);
+          stats_record(STATS_REPORT_TO_DECODE, read_qpc, stats_now());
+          stats_count_report(MU3_IO_REPORT_INPUT);
+          session_on_input(read_qpc);
+          // 读取摇杆位置
+          uint16_t lever_pos = 0;
+          lever_pos = data->roller_value_sp;
+          int64_t time_us = lever_time_us(read_qpc);
+          int16_t mu3_lever_pos;
+          // Calibrated: one table lookup. Otherwise 0x8000 is the center.
+          if (calib_state() == CALIB_ACTIVE) {
+            mu3_lever_pos = calib_map(lever_pos);
+          } else {
+            mu3_lever_pos = (int16_t)(((int32_t)lever_pos) - 0x8000);
+            if (calib_state() != CALIB_OFF &&
+                calib_observe(lever_pos, time_us) && calib_hook != NULL) {
+              calib_points_t points;
+              calib_points(&points);
+              calib_hook(&points);
+            }
+          }
+          if (lever_filter_enabled) {
+            mu3_lever_pos =
+                lever_filter_update(&lever_filter, mu3_lever_pos, time_us);
+          }
+          // Velocity of the reported position, for prediction at read time
+          int16_t velocity =
+              lever_velocity_update(&lever_velocity, mu3_lever_pos, time_us);
+          uint32_t pressed = input_publish(buttons, mu3_lever_pos, velocity);
+          if (input_hook != NULL) {
+            input_hook(input_live(), pressed, input_live_qpc());
+          }
+          TP(TP_DECODE, buttons, lever_pos, (uint16_t)mu3_lever_pos);
+          break;
+        }
+        case ROLLER_GET_DATA:
+          stats_count_report(MU3_IO_REPORT_ROLLER);
+          calib_on_roller_data(data->roller_value, data->roller_raw_value);
+          break;
+        case ROLLER_SET_OFFSET:
+          stats_count_report(MU3_IO_REPORT_ROLLER);
+          break;
+        case SP_LED_STREAM:
+        case SP_LED_SET:  // 设置LED状态
+          // 这里可以处理LED数据，如果需要的话
+          // 目前不需要处理LED数据
+          stats_count_report(MU3_IO_REPORT_LED);
+          break;
+        case SP_INPUT_GET_START:
+          stats_count_report(MU3_IO_REPORT_START);
+          session_on_start_ack(read_qpc);
+          break;
+        case SP_INPUT_GET_END:
+          stats_count_report(MU3_IO_REPORT_END);
+          session_on_end(read_qpc);
+          break;
+        default:
+          stats_count_report(MU3_IO_REPORT_OTHER);
+          dprintf("SimGEKI: Unknown HID command: %02X\n", data->command);
+          return E_FAIL;
+      }
+    }
+  }
+  return S_OK;
+}
+
+transport_status_t report_drain(transport_t* t) {
+  transport_status_t status;
+  size_t bytes = 0;
+  int packet_count = 0;
+
+  for (;;) {
+    // 先解析所有已完成的缓冲区，再一起重新发起异步读：
+    // 解析期间到达的报告直接落进其余仍在排队的读里
+    int batch = 0;
+    while (batch < t->read_depth &&
+           (status = transport_read_result(t, &bytes)) == TRANSPORT_OK) {
+      batch++;
+
+      LONGLONG read_qpc = stats_now();
+      trace_report(TRACE_IN, read_qpc, t->read_data, bytes);
+      hid_on_data_at((char*)t->read_data, bytes, read_qpc);
+    }
+    packet_count += batch;
+
+    if (batch > 0 && status != TRANSPORT_DISCONNECTED) {
+      transport_status_t armed = transport_read_start(t);
+      if (armed != TRANSPORT_OK) {
+        status = armed;
+      }
+    }
+    // Every buffer held a report: more may already be waiting
+    if (status != TRANSPORT_OK || batch < t->read_depth) {
+      break;
+    }
+  }
+
+  switch (status) {
+    case TRANSPORT_PENDING:
+      break;
+    case TRANSPORT_DISCONNECTED:
+      dprintf("SimGEKI: USB device disconnected (%s error: %lu).\n",
+              t->ops->name, (unsigned long)t->last_error);
+      return TRANSPORT_DISCONNECTED;
+    default:
+      // A single failed transfer: log it and keep a read armed, otherwise
+      // nothing would ever complete again
+      dprintf("SimGEKI: HID read failed (%s error: %lu).\n", t->ops->name,
+              (unsigned long)t->last_error);
+      if (transport_read_start(t) == TRANSPORT_DISCONNECTED) {
+        return TRANSPORT_DISCONNECTED;
+      }
+      break;
+  }
+
+  if (packet_count > 0) {
+    TP(TP_DRAIN, packet_count, 0, 0);
+  }
+
+  return TRANSPORT_OK;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+#include "calib.h"
+#include "input.h"
+#include "lever.h"
+#include "transport.h"
+
+/* Incoming report handling, independent of the platform: decodes reports
+   into the input ring and feeds the streaming session (session.h). Runs the
+   same on top of every transport backend. */
+
+/* Called with every decoded input report and its decode time, e.g. to
+   forward it to the shared hub. */
+typedef void (*report_input_hook_fn)(input_snapshot_t state,
+                                     uint32_t pressed,
+                                     LONGLONG qpc);
+
+void report_set_input_hook(report_input_hook_fn hook);
+
+/* Called on the report thread when a lever calibration has been learnt (see
+   calib.h), e.g. to save it and send the new offset to the device. */
+typedef void (*report_calib_hook_fn)(const calib_points_t* points);
+
+void report_set_calib_hook(report_calib_hook_fn hook);
+
+/* Handle one raw 64-byte report from the device. */
+HRESULT hid_on_data(char* dat, size_t length);
+
+/* Same, for a report that was read at read_qpc (QueryPerformanceCounter),
+   e.g. when replaying a trace on its own clock. */
+HRESULT hid_on_data_at(char* dat, size_t length, LONGLONG read_qpc);
+
+/* Run the lever of every input report through the adaptive filter (see
+   lever.h), or report it unfiltered when params is NULL. Resets the filter.
+   Call before reading starts. */
+void report_set_lever_filter(const lever_filter_params_t* params);
+
+/* Drain every completed read, decode it and immediately re-arm the next one.
+   Every report goes through hid_on_data() so that no button edge is lost.
+
+   Returns TRANSPORT_DISCONNECTED if the device is gone (the caller closes
+   the transport), TRANSPORT_OK otherwise. */
+transport_status_t report_drain(transport_t* t);
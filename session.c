@@ -0,0 +1,155 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/dprintf.h"
+
+#include "session.h"
+#include "stats.h"
+
+static session_send_start_fn send_start = NULL;
+static uint32_t gap_ms = SESSION_GAP_MS;
+
+static volatile LONG state = SESSION_IDLE;
+static volatile LONG first_input_pending = 0;
+static volatile LONG64 connect_qpc = 0;
+static volatile LONG64 first_input_us = -1;
+
+// Only touched by the thread that handles reports and ticks
+static LONGLONG last_report_qpc = 0;
+static LONGLONG last_send_qpc = 0;
+static uint32_t retry_ms = SESSION_RETRY_MIN_MS;
+static uint32_t send_count = 0;
+
+static const char* const state_names[] = {
+    "idle",
+    "start sent",
+    "streaming",
+    "stale",
+};
+
+static bool transition(session_state_t from, session_state_t to) {
+  return InterlockedCompareExchange(&state, to, from) == (LONG)from;
+}
+
+static uint32_t elapsed_ms(LONGLONG start, LONGLONG end) {
+  int64_t ms = stats_elapsed_us(start, end) / 1000;
+  return ms > UINT32_MAX ? UINT32_MAX : (uint32_t)ms;
+}
+
+static void send(LONGLONG now) {
+  last_send_qpc = now;
+  send_count++;
+  if (send_start != NULL) {
+    send_start();
+  }
+}
+
+void session_init(session_send_start_fn send_start_fn, uint32_t gap) {
+  send_start = send_start_fn;
+  gap_ms = gap;
+  session_disconnected();
+}
+
+void session_connected(LONGLONG qpc) {
+  InterlockedExchange64(&connect_qpc, qpc);
+  InterlockedExchange64(&first_input_us, -1);
+  InterlockedExchange(&first_input_pending, 1);
+  send_count = 0;
+  InterlockedExchange(&state, SESSION_IDLE);
+}
+
+void session_disconnected(void) {
+  InterlockedExchange(&first_input_pending, 0);
+  InterlockedExchange(&state, SESSION_IDLE);
+}
+
+void session_on_start_ack(LONGLONG qpc) {
+  last_report_qpc = qpc;
+  if (InterlockedExchange(&state, SESSION_STREAMING) != SESSION_STREAMING) {
+    dprintf("SimGEKI: Start poll listening\n");
+  }
+}
+
+void session_on_end(LONGLONG qpc) {
+  last_report_qpc = qpc;
+  InterlockedExchange(&state, SESSION_IDLE);
+  dprintf("SimGEKI: Stop poll listening\n");
+}
+
+void session_on_input(LONGLONG qpc) {
+  last_report_qpc = qpc;
+
+  // Reports flowing are as good as an acknowledge, e.g. when it was lost
+  if (state != SESSION_STREAMING) {
+    InterlockedExchange(&state, SESSION_STREAMING);
+  }
+
+  if (first_input_pending != 0 &&
+      InterlockedExchange(&first_input_pending, 0) != 0) {
+    int64_t us = stats_elapsed_us(connect_qpc, qpc);
+    InterlockedExchange64(&first_input_us, us);
+    dprintf("SimGEKI: First input %.1f ms after connect (start sent %u "
+            "times).\n",
+            (double)us / 1000.0, send_count);
+  }
+}
+
+uint32_t session_tick(LONGLONG now) {
+  uint32_t elapsed;
+
+  switch ((session_state_t)state) {
+    case SESSION_IDLE:
+      if (!transition(SESSION_IDLE, SESSION_START_SENT)) {
+        return 0;
+      }
+      retry_ms = SESSION_RETRY_MIN_MS;
+      send(now);
+      return retry_ms;
+
+    case SESSION_START_SENT:
+    case SESSION_STALE:
+      // Unanswered: send again, backing off so a device that is still
+      // booting is not flooded
+      elapsed = elapsed_ms(last_send_qpc, now);
+      if (elapsed < retry_ms) {
+        return retry_ms - elapsed;
+      }
+      retry_ms = retry_ms * 2 > SESSION_RETRY_MAX_MS ? SESSION_RETRY_MAX_MS
+                                                     : retry_ms * 2;
+      send(now);
+      return retry_ms;
+
+    case SESSION_STREAMING:
+      if (gap_ms == 0) {
+        return UINT32_MAX;
+      }
+      elapsed = elapsed_ms(last_report_qpc, now);
+      if (elapsed < gap_ms) {
+        return gap_ms - elapsed;
+      }
+      if (!transition(SESSION_STREAMING, SESSION_STALE)) {
+        return 0;
+      }
+      dprintf("SimGEKI: No report for %u ms, restarting input streaming.\n",
+              elapsed);
+      retry_ms = SESSION_RETRY_MIN_MS;
+      send(now);
+      return retry_ms;
+  }
+
+  return 0;
+}
+
+session_state_t session_state(void) {
+  return (session_state_t)InterlockedCompareExchange(&state, 0, 0);
+}
+
+int64_t session_first_input_us(void) {
+  return InterlockedCompareExchange64(&first_input_us, 0, 0);
+}
+
+const char* session_state_name(session_state_t s) {
+  return (unsigned)s < sizeof(state_names) / sizeof(state_names[0])
+             ? state_names[s]
+             : "?";
+}
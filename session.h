@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+/* Input streaming session. The device only streams SP_INPUT_GET reports
+   after SP_INPUT_GET_START; this tracks whether it does:
+
+     IDLE        connected, start not sent yet
+     START_SENT  waiting for the acknowledge (or the first input report);
+                 the start is re-sent with exponential backoff
+     STREAMING   reports arrive
+     STALE       no report for the gap timeout although the device never
+                 sent SP_INPUT_GET_END: the session is restarted
+
+   session_tick() only queues the start command through the send callback,
+   it never waits for the device. Report events and ticks come from the
+   thread that drains the reads; connect/disconnect may come from any
+   thread. */
+
+#define SESSION_RETRY_MIN_MS 20   // First re-send of an unanswered start
+#define SESSION_RETRY_MAX_MS 1000
+#define SESSION_GAP_MS 250        // Default report gap that marks a stale stream
+
+typedef enum {
+  SESSION_IDLE,
+  SESSION_START_SENT,
+  SESSION_STREAMING,
+  SESSION_STALE,
+} session_state_t;
+
+/* Queue SP_INPUT_GET_START to the device. Must not block. */
+typedef void (*session_send_start_fn)(void);
+
+/* gap_ms: report gap after which a streaming device is restarted, 0 never. */
+void session_init(session_send_start_fn send_start, uint32_t gap_ms);
+
+/* The device was (re)connected at qpc: start a new session. */
+void session_connected(LONGLONG qpc);
+
+/* The device went away. */
+void session_disconnected(void);
+
+/* Report events, with the time the report was read. */
+void session_on_start_ack(LONGLONG qpc);
+void session_on_end(LONGLONG qpc);
+void session_on_input(LONGLONG qpc);
+
+/* Send or re-send the start when due and run the gap watchdog. Returns the
+   milliseconds until the next tick has anything to do. */
+uint32_t session_tick(LONGLONG now);
+
+session_state_t session_state(void);
+
+static inline bool session_streaming(void) {
+  return session_state() == SESSION_STREAMING;
+}
+
+/* Microseconds from the last connect to its first input report, -1 while
+   there is none yet. */
+int64_t session_first_input_us(void);
+
+const char* session_state_name(session_state_t state);
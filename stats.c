@@ -0,0 +1,217 @@
+#include "platform.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "util/dprintf.h"
+
+#include "stats.h"
+
+typedef struct {
+  volatile LONG count;
+  volatile LONG max_us;
+  volatile LONG64 total_us;
+  volatile LONG buckets[MU3_IO_STATS_BUCKETS];
+} stats_slot_t;
+
+static stats_slot_t stats_slots[STATS_HISTOGRAM_COUNT];
+static LONGLONG stats_qpc_freq = 0;
+static LONGLONG stats_init_qpc = 0;
+// Microseconds from stats_init() to each milestone, 0 = not reached
+static volatile LONG stats_milestones[STATS_MILESTONE_COUNT];
+
+static volatile LONG stats_io_counters[STATS_IO_COUNTER_COUNT];
+
+// Reports of the current poll, counted on the report thread
+static volatile LONG report_pending[MU3_IO_REPORT_CLASSES];
+// Folded by stats_end_poll() on the poll thread
+static mu3_io_report_counts_t report_counts;
+
+static const char* const stats_names[STATS_HISTOGRAM_COUNT] = {
+    "report->decode",
+    "decode->consume",
+    "poll->poll",
+    "LED frame",
+};
+
+static const char* const report_class_names[MU3_IO_REPORT_CLASSES] = {
+    "input", "start ack", "end ack", "LED echo", "roller", "other",
+};
+
+// log2 bucket: 0 for < 1 us, i for [2^(i-1), 2^i) us, clamped to the last
+static int stats_bucket(uint32_t us) {
+  int bucket = 0;
+  while (us != 0 && bucket < MU3_IO_STATS_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+void stats_init(void) {
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  stats_qpc_freq = freq.QuadPart;
+  stats_init_qpc = stats_now();
+}
+
+LONGLONG stats_now(void) {
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  return now.QuadPart;
+}
+
+int64_t stats_elapsed_us(LONGLONG start, LONGLONG end) {
+  if (end < start || stats_qpc_freq == 0) {
+    return 0;
+  }
+  return (end - start) * 1000000 / stats_qpc_freq;
+}
+
+void stats_record(stats_histogram_t histogram, LONGLONG start, LONGLONG end) {
+  if (start == 0 || end < start || stats_qpc_freq == 0) {
+    return;
+  }
+
+  LONGLONG us64 = (end - start) * 1000000 / stats_qpc_freq;
+  uint32_t us = us64 > 0x7FFFFFFF ? 0x7FFFFFFF : (uint32_t)us64;
+  stats_slot_t* slot = &stats_slots[histogram];
+
+  InterlockedIncrement(&slot->buckets[stats_bucket(us)]);
+  InterlockedIncrement(&slot->count);
+  InterlockedExchangeAdd64(&slot->total_us, (LONG64)us);
+
+  LONG max = slot->max_us;
+  while ((LONG)us > max) {
+    LONG seen = InterlockedCompareExchange(&slot->max_us, (LONG)us, max);
+    if (seen == max) {
+      break;
+    }
+    max = seen;
+  }
+}
+
+void stats_milestone(stats_milestone_t milestone) {
+  if (stats_milestones[milestone] != 0 || stats_init_qpc == 0) {
+    return;
+  }
+
+  int64_t us = stats_elapsed_us(stats_init_qpc, stats_now());
+  if (us < 1) {
+    us = 1;  // 0 means not reached
+  } else if (us > 0x7FFFFFFF) {
+    us = 0x7FFFFFFF;
+  }
+  InterlockedCompareExchange(&stats_milestones[milestone], (LONG)us, 0);
+}
+
+void stats_count_io(stats_io_counter_t counter, LONG n) {
+  InterlockedExchangeAdd(&stats_io_counters[counter], n);
+}
+
+void stats_count_report(int report_class) {
+  InterlockedIncrement(&report_pending[report_class]);
+}
+
+void stats_end_poll(void) {
+  report_counts.polls++;
+  for (int i = 0; i < MU3_IO_REPORT_CLASSES; i++) {
+    uint32_t n = (uint32_t)InterlockedExchange(&report_pending[i], 0);
+    if (n == 0) {
+      continue;
+    }
+    report_counts.total[i] += n;
+    report_counts.polls_with[i]++;
+    if (n > report_counts.max_per_poll[i]) {
+      report_counts.max_per_poll[i] = n;
+    }
+  }
+}
+
+static void stats_copy(const stats_slot_t* slot, mu3_io_histogram_t* out) {
+  out->count = (uint32_t)slot->count;
+  out->max_us = (uint32_t)slot->max_us;
+  out->total_us = (uint64_t)slot->total_us;
+  for (int i = 0; i < MU3_IO_STATS_BUCKETS; i++) {
+    out->buckets[i] = (uint32_t)slot->buckets[i];
+  }
+}
+
+void stats_get(mu3_io_stats_t* stats) {
+  stats_copy(&stats_slots[STATS_REPORT_TO_DECODE], &stats->report_to_decode);
+  stats_copy(&stats_slots[STATS_DECODE_TO_CONSUME],
+             &stats->decode_to_consume);
+  stats_copy(&stats_slots[STATS_POLL_INTERVAL], &stats->poll_interval);
+  stats_copy(&stats_slots[STATS_LED_FRAME], &stats->led_frame);
+  stats->reports = report_counts;
+  stats->log_dropped = (uint32_t)dprintf_dropped();
+  stats->init_us = (uint32_t)stats_milestones[STATS_MILESTONE_INIT_DONE];
+  stats->ready_us = (uint32_t)stats_milestones[STATS_MILESTONE_DEVICE_READY];
+  stats->io_calls = (uint32_t)stats_io_counters[STATS_IO_CALL];
+  stats->io_waits = (uint32_t)stats_io_counters[STATS_IO_WAIT];
+}
+
+void stats_dump(void) {
+  mu3_io_histogram_t h;
+
+  dprintf("SimGEKI: --- Latency statistics (us) ---\n");
+  dprintf("SimGEKI: mu3_io_init        %lu\n",
+          (unsigned long)stats_milestones[STATS_MILESTONE_INIT_DONE]);
+  if (stats_milestones[STATS_MILESTONE_DEVICE_READY] != 0) {
+    dprintf("SimGEKI: init->ready        %lu\n",
+            (unsigned long)stats_milestones[STATS_MILESTONE_DEVICE_READY]);
+  } else {
+    dprintf("SimGEKI: init->ready        device not connected yet\n");
+  }
+  for (int i = 0; i < STATS_HISTOGRAM_COUNT; i++) {
+    stats_copy(&stats_slots[i], &h);
+    if (h.count == 0) {
+      dprintf("SimGEKI: %-16s no samples\n", stats_names[i]);
+      continue;
+    }
+
+    dprintf("SimGEKI: %-16s n=%lu avg=%lu max=%lu\n", stats_names[i],
+            (unsigned long)h.count, (unsigned long)(h.total_us / h.count),
+            (unsigned long)h.max_us);
+    for (int b = 0; b < MU3_IO_STATS_BUCKETS; b++) {
+      if (h.buckets[b] == 0) {
+        continue;
+      }
+      dprintf("SimGEKI:   < %8lu: %lu\n",
+              b == MU3_IO_STATS_BUCKETS - 1 ? 0xFFFFFFFFUL : 1UL << b,
+              (unsigned long)h.buckets[b]);
+    }
+  }
+
+  const mu3_io_report_counts_t* r = &report_counts;
+  dprintf("SimGEKI: --- Reports per poll (%lu polls) ---\n",
+          (unsigned long)r->polls);
+  for (int i = 0; i < MU3_IO_REPORT_CLASSES; i++) {
+    if (r->total[i] == 0) {
+      continue;
+    }
+    dprintf("SimGEKI: %-16s n=%lu avg=%.2f max=%lu in %lu polls\n",
+            report_class_names[i], (unsigned long)r->total[i],
+            r->polls != 0 ? (double)r->total[i] / r->polls : 0.0,
+            (unsigned long)r->max_per_poll[i],
+            (unsigned long)r->polls_with[i]);
+  }
+
+  uint32_t reports = 0;
+  for (int i = 0; i < MU3_IO_REPORT_CLASSES; i++) {
+    reports += r->total[i];
+  }
+  if (reports != 0 && stats_io_counters[STATS_IO_CALL] != 0) {
+    dprintf("SimGEKI: I/O calls %lu (%.2f per report), waits %lu (%.2f per "
+            "report)\n",
+            (unsigned long)stats_io_counters[STATS_IO_CALL],
+            (double)stats_io_counters[STATS_IO_CALL] / reports,
+            (unsigned long)stats_io_counters[STATS_IO_WAIT],
+            (double)stats_io_counters[STATS_IO_WAIT] / reports);
+  }
+
+  if (dprintf_dropped() != 0) {
+    dprintf("SimGEKI: Log messages dropped: %lu\n",
+            (unsigned long)dprintf_dropped());
+  }
+}
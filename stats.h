@@ -0,0 +1,59 @@
+#pragma once
+
+#include "platform.h"
+
+#include "mu3io.h"
+
+/* Lock-free latency histograms behind mu3_io_get_stats(). Recording is a
+   handful of interlocked adds, safe from any thread. */
+
+typedef enum {
+  STATS_REPORT_TO_DECODE,
+  STATS_DECODE_TO_CONSUME,
+  STATS_POLL_INTERVAL,
+  STATS_LED_FRAME,
+  STATS_HISTOGRAM_COUNT
+} stats_histogram_t;
+
+typedef enum {
+  STATS_MILESTONE_INIT_DONE,     // mu3_io_init() returned
+  STATS_MILESTONE_DEVICE_READY,  // First device connection (or hub input)
+  STATS_MILESTONE_COUNT
+} stats_milestone_t;
+
+typedef enum {
+  STATS_IO_CALL,  // Device I/O system call (ReadFile, WriteFile, event, wait)
+  STATS_IO_WAIT,  // Blocking wait of an I/O thread returned
+  STATS_IO_COUNTER_COUNT
+} stats_io_counter_t;
+
+/* Read the QPC frequency and start the milestone clock. Must be called
+   before stats_record(). */
+void stats_init(void);
+
+/* Current QueryPerformanceCounter value. */
+LONGLONG stats_now(void);
+
+/* Microseconds from start to end (QPC ticks), 0 if end < start. */
+int64_t stats_elapsed_us(LONGLONG start, LONGLONG end);
+
+/* Add the time from start to end (QPC ticks) to a histogram. Samples with
+   start == 0 (no timestamp) or end < start are ignored. */
+void stats_record(stats_histogram_t histogram, LONGLONG start, LONGLONG end);
+
+/* Record the time since stats_init() for a milestone, the first time it is
+   reached. Cheap enough to call on every poll. */
+void stats_milestone(stats_milestone_t milestone);
+
+/* Count n I/O system calls or waits, to compare the I/O engines. */
+void stats_count_io(stats_io_counter_t counter, LONG n);
+
+/* Count one report of a class (MU3_IO_REPORT_*) towards the current poll. */
+void stats_count_report(int report_class);
+
+/* Close the current poll: fold the reports counted since the last one. */
+void stats_end_poll(void);
+
+void stats_get(mu3_io_stats_t* stats);
+
+void stats_dump(void);
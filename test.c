@@ -1,5 +1,8 @@
 #include "hid.h"
 #include "mu3io.h"
+#include "led.h"
+#include "writeq.h"
+#include "util/dprintf.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -40,13 +43,30 @@ void test_initialization() {
   print_separator("Initialization Test");
   
   // Test mu3_io_init
+  LARGE_INTEGER freq, start, end;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&start);
   HRESULT result = mu3_io_init();
+  QueryPerformanceCounter(&end);
   printf("mu3_io_init Result: 0x%08X\n", result);
   if (SUCCEEDED(result)) {
     printf("IO initialization: SUCCESS\n");
   } else {
     printf("IO initialization: FAILED\n");
   }
+  printf("mu3_io_init wall time: %.3f ms\n",
+         (double)(end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart);
+
+  // The device connects in the background
+  result = mu3_io_wait_ready(3000);
+  mu3_io_stats_t stats;
+  mu3_io_get_stats(&stats);
+  if (result == S_OK) {
+    printf("Device ready %.3f ms after the start of mu3_io_init\n",
+           (double)stats.ready_us / 1000.0);
+  } else {
+    printf("Device not ready after 3 s (not attached?)\n");
+  }
   
   // Test LED init
   result = mu3_io_led_init();
@@ -192,6 +212,90 @@ void test_raw_hid_write() {
   }
 }
 
+void test_write_stats() {
+  print_separator("Output Queue Stats");
+
+  // Give the output worker a moment to finish the queued writes
+  Sleep(500);
+
+  writeq_stats_t stats;
+  writeq_get_stats(&stats);
+  printf("Queued:    %ld\n", stats.queued);
+  printf("Coalesced: %ld\n", stats.coalesced);
+  printf("Completed: %ld\n", stats.completed);
+  printf("Timed out: %ld\n", stats.timed_out);
+  printf("Failed:    %ld\n", stats.failed);
+  printf("Rejected:  %ld\n", stats.rejected);
+
+  led_stats_t led;
+  led_get_stats(&led);
+  printf("LED frames sent:      %ld\n", led.sent);
+  printf("LED frames unchanged: %ld\n", led.unchanged);
+  printf("LED frames deferred:  %ld\n", led.deferred);
+  printf("LED frames flushed:   %ld\n", led.flushed);
+}
+
+void test_latency_stats() {
+  print_separator("Latency Stats");
+
+  mu3_io_stats_t stats;
+  if (mu3_io_get_stats(&stats) != S_OK) {
+    printf("mu3_io_get_stats failed\n");
+    return;
+  }
+
+  printf("report->decode:  n=%u max=%u us\n", stats.report_to_decode.count,
+         stats.report_to_decode.max_us);
+  printf("decode->consume: n=%u max=%u us\n", stats.decode_to_consume.count,
+         stats.decode_to_consume.max_us);
+  printf("poll->poll:      n=%u max=%u us\n", stats.poll_interval.count,
+         stats.poll_interval.max_us);
+  printf("Reports in %u polls: input %u, LED echo %u, start ack %u\n",
+         stats.reports.polls, stats.reports.total[MU3_IO_REPORT_INPUT],
+         stats.reports.total[MU3_IO_REPORT_LED],
+         stats.reports.total[MU3_IO_REPORT_START]);
+
+  // Run once with completionPort = 0 and once with 1 to compare the engines
+  uint32_t reports = 0;
+  for (int i = 0; i < MU3_IO_REPORT_CLASSES; i++) {
+    reports += stats.reports.total[i];
+  }
+  if (reports != 0) {
+    printf("I/O per report:  %.2f calls, %.2f waits (%u reports)\n",
+           (double)stats.io_calls / reports, (double)stats.io_waits / reports,
+           reports);
+  }
+
+  // Full histograms go to the debug log
+  mu3_io_dump_stats();
+}
+
+// Cost of the per-poll trace messages, off and on
+void test_log_cost() {
+  print_separator("Poll Logging Cost Test");
+
+  const int polls = 100000;
+  LARGE_INTEGER freq, start, end;
+  QueryPerformanceFrequency(&freq);
+
+  for (int level = DLOG_INFO; level <= DLOG_TRACE; level += DLOG_TRACE -
+                                                          DLOG_INFO) {
+    dprintf_set_level(level);
+    unsigned long dropped = dprintf_dropped();
+    QueryPerformanceCounter(&start);
+    for (int i = 0; i < polls; i++) {
+      mu3_io_poll();
+    }
+    QueryPerformanceCounter(&end);
+    printf("Level %d: %.1f ns/poll, %lu messages dropped\n", level,
+           (double)(end.QuadPart - start.QuadPart) * 1e9 / freq.QuadPart /
+               polls,
+           dprintf_dropped() - dropped);
+  }
+  dprintf_set_level(DLOG_INFO);
+  dprintf_flush();
+}
+
 int main() {
   printf("========================================\n");
   printf("      SimGEKI mu3io Test Program\n");
@@ -214,6 +318,15 @@ int main() {
   
   // Test 6: Input Polling (main test)
   test_input_polling();
+
+  // Test 7: Output queue counters
+  test_write_stats();
+
+  // Test 8: Input latency histograms
+  test_latency_stats();
+
+  // Test 9: Debug logging on the poll path
+  test_log_cost();
   
   print_separator("Test Complete");
   printf("All tests completed. Press any key to continue with infinite polling...\n");
@@ -0,0 +1,80 @@
+#include "tracepoint.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Host-native decoder for trace point dumps ("tracePointDump =" in
+   simgeki_io.ini): one line per record, oldest first.
+
+     tpdump dump.tpt [--event name,...]
+
+   Columns: time since the first record and since the previous one (ms,
+   us), the low bits of the thread ID, the event and its arguments. With
+   --event, only the listed events are shown; the deltas still count the
+   hidden records. A summary of the events per type follows. */
+
+int main(int argc, char** argv) {
+  tp_reader_t reader;
+  tp_record_t record;
+  uint32_t shown = TP_ALL;
+  uint32_t counts[TP_EVENTS] = {0};
+  LONGLONG first = 0, prev = 0;
+  bool started = false;
+  char args[96];
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s dump.tpt [--event name,...]\n", argv[0]);
+    return 2;
+  }
+  for (int i = 2; i + 1 < argc; i++) {
+    if (strcmp(argv[i], "--event") == 0) {
+      shown = tp_parse_mask(argv[++i]);
+    }
+  }
+
+  if (tp_reader_open(&reader, argv[1]) != S_OK) {
+    fprintf(stderr, "Not a trace point dump: %s\n", argv[1]);
+    return 1;
+  }
+
+  double ms_per_tick = 1000.0 / (double)reader.qpc_freq;
+  printf("%u records\n", (unsigned)reader.count);
+  printf("%12s %10s %6s %-10s %s\n", "time ms", "delta us", "thread",
+         "event", "details");
+
+  while (tp_reader_next(&reader, &record)) {
+    if (!started) {
+      first = prev = record.qpc;
+      started = true;
+    }
+    if (record.event < TP_EVENTS) {
+      counts[record.event]++;
+    }
+
+    if (record.event >= TP_EVENTS || (shown & (1u << record.event))) {
+      tp_format_args(&record, args, sizeof(args));
+      printf("%12.3f %10.1f %6X %-10s %s\n",
+             (double)(record.qpc - first) * ms_per_tick,
+             (double)(record.qpc - prev) * ms_per_tick * 1000.0,
+             (unsigned)record.thread,
+             tp_event_name((tp_event_t)record.event), args);
+    }
+    prev = record.qpc;
+  }
+  tp_reader_close(&reader);
+
+  if (started) {
+    double span_ms = (double)(prev - first) * ms_per_tick;
+    printf("\n%.3f ms:", span_ms);
+    for (int i = 0; i < TP_EVENTS; i++) {
+      if (counts[i] != 0) {
+        printf(" %s %u", tp_event_name((tp_event_t)i), (unsigned)counts[i]);
+      }
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,150 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/dprintf.h"
+
+#include "trace.h"
+
+// Flush the stdio buffer every this many records, so a crash loses at most
+// a fraction of a second of reports
+#define TRACE_FLUSH_EVERY 256
+
+static CRITICAL_SECTION trace_lock;
+static volatile LONG trace_lock_ready = 0;
+static volatile LONG trace_active = 0;
+static FILE* trace_file = NULL;
+static uint32_t trace_unflushed = 0;
+
+static void trace_lock_init(void) {
+  // The first caller initializes, everyone else waits until it is done
+  if (InterlockedCompareExchange(&trace_lock_ready, 1, 0) == 0) {
+    InitializeCriticalSection(&trace_lock);
+    InterlockedExchange(&trace_lock_ready, 2);
+  }
+  while (InterlockedCompareExchange(&trace_lock_ready, 2, 2) != 2) {
+    Sleep(0);
+  }
+}
+
+HRESULT trace_open(const char* path) {
+  LARGE_INTEGER freq;
+  uint64_t freq64;
+
+  trace_lock_init();
+  trace_close();
+
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    dprintf("SimGEKI: Failed to create trace %s\n", path);
+    return E_FAIL;
+  }
+
+  QueryPerformanceFrequency(&freq);
+  freq64 = (uint64_t)freq.QuadPart;
+  if (fwrite(TRACE_MAGIC, 1, 8, file) != 8 ||
+      fwrite(&freq64, sizeof(freq64), 1, file) != 1) {
+    fclose(file);
+    return E_FAIL;
+  }
+
+  EnterCriticalSection(&trace_lock);
+  trace_file = file;
+  trace_unflushed = 0;
+  InterlockedExchange(&trace_active, 1);
+  LeaveCriticalSection(&trace_lock);
+
+  dprintf("SimGEKI: Recording HID reports to %s\n", path);
+  return S_OK;
+}
+
+void trace_close(void) {
+  if (InterlockedCompareExchange(&trace_lock_ready, 2, 2) != 2) {
+    return;
+  }
+
+  EnterCriticalSection(&trace_lock);
+  InterlockedExchange(&trace_active, 0);
+  if (trace_file != NULL) {
+    fclose(trace_file);
+    trace_file = NULL;
+  }
+  LeaveCriticalSection(&trace_lock);
+}
+
+void trace_report(trace_direction_t direction,
+                  LONGLONG qpc,
+                  const void* data,
+                  size_t length) {
+  uint8_t header[10];
+
+  if (InterlockedCompareExchange(&trace_active, 0, 0) == 0) {
+    return;
+  }
+  if (length > TRACE_MAX_REPORT) {
+    length = TRACE_MAX_REPORT;
+  }
+
+  memcpy(header, &qpc, 8);
+  header[8] = (uint8_t)direction;
+  header[9] = (uint8_t)length;
+
+  EnterCriticalSection(&trace_lock);
+  if (trace_file != NULL) {
+    fwrite(header, 1, sizeof(header), trace_file);
+    fwrite(data, 1, length, trace_file);
+    if (++trace_unflushed >= TRACE_FLUSH_EVERY) {
+      fflush(trace_file);
+      trace_unflushed = 0;
+    }
+  }
+  LeaveCriticalSection(&trace_lock);
+}
+
+HRESULT trace_reader_open(trace_reader_t* reader, const char* path) {
+  char magic[8];
+  uint64_t freq64;
+
+  reader->file = fopen(path, "rb");
+  if (reader->file == NULL) {
+    return E_FAIL;
+  }
+
+  if (fread(magic, 1, 8, reader->file) != 8 ||
+      memcmp(magic, TRACE_MAGIC, 8) != 0 ||
+      fread(&freq64, sizeof(freq64), 1, reader->file) != 1 || freq64 == 0) {
+    fclose(reader->file);
+    reader->file = NULL;
+    return E_INVALIDARG;
+  }
+
+  reader->qpc_freq = (LONGLONG)freq64;
+  return S_OK;
+}
+
+bool trace_reader_next(trace_reader_t* reader, trace_record_t* record) {
+  uint8_t header[10];
+
+  if (reader->file == NULL ||
+      fread(header, 1, sizeof(header), reader->file) != sizeof(header)) {
+    return false;
+  }
+
+  memcpy(&record->qpc, header, 8);
+  record->direction = header[8];
+  record->length = header[9];
+  if (record->length > TRACE_MAX_REPORT) {
+    return false;
+  }
+
+  return fread(record->data, 1, record->length, reader->file) ==
+         record->length;
+}
+
+void trace_reader_close(trace_reader_t* reader) {
+  if (reader->file != NULL) {
+    fclose(reader->file);
+    reader->file = NULL;
+  }
+}
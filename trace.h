@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "platform.h"
+
+/* Binary trace of raw HID reports, for reproducing field problems offline
+   (see replay.c). File layout, little endian:
+
+     header:  char magic[8] = "SGKTRC01", uint64 qpc_freq
+     record:  uint64 qpc, uint8 direction, uint8 length, uint8 data[length]
+
+   qpc is QueryPerformanceCounter when the report was read (direction
+   TRACE_IN) or written to the device by the output worker (TRACE_OUT). */
+
+#define TRACE_MAGIC "SGKTRC01"
+#define TRACE_MAX_REPORT 64
+
+typedef enum {
+  TRACE_IN = 0,   // Report read from the device
+  TRACE_OUT = 1,  // Report sent to the device
+} trace_direction_t;
+
+typedef struct {
+  LONGLONG qpc;
+  uint8_t direction;
+  uint8_t length;
+  uint8_t data[TRACE_MAX_REPORT];
+} trace_record_t;
+
+/* Start appending every report to a new trace file at path. */
+HRESULT trace_open(const char* path);
+
+/* Flush and stop capturing. */
+void trace_close(void);
+
+/* Append one report if a capture is running; cheap no-op otherwise. Safe to
+   call from the read and write threads at the same time. */
+void trace_report(trace_direction_t direction,
+                  LONGLONG qpc,
+                  const void* data,
+                  size_t length);
+
+typedef struct {
+  FILE* file;
+  LONGLONG qpc_freq;
+} trace_reader_t;
+
+HRESULT trace_reader_open(trace_reader_t* reader, const char* path);
+
+/* Read the next record. Returns false at the end of the trace or on a
+   truncated record. */
+bool trace_reader_next(trace_reader_t* reader, trace_record_t* record);
+
+void trace_reader_close(trace_reader_t* reader);
@@ -0,0 +1,286 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/dprintf.h"
+
+#include "tracepoint.h"
+#include "transport.h"
+
+typedef struct {
+  tp_record_t record;
+  volatile LONG seq;  // Low bits of the record's index + 1, 0 while written
+  uint32_t pad;
+} tp_slot_t;
+
+volatile uint32_t tp_mask = 0;
+
+// Allocated once by tp_start() and never freed, so a late TP() on another
+// thread never sees it go away
+static tp_slot_t* volatile tp_ring = NULL;
+static uint32_t tp_ring_size = 0;
+static volatile LONG64 tp_next = 0;
+
+static const char* const tp_names[TP_EVENTS] = {
+    "poll", "report", "decode", "drain", "write", "connect", "disconnect",
+    "enum",
+};
+
+static const char* const tp_enum_steps[] = {
+    "tested",
+    "matched",
+    "no path",
+    "end",
+};
+
+HRESULT tp_start(uint32_t mask, uint32_t records) {
+  if (tp_ring == NULL) {
+    uint32_t size = 64;
+    while (size < records && size < (1u << 24)) {
+      size <<= 1;
+    }
+
+    tp_slot_t* ring = calloc(size, sizeof(*ring));
+    if (ring == NULL) {
+      return E_OUTOFMEMORY;
+    }
+    tp_ring_size = size;
+    // Ring and size are visible before any event is enabled
+    MemoryBarrier();
+    tp_ring = ring;
+  }
+
+  InterlockedExchange((volatile LONG*)&tp_mask, (LONG)(mask & TP_ALL));
+  return S_OK;
+}
+
+void tp_stop(void) {
+  InterlockedExchange((volatile LONG*)&tp_mask, 0);
+}
+
+void tp_record(tp_event_t event, uint32_t a, uint32_t b, uint32_t c) {
+  LARGE_INTEGER now;
+  tp_slot_t* ring = tp_ring;
+
+  if (ring == NULL) {
+    return;
+  }
+
+  LONG64 index = InterlockedExchangeAdd64(&tp_next, 1);
+  tp_slot_t* slot = &ring[index & (tp_ring_size - 1)];
+
+  QueryPerformanceCounter(&now);
+  InterlockedExchange(&slot->seq, 0);
+  slot->record.qpc = now.QuadPart;
+  slot->record.event = (uint16_t)event;
+  slot->record.thread = (uint16_t)GetCurrentThreadId();
+  slot->record.a = a;
+  slot->record.b = b;
+  slot->record.c = c;
+  InterlockedExchange(&slot->seq, (LONG)(index + 1));
+}
+
+size_t tp_snapshot(tp_record_t* out, size_t max) {
+  tp_slot_t* ring = tp_ring;
+  size_t count = 0;
+
+  if (ring == NULL || out == NULL) {
+    return 0;
+  }
+
+  LONG64 end = InterlockedCompareExchange64(&tp_next, 0, 0);
+  LONG64 start = end > (LONG64)tp_ring_size ? end - tp_ring_size : 0;
+  if (end - start > (LONG64)max) {
+    start = end - (LONG64)max;
+  }
+
+  for (LONG64 i = start; i < end; i++) {
+    tp_slot_t* slot = &ring[i & (tp_ring_size - 1)];
+    LONG seq = InterlockedCompareExchange(&slot->seq, 0, 0);
+    if (seq != (LONG)(i + 1)) {
+      continue;  // Still being written, or already overwritten
+    }
+    out[count] = slot->record;
+    MemoryBarrier();
+    if (slot->seq == seq) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+HRESULT tp_dump(const char* path) {
+  LARGE_INTEGER freq;
+  uint64_t freq64;
+  uint32_t header[2];
+
+  if (tp_ring == NULL) {
+    return S_FALSE;
+  }
+
+  tp_record_t* records = malloc((size_t)tp_ring_size * sizeof(*records));
+  if (records == NULL) {
+    return E_OUTOFMEMORY;
+  }
+  size_t count = tp_snapshot(records, tp_ring_size);
+
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    dprintf("SimGEKI: Failed to create trace point dump %s\n", path);
+    free(records);
+    return E_FAIL;
+  }
+
+  QueryPerformanceFrequency(&freq);
+  freq64 = (uint64_t)freq.QuadPart;
+  header[0] = (uint32_t)count;
+  header[1] = sizeof(tp_record_t);
+  bool ok = fwrite(TP_MAGIC, 1, 8, file) == 8 &&
+            fwrite(&freq64, sizeof(freq64), 1, file) == 1 &&
+            fwrite(header, sizeof(header), 1, file) == 1 &&
+            fwrite(records, sizeof(*records), count, file) == count;
+  ok = fclose(file) == 0 && ok;
+  free(records);
+
+  if (!ok) {
+    dprintf("SimGEKI: Failed to write trace point dump %s\n", path);
+    return E_FAIL;
+  }
+  dprintf("SimGEKI: %u trace points written to %s\n", (unsigned)count, path);
+  return S_OK;
+}
+
+uint32_t tp_parse_mask(const char* list) {
+  uint32_t mask = 0;
+  const char* p = list;
+
+  if (isdigit((unsigned char)*p)) {
+    return (uint32_t)strtoul(p, NULL, 0) & TP_ALL;
+  }
+
+  while (*p != '\0') {
+    char name[16];
+    size_t len = 0;
+
+    while (*p == ',' || isspace((unsigned char)*p)) {
+      p++;
+    }
+    while (*p != '\0' && *p != ',' && !isspace((unsigned char)*p)) {
+      if (len < sizeof(name) - 1) {
+        name[len++] = (char)tolower((unsigned char)*p);
+      }
+      p++;
+    }
+    name[len] = '\0';
+    if (len == 0) {
+      continue;
+    }
+
+    if (strcmp(name, "all") == 0) {
+      mask |= TP_ALL;
+      continue;
+    }
+    for (int i = 0; i < TP_EVENTS; i++) {
+      if (strcmp(name, tp_names[i]) == 0) {
+        mask |= 1u << i;
+      }
+    }
+  }
+
+  return mask;
+}
+
+const char* tp_event_name(tp_event_t event) {
+  return (unsigned)event < TP_EVENTS ? tp_names[event] : "?";
+}
+
+void tp_format_args(const tp_record_t* r, char* buf, size_t size) {
+  switch ((tp_event_t)r->event) {
+    case TP_POLL:
+      snprintf(buf, size, "op %02X left %02X right %02X lever %d",
+               (unsigned)(r->a & 0xFF), (unsigned)((r->a >> 8) & 0xFF),
+               (unsigned)((r->a >> 16) & 0xFF), (int16_t)r->b);
+      break;
+    case TP_REPORT:
+      snprintf(buf, size, "id %02X cmd %02X len %u",
+               (unsigned)((r->a >> 8) & 0xFF), (unsigned)(r->a & 0xFF),
+               (unsigned)r->b);
+      break;
+    case TP_DECODE:
+      snprintf(buf, size, "buttons %06X raw lever %04X lever %d",
+               (unsigned)r->a, (unsigned)(r->b & 0xFFFF), (int16_t)r->c);
+      break;
+    case TP_DRAIN:
+      snprintf(buf, size, "%u reports", (unsigned)r->a);
+      break;
+    case TP_WRITE:
+      snprintf(buf, size, "id %02X cmd %02X len %u %s",
+               (unsigned)((r->a >> 8) & 0xFF), (unsigned)(r->a & 0xFF),
+               (unsigned)r->b,
+               transport_status_name((transport_status_t)r->c));
+      break;
+    case TP_CONNECT:
+      snprintf(buf, size, "%.2f ms%s", (double)r->a / 1000.0,
+               r->b ? ", cached path" : "");
+      break;
+    case TP_DISCONNECT:
+      snprintf(buf, size, "error %lu", (unsigned long)r->a);
+      break;
+    case TP_ENUM:
+      if (r->b == TP_ENUM_END) {
+        snprintf(buf, size, "end, %u devices", (unsigned)r->a);
+      } else {
+        snprintf(buf, size, "device %u %s error %lu", (unsigned)r->a,
+                 r->b < sizeof(tp_enum_steps) / sizeof(tp_enum_steps[0])
+                     ? tp_enum_steps[r->b]
+                     : "?",
+                 (unsigned long)r->c);
+      }
+      break;
+    default:
+      snprintf(buf, size, "%08X %08X %08X", (unsigned)r->a, (unsigned)r->b,
+               (unsigned)r->c);
+      break;
+  }
+}
+
+HRESULT tp_reader_open(tp_reader_t* reader, const char* path) {
+  char magic[8];
+  uint64_t freq64;
+  uint32_t header[2];
+
+  reader->file = fopen(path, "rb");
+  if (reader->file == NULL) {
+    return E_FAIL;
+  }
+
+  if (fread(magic, 1, 8, reader->file) != 8 ||
+      memcmp(magic, TP_MAGIC, 8) != 0 ||
+      fread(&freq64, sizeof(freq64), 1, reader->file) != 1 || freq64 == 0 ||
+      fread(header, sizeof(header), 1, reader->file) != 1 ||
+      header[1] != sizeof(tp_record_t)) {
+    fclose(reader->file);
+    reader->file = NULL;
+    return E_INVALIDARG;
+  }
+
+  reader->qpc_freq = (LONGLONG)freq64;
+  reader->count = header[0];
+  return S_OK;
+}
+
+bool tp_reader_next(tp_reader_t* reader, tp_record_t* record) {
+  return reader->file != NULL &&
+         fread(record, sizeof(*record), 1, reader->file) == 1;
+}
+
+void tp_reader_close(tp_reader_t* reader) {
+  if (reader->file != NULL) {
+    fclose(reader->file);
+    reader->file = NULL;
+  }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "platform.h"
+
+/* Runtime trace points: fixed-size binary records in a memory ring, for
+   diagnosing a cabinet with the same DLL that runs it. Trace points are
+   compiled in everywhere; while an event is not selected, TP() is one load
+   of tp_mask and one predictable branch.
+
+   Selected with "tracePoints =" in simgeki_io.ini, dumped to
+   "tracePointDump =" by mu3_io_dump_stats() and at exit, and turned into a
+   timeline on the host with the tpdump tool. Not to be confused with
+   trace.c, which records the raw HID reports for replay. Dump file layout,
+   little endian:
+
+     header:  char magic[8] = "SGKTPT01", uint64 qpc_freq, uint32 count,
+              uint32 record size
+     record:  tp_record_t, oldest first */
+
+#define TP_MAGIC "SGKTPT01"
+#define TP_DEFAULT_RECORDS 16384
+
+typedef enum {
+  TP_POLL,        // a: opbtn | left << 8 | right << 16, b: lever
+  TP_REPORT,      // a: report ID << 8 | command, b: length
+  TP_DECODE,      // a: buttons as decoded, b: raw lever, c: lever latched
+  TP_DRAIN,       // a: reports handled in one drain pass
+  TP_WRITE,       // a: report ID << 8 | command, b: length, c: TRANSPORT_*
+  TP_CONNECT,     // a: init time in us, b: 1 if the cached path was used
+  TP_DISCONNECT,  // a: last transport error
+  TP_ENUM,        // a: device index, b: tp_enum_step_t, c: error
+  TP_EVENTS
+} tp_event_t;
+
+typedef enum {
+  TP_ENUM_TESTED,   // Hardware ID read
+  TP_ENUM_MATCHED,  // VID/PID/MI match
+  TP_ENUM_NO_PATH,  // Matched but no device path found
+  TP_ENUM_END,      // End of the device list, a: devices seen
+} tp_enum_step_t;
+
+#define TP_ALL ((1u << TP_EVENTS) - 1)
+
+typedef struct {
+  int64_t qpc;
+  uint16_t event;
+  uint16_t thread;  // Low bits of the thread ID
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+} tp_record_t;
+
+// Bit (1 << event) set: the event is recorded
+extern volatile uint32_t tp_mask;
+
+#define TP(event, a, b, c)                                         \
+  do {                                                             \
+    if (tp_mask & (1u << (event))) {                               \
+      tp_record((event), (uint32_t)(a), (uint32_t)(b), (uint32_t)(c)); \
+    }                                                              \
+  } while (0)
+
+/* Allocate a ring of records (rounded up to a power of two) and start
+   recording the events in mask. Calling it again changes the mask; the ring
+   keeps its size. */
+HRESULT tp_start(uint32_t mask, uint32_t records);
+
+/* Stop recording. The ring keeps its contents for tp_dump(). */
+void tp_stop(void);
+
+/* Append one record; use TP() instead so disabled events cost nothing. Safe
+   to call from any number of threads. */
+void tp_record(tp_event_t event, uint32_t a, uint32_t b, uint32_t c);
+
+/* Copy up to max of the newest records, oldest first. Records being written
+   during the copy are left out. Returns the number copied. */
+size_t tp_snapshot(tp_record_t* out, size_t max);
+
+/* Write the ring to path (see the layout above). */
+HRESULT tp_dump(const char* path);
+
+/* Parse "all", a comma-separated list of event names (poll,report,...) or a
+   number. Unknown names are ignored. */
+uint32_t tp_parse_mask(const char* list);
+
+const char* tp_event_name(tp_event_t event);
+
+/* Describe the arguments of a record, e.g. "cmd 01 len 64". */
+void tp_format_args(const tp_record_t* record, char* buf, size_t size);
+
+typedef struct {
+  FILE* file;
+  LONGLONG qpc_freq;
+  uint32_t count;
+} tp_reader_t;
+
+HRESULT tp_reader_open(tp_reader_t* reader, const char* path);
+
+/* Read the next record. Returns false at the end of the dump. */
+bool tp_reader_next(tp_reader_t* reader, tp_record_t* record);
+
+void tp_reader_close(tp_reader_t* reader);
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform.h"
+
+/* HID transport: how reports get to and from the device. mu3io.c only talks
+   to this interface, so the poll/decode/LED pipeline runs unchanged on top of
+   any backend:
+     transport_win32_ops     Win32 overlapped I/O on a HID device path
+     transport_iocp_ops      The same, completed through an I/O completion
+                             port (see transport_iocp_wait())
+     transport_hidraw_ops    Linux /dev/hidraw* (host-side testing)
+     transport_loopback_ops  In-process queue fed by the caller (tests,
+                             benchmarks, replay)
+
+   One thread at a time may read (read_start/read_result) and one thread at a
+   time may write; the caller serializes close() against both.
+
+   Reads: read_depth reads are kept in flight, each with its own buffer, so
+   reports that arrive while the reader is busy land in a buffer of ours
+   right away instead of waiting in the driver for the next read. They
+   complete in the order they were armed. read_result() hands over the
+   oldest completed buffer through read_data (no copy); the buffer stays
+   ours until the next read_start(), which re-arms every buffer handed over
+   since the last one. */
+
+#define TRANSPORT_REPORT_SIZE 64
+#define TRANSPORT_MAX_READS 16
+#define TRANSPORT_DEFAULT_READS 4
+
+typedef enum {
+  TRANSPORT_OK,            // Completed
+  TRANSPORT_PENDING,       // Read still in flight, nothing received yet
+  TRANSPORT_TIMEOUT,       // Write did not complete in time, was cancelled
+  TRANSPORT_DISCONNECTED,  // Device is gone: close and reconnect
+  TRANSPORT_ERROR,         // Failed, but the device may still be there
+} transport_status_t;
+
+typedef struct transport transport_t;
+
+typedef struct {
+  const char* name;
+  // Open the device at path (ignored by the loopback backend)
+  transport_status_t (*open)(transport_t* t, const char* path);
+  // Arm every read buffer that is not in flight
+  transport_status_t (*read_start)(transport_t* t);
+  // Non-blocking: has the oldest armed read completed? On TRANSPORT_OK
+  // t->read_data points at its report and *bytes receives its length
+  transport_status_t (*read_result)(transport_t* t, size_t* bytes);
+  // Write one report, waiting at most timeout_ms for it to complete
+  transport_status_t (*write)(transport_t* t,
+                              const uint8_t* data,
+                              size_t length,
+                              uint32_t timeout_ms);
+  // Optional: make a write() waiting on another thread return now. NULL for
+  // backends whose write() does not wait on the device.
+  void (*cancel_write)(transport_t* t);
+  void (*close)(transport_t* t);
+} transport_ops_t;
+
+struct transport {
+  const transport_ops_t* ops;
+  // Signalled when the oldest armed read completes (Win32 event), NULL
+  // otherwise. Changes with every completion, read it before each wait.
+  HANDLE read_event;
+  // Native error code (GetLastError/errno) of the last failure, for logs
+  uint32_t last_error;
+  bool is_open;
+  // Reads kept in flight, set before open(); 0 = TRANSPORT_DEFAULT_READS
+  uint8_t read_depth;
+  // Report handed over by the last successful read_result()
+  const uint8_t* read_data;
+  void* impl;  // Backend state
+};
+
+#ifdef _WIN32
+extern const transport_ops_t transport_win32_ops;
+extern const transport_ops_t transport_iocp_ops;
+#endif
+#ifdef __linux__
+extern const transport_ops_t transport_hidraw_ops;
+#endif
+extern const transport_ops_t transport_loopback_ops;
+
+static inline void transport_bind(transport_t* t, const transport_ops_t* ops) {
+  t->ops = ops;
+}
+
+static inline transport_status_t transport_open(transport_t* t,
+                                                const char* path) {
+  if (t->read_depth == 0) {
+    t->read_depth = TRANSPORT_DEFAULT_READS;
+  } else if (t->read_depth > TRANSPORT_MAX_READS) {
+    t->read_depth = TRANSPORT_MAX_READS;
+  }
+  return t->ops->open(t, path);
+}
+
+static inline transport_status_t transport_read_start(transport_t* t) {
+  return t->ops->read_start(t);
+}
+
+static inline transport_status_t transport_read_result(transport_t* t,
+                                                       size_t* bytes) {
+  return t->ops->read_result(t, bytes);
+}
+
+static inline transport_status_t transport_write(transport_t* t,
+                                                 const uint8_t* data,
+                                                 size_t length,
+                                                 uint32_t timeout_ms) {
+  return t->ops->write(t, data, length, timeout_ms);
+}
+
+static inline void transport_cancel_write(transport_t* t) {
+  if (t->is_open && t->ops->cancel_write != NULL) {
+    t->ops->cancel_write(t);
+  }
+}
+
+static inline void transport_close(transport_t* t) {
+  if (t->is_open) {
+    t->ops->close(t);
+  }
+}
+
+#ifdef _WIN32
+/* I/O completion port backend. Reads and writes have no event: one thread
+   collects their completions, and signals posted by other threads, with
+   transport_iocp_wait(). read_result() only returns reads whose completion
+   that thread has already collected, so it must also be the one reading.
+   write() only issues the write and returns TRANSPORT_PENDING; its outcome
+   comes back as a TRANSPORT_IOCP_WRITE event. */
+
+#define TRANSPORT_IOCP_WRITES 8  // Writes in flight
+#define TRANSPORT_IOCP_BATCH 16  // Most events returned by one wait
+
+typedef enum {
+  TRANSPORT_IOCP_SIGNAL,  // Posted with transport_iocp_post()
+  TRANSPORT_IOCP_READ,    // A read completed, drain with read_result()
+  TRANSPORT_IOCP_WRITE,   // A write completed
+  TRANSPORT_IOCP_STALE,   // An operation of a transport closed since
+} transport_iocp_kind_t;
+
+typedef struct {
+  transport_iocp_kind_t kind;
+  ULONG_PTR key;  // SIGNAL
+  transport_t* t;  // READ, WRITE
+  // WRITE: outcome, the report and when it was issued (QPC)
+  transport_status_t status;
+  size_t length;
+  LONGLONG issued;
+  uint8_t data[TRANSPORT_REPORT_SIZE];
+} transport_iocp_event_t;
+
+/* Create the completion port, before opening a transport. */
+HRESULT transport_iocp_start(void);
+
+/* Wake the waiting thread with a TRANSPORT_IOCP_SIGNAL event; key must not
+   be 0. May be called from any thread. */
+bool transport_iocp_post(ULONG_PTR key);
+
+/* Wait up to timeout_ms for completions and signals. Returns how many
+   events were written to events, 0 on timeout. */
+size_t transport_iocp_wait(transport_iocp_event_t* events,
+                           size_t max,
+                           uint32_t timeout_ms);
+
+/* Is a write slot free? */
+bool transport_iocp_write_ready(const transport_t* t);
+
+/* Cancel writes in flight for longer than timeout_ms; they complete with
+   TRANSPORT_TIMEOUT. */
+void transport_iocp_expire_writes(transport_t* t, uint32_t timeout_ms);
+#endif
+
+/* Loopback only: queue a report to be returned by the next read. Returns
+   false if the queue is full. May be called from any single thread. */
+bool transport_loopback_inject(transport_t* t,
+                               const void* report,
+                               size_t length);
+
+/* Loopback only: spin ns for every read re-armed by read_start(), to stand
+   in for what issuing a ReadFile costs on a real device. 0 by default. */
+void transport_loopback_set_read_cost(transport_t* t, uint32_t ns);
+
+/* Loopback only: reports and bytes written so far. */
+void transport_loopback_written(transport_t* t,
+                                uint64_t* reports,
+                                uint64_t* bytes);
+
+static inline const char* transport_status_name(transport_status_t status) {
+  switch (status) {
+    case TRANSPORT_OK:
+      return "ok";
+    case TRANSPORT_PENDING:
+      return "pending";
+    case TRANSPORT_TIMEOUT:
+      return "timeout";
+    case TRANSPORT_DISCONNECTED:
+      return "disconnected";
+    case TRANSPORT_ERROR:
+    default:
+      return "error";
+  }
+}
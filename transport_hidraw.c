@@ -0,0 +1,145 @@
+#ifdef __linux__
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "transport.h"
+
+/* /dev/hidraw* delivers one report per read(), report ID first, which is the
+   same layout ReadFile returns on Windows. The fd is non-blocking, so an
+   "armed" read is simply the next read() call, made into the next of
+   read_depth buffers. */
+
+typedef struct {
+  int fd;
+  uint8_t held;  // Buffers handed over since the last read_start
+  uint8_t bufs[TRANSPORT_MAX_READS][TRANSPORT_REPORT_SIZE];
+} hidraw_t;
+
+static transport_status_t hidraw_classify(transport_t* t, int error) {
+  t->last_error = (uint32_t)error;
+  switch (error) {
+    case ENODEV:
+    case ENXIO:
+    case EIO:
+    case ESHUTDOWN:
+    case EPIPE:
+      return TRANSPORT_DISCONNECTED;
+    default:
+      return TRANSPORT_ERROR;
+  }
+}
+
+static int hidraw_fd(transport_t* t) {
+  return ((hidraw_t*)t->impl)->fd;
+}
+
+static transport_status_t hidraw_open(transport_t* t, const char* path) {
+  hidraw_t* h = (hidraw_t*)calloc(1, sizeof(*h));
+  if (h == NULL) {
+    t->last_error = ENOMEM;
+    return TRANSPORT_ERROR;
+  }
+
+  h->fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (h->fd < 0) {
+    t->last_error = (uint32_t)errno;
+    free(h);
+    return TRANSPORT_DISCONNECTED;
+  }
+
+  t->impl = h;
+  t->read_event = NULL;
+  t->is_open = true;
+  return TRANSPORT_OK;
+}
+
+static transport_status_t hidraw_read_start(transport_t* t) {
+  ((hidraw_t*)t->impl)->held = 0;
+  return TRANSPORT_OK;
+}
+
+static transport_status_t hidraw_read_result(transport_t* t, size_t* bytes) {
+  hidraw_t* h = (hidraw_t*)t->impl;
+
+  if (h->held >= t->read_depth) {
+    return TRANSPORT_PENDING;
+  }
+
+  uint8_t* buf = h->bufs[h->held];
+  ssize_t n = read(h->fd, buf, TRANSPORT_REPORT_SIZE);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EINTR) {
+      return TRANSPORT_PENDING;
+    }
+    return hidraw_classify(t, errno);
+  }
+  if (n == 0) {
+    // End of file: the device node is going away
+    return hidraw_classify(t, ENODEV);
+  }
+
+  h->held++;
+  t->read_data = buf;
+  *bytes = (size_t)n;
+  return TRANSPORT_OK;
+}
+
+static transport_status_t hidraw_write(transport_t* t,
+                                       const uint8_t* data,
+                                       size_t length,
+                                       uint32_t timeout_ms) {
+  int fd = hidraw_fd(t);
+
+  for (;;) {
+    ssize_t n = write(fd, data, length);
+    if (n >= 0) {
+      return TRANSPORT_OK;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN) {
+      return hidraw_classify(t, errno);
+    }
+
+    // Output queue full: wait for room like the Win32 write timeout
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    int ready = poll(&pfd, 1, (int)timeout_ms);
+    if (ready == 0) {
+      t->last_error = ETIMEDOUT;
+      return TRANSPORT_TIMEOUT;
+    }
+    if (ready < 0 && errno != EINTR) {
+      return hidraw_classify(t, errno);
+    }
+    if (pfd.revents & (POLLERR | POLLHUP)) {
+      return hidraw_classify(t, ENODEV);
+    }
+  }
+}
+
+static void hidraw_close(transport_t* t) {
+  close(hidraw_fd(t));
+  free(t->impl);
+  t->impl = NULL;
+  t->is_open = false;
+}
+
+const transport_ops_t transport_hidraw_ops = {
+    .name = "hidraw",
+    .open = hidraw_open,
+    .read_start = hidraw_read_start,
+    .read_result = hidraw_read_result,
+    .write = hidraw_write,
+    .close = hidraw_close,
+};
+
+#endif  // __linux__
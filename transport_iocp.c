@@ -0,0 +1,368 @@
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+#include "transport.h"
+
+/* Win32 overlapped I/O completed through one I/O completion port instead of
+   an event per operation: reads and writes carry no event, the kernel queues
+   a packet for each and a single thread collects them, several at a time,
+   with transport_iocp_wait(). Callers post their own signals to the same
+   port, so that thread sleeps in exactly one place.
+
+   Packets of cancelled operations still arrive after close(), so the
+   backend state is reference counted: every operation in flight holds a
+   reference and whoever drops the last one frees it. */
+
+#define IOCP_KEY_DEVICE 0  // Packets of device reads and writes
+
+typedef struct iocp_device iocp_device_t;
+
+typedef struct {
+  OVERLAPPED ov;  // No event: the packet goes to the port
+  iocp_device_t* dev;
+  bool write;
+  bool busy;       // Owned by the kernel until its packet is dequeued
+  bool done;       // Read: packet dequeued, waiting for read_result()
+  bool timed_out;  // Write: cancelled by transport_iocp_expire_writes()
+  DWORD bytes;
+  DWORD error;
+  LONGLONG issued;  // Write: QPC when it was issued
+  size_t length;    // Write: report length
+  uint8_t buf[TRANSPORT_REPORT_SIZE];
+} iocp_op_t;
+
+/* Reads form a ring like in transport_win32.c: the armed ones run from next
+   to arm, oldest first. Writes take any free slot. */
+struct iocp_device {
+  transport_t* volatile t;  // NULL once closed
+  HANDLE handle;
+  volatile LONG refs;
+  uint8_t depth;
+  uint8_t next;   // Oldest armed read
+  uint8_t arm;    // Next read to arm
+  uint8_t armed;  // Reads in flight or done but not handed over
+  iocp_op_t reads[TRANSPORT_MAX_READS];
+  iocp_op_t writes[TRANSPORT_IOCP_WRITES];
+};
+
+static HANDLE iocp_port = NULL;
+
+static void iocp_release(iocp_device_t* dev) {
+  if (InterlockedDecrement(&dev->refs) == 0) {
+    free(dev);
+  }
+}
+
+// Errors that mean the device went away rather than a single failed transfer
+static transport_status_t iocp_classify(transport_t* t, DWORD error) {
+  t->last_error = error;
+  switch (error) {
+    case ERROR_BAD_COMMAND:
+    case ERROR_NOT_READY:
+    case ERROR_DEVICE_NOT_CONNECTED:
+    case ERROR_GEN_FAILURE:
+    case ERROR_OPERATION_ABORTED:
+      return TRANSPORT_DISCONNECTED;
+    default:
+      return TRANSPORT_ERROR;
+  }
+}
+
+// Issue one read or write; the op holds a reference while it is in flight
+static bool iocp_issue(iocp_device_t* dev, iocp_op_t* op, DWORD* error) {
+  BOOL ok;
+
+  memset(&op->ov, 0, sizeof(op->ov));
+  op->busy = true;
+  InterlockedIncrement(&dev->refs);
+  stats_count_io(STATS_IO_CALL, 1);
+  if (op->write) {
+    ok = WriteFile(dev->handle, op->buf, (DWORD)op->length, NULL, &op->ov);
+  } else {
+    ok = ReadFile(dev->handle, op->buf, TRANSPORT_REPORT_SIZE, NULL, &op->ov);
+  }
+
+  // Completed right away or pending: either way a packet is queued
+  *error = ok ? ERROR_SUCCESS : GetLastError();
+  if (ok || *error == ERROR_IO_PENDING) {
+    return true;
+  }
+  op->busy = false;
+  InterlockedDecrement(&dev->refs);
+  return false;
+}
+
+static void iocp_close(transport_t* t) {
+  iocp_device_t* dev = (iocp_device_t*)t->impl;
+
+  t->is_open = false;
+  t->impl = NULL;
+  if (dev == NULL) {
+    return;
+  }
+
+  // Operations in flight complete as aborted; their packets free dev
+  InterlockedExchangePointer((PVOID volatile*)&dev->t, NULL);
+  if (dev->handle != NULL) {
+    CancelIoEx(dev->handle, NULL);
+    CloseHandle(dev->handle);
+  }
+  iocp_release(dev);
+}
+
+static transport_status_t iocp_open(transport_t* t, const char* path) {
+  if (iocp_port == NULL) {
+    t->last_error = ERROR_INVALID_HANDLE;
+    return TRANSPORT_ERROR;
+  }
+
+  iocp_device_t* dev = (iocp_device_t*)calloc(1, sizeof(*dev));
+  if (dev == NULL) {
+    t->last_error = ERROR_NOT_ENOUGH_MEMORY;
+    return TRANSPORT_ERROR;
+  }
+  dev->refs = 1;
+  dev->depth = t->read_depth;
+  for (int i = 0; i < TRANSPORT_MAX_READS; i++) {
+    dev->reads[i].dev = dev;
+  }
+  for (int i = 0; i < TRANSPORT_IOCP_WRITES; i++) {
+    dev->writes[i].dev = dev;
+    dev->writes[i].write = true;
+  }
+  t->impl = dev;
+
+  dev->handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                            OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+  if (dev->handle == INVALID_HANDLE_VALUE) {
+    dev->handle = NULL;
+    t->last_error = GetLastError();
+    iocp_close(t);
+    return TRANSPORT_DISCONNECTED;
+  }
+
+  if (CreateIoCompletionPort(dev->handle, iocp_port, IOCP_KEY_DEVICE, 0) ==
+      NULL) {
+    t->last_error = GetLastError();
+    iocp_close(t);
+    return TRANSPORT_ERROR;
+  }
+  // Nobody waits on the handle itself, spare the kernel signalling it
+  SetFileCompletionNotificationModes(dev->handle,
+                                     FILE_SKIP_SET_EVENT_ON_HANDLE);
+
+  dev->t = t;
+  t->read_event = NULL;
+  t->is_open = true;
+  return TRANSPORT_OK;
+}
+
+static transport_status_t iocp_read_start(transport_t* t) {
+  iocp_device_t* dev = (iocp_device_t*)t->impl;
+  DWORD error;
+
+  while (dev->armed < dev->depth) {
+    iocp_op_t* op = &dev->reads[dev->arm];
+
+    op->done = false;
+    if (!iocp_issue(dev, op, &error)) {
+      return iocp_classify(t, error);
+    }
+    dev->arm = (uint8_t)((dev->arm + 1) % dev->depth);
+    dev->armed++;
+  }
+  return TRANSPORT_OK;
+}
+
+static transport_status_t iocp_read_result(transport_t* t, size_t* bytes) {
+  iocp_device_t* dev = (iocp_device_t*)t->impl;
+  iocp_op_t* op = &dev->reads[dev->next];
+
+  // Only packets dequeued by transport_iocp_wait() count as completed
+  if (dev->armed == 0 || !op->done) {
+    return TRANSPORT_PENDING;
+  }
+
+  op->done = false;
+  dev->armed--;
+  dev->next = (uint8_t)((dev->next + 1) % dev->depth);
+  if (op->error != ERROR_SUCCESS) {
+    return iocp_classify(t, op->error);
+  }
+
+  t->read_data = op->buf;
+  *bytes = op->bytes;
+  return TRANSPORT_OK;
+}
+
+// Issue the write and return: TRANSPORT_PENDING once it is in flight, its
+// result comes with a TRANSPORT_IOCP_WRITE event. timeout_ms is enforced by
+// transport_iocp_expire_writes().
+static transport_status_t iocp_write(transport_t* t,
+                                     const uint8_t* data,
+                                     size_t length,
+                                     uint32_t timeout_ms) {
+  iocp_device_t* dev = (iocp_device_t*)t->impl;
+  DWORD error;
+  (void)timeout_ms;
+
+  if (length > TRANSPORT_REPORT_SIZE) {
+    t->last_error = ERROR_INVALID_PARAMETER;
+    return TRANSPORT_ERROR;
+  }
+
+  for (int i = 0; i < TRANSPORT_IOCP_WRITES; i++) {
+    iocp_op_t* op = &dev->writes[i];
+    if (op->busy) {
+      continue;
+    }
+
+    memcpy(op->buf, data, length);
+    op->length = length;
+    op->timed_out = false;
+    op->issued = stats_now();
+    if (!iocp_issue(dev, op, &error)) {
+      return iocp_classify(t, error);
+    }
+    return TRANSPORT_PENDING;
+  }
+
+  t->last_error = ERROR_BUSY;
+  return TRANSPORT_ERROR;
+}
+
+HRESULT transport_iocp_start(void) {
+  if (iocp_port != NULL) {
+    return S_OK;
+  }
+
+  // One thread dequeues, so one may run
+  iocp_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+  if (iocp_port == NULL) {
+    return HRESULT_FROM_WIN32(GetLastError());
+  }
+  return S_OK;
+}
+
+bool transport_iocp_post(ULONG_PTR key) {
+  stats_count_io(STATS_IO_CALL, 1);
+  return iocp_port != NULL &&
+         PostQueuedCompletionStatus(iocp_port, 0, key, NULL);
+}
+
+size_t transport_iocp_wait(transport_iocp_event_t* events,
+                           size_t max,
+                           uint32_t timeout_ms) {
+  OVERLAPPED_ENTRY entries[TRANSPORT_IOCP_BATCH];
+  ULONG removed = 0;
+
+  if (max > TRANSPORT_IOCP_BATCH) {
+    max = TRANSPORT_IOCP_BATCH;
+  }
+  BOOL ok = GetQueuedCompletionStatusEx(iocp_port, entries, (ULONG)max,
+                                        &removed, timeout_ms, FALSE);
+  stats_count_io(STATS_IO_CALL, 1);
+  stats_count_io(STATS_IO_WAIT, 1);
+  if (!ok) {
+    return 0;  // Timed out
+  }
+
+  for (ULONG i = 0; i < removed; i++) {
+    transport_iocp_event_t* e = &events[i];
+
+    memset(e, 0, sizeof(*e));
+    if (entries[i].lpCompletionKey != IOCP_KEY_DEVICE) {
+      e->kind = TRANSPORT_IOCP_SIGNAL;
+      e->key = entries[i].lpCompletionKey;
+      continue;
+    }
+
+    iocp_op_t* op =
+        CONTAINING_RECORD(entries[i].lpOverlapped, iocp_op_t, ov);
+    iocp_device_t* dev = op->dev;
+    transport_t* t = dev->t;
+
+    // Completed: the status is in the OVERLAPPED, no system call needed
+    op->bytes = entries[i].dwNumberOfBytesTransferred;
+    op->error = ERROR_SUCCESS;
+    if (!GetOverlappedResult(dev->handle, &op->ov, &op->bytes, FALSE)) {
+      op->error = GetLastError();
+    }
+
+    if (t == NULL) {
+      e->kind = TRANSPORT_IOCP_STALE;
+    } else if (!op->write) {
+      e->kind = TRANSPORT_IOCP_READ;
+      e->t = t;
+      op->done = true;
+    } else {
+      e->kind = TRANSPORT_IOCP_WRITE;
+      e->t = t;
+      e->length = op->length;
+      e->issued = op->issued;
+      memcpy(e->data, op->buf, op->length);
+      if (op->error == ERROR_SUCCESS) {
+        e->status = TRANSPORT_OK;
+      } else if (op->timed_out) {
+        t->last_error = ERROR_TIMEOUT;
+        e->status = TRANSPORT_TIMEOUT;
+      } else {
+        e->status = iocp_classify(t, op->error);
+      }
+    }
+
+    op->busy = false;
+    iocp_release(dev);
+  }
+
+  return removed;
+}
+
+bool transport_iocp_write_ready(const transport_t* t) {
+  const iocp_device_t* dev = (const iocp_device_t*)t->impl;
+
+  if (dev == NULL) {
+    return false;
+  }
+  for (int i = 0; i < TRANSPORT_IOCP_WRITES; i++) {
+    if (!dev->writes[i].busy) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void transport_iocp_expire_writes(transport_t* t, uint32_t timeout_ms) {
+  iocp_device_t* dev = (iocp_device_t*)t->impl;
+  LARGE_INTEGER freq;
+
+  if (dev == NULL) {
+    return;
+  }
+
+  QueryPerformanceFrequency(&freq);
+  LONGLONG limit = stats_now() - freq.QuadPart * timeout_ms / 1000;
+  for (int i = 0; i < TRANSPORT_IOCP_WRITES; i++) {
+    iocp_op_t* op = &dev->writes[i];
+    if (op->busy && !op->timed_out && op->issued < limit) {
+      // Completes as aborted, reported as a timeout
+      op->timed_out = true;
+      CancelIoEx(dev->handle, &op->ov);
+    }
+  }
+}
+
+const transport_ops_t transport_iocp_ops = {
+    .name = "iocp",
+    .open = iocp_open,
+    .read_start = iocp_read_start,
+    .read_result = iocp_read_result,
+    .write = iocp_write,
+    .close = iocp_close,
+};
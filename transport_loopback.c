@@ -0,0 +1,160 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "transport.h"
+
+/* In-process device: reports queued with transport_loopback_inject() come
+   back out of the read side, writes are counted and dropped. The queue is a
+   single-producer/single-consumer ring, so one injecting thread can feed a
+   reader thread without locks.
+
+   Reads behave like read_depth buffers handed over in place: read_result()
+   points read_data into the ring, and the slots only go back to the
+   injecting thread on the next read_start(). */
+
+// Must be a power of two
+#define LOOPBACK_DEPTH 1024
+
+typedef struct {
+  uint8_t reports[LOOPBACK_DEPTH][TRANSPORT_REPORT_SIZE];
+  uint8_t lengths[LOOPBACK_DEPTH];
+  volatile LONG head;  // Written by the injecting thread
+  volatile LONG tail;  // Written by the reading thread
+  LONG held;           // Reports handed over since the last read_start
+  uint32_t read_cost_ns;
+  volatile LONG64 written_reports;
+  volatile LONG64 written_bytes;
+} loopback_t;
+
+static transport_status_t loopback_open(transport_t* t, const char* path) {
+  (void)path;
+
+  loopback_t* lb = (loopback_t*)calloc(1, sizeof(*lb));
+  if (lb == NULL) {
+    t->last_error = 0;
+    return TRANSPORT_ERROR;
+  }
+
+  t->impl = lb;
+  t->read_event = NULL;
+  t->is_open = true;
+  return TRANSPORT_OK;
+}
+
+// Busy-wait standing in for the cost of issuing one device read
+static void loopback_spin(uint64_t ns) {
+  LARGE_INTEGER freq, start, now;
+
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&start);
+  LONGLONG ticks = (LONGLONG)(ns * (uint64_t)freq.QuadPart / 1000000000ull);
+  do {
+    QueryPerformanceCounter(&now);
+  } while (now.QuadPart - start.QuadPart < ticks);
+}
+
+static transport_status_t loopback_read_start(transport_t* t) {
+  loopback_t* lb = (loopback_t*)t->impl;
+  LONG held = lb->held;
+
+  if (held == 0) {
+    return TRANSPORT_OK;
+  }
+  if (lb->read_cost_ns != 0) {
+    loopback_spin((uint64_t)lb->read_cost_ns * (uint64_t)held);
+  }
+
+  lb->held = 0;
+  InterlockedExchange(&lb->tail, lb->tail + held);
+  return TRANSPORT_OK;
+}
+
+static transport_status_t loopback_read_result(transport_t* t, size_t* bytes) {
+  loopback_t* lb = (loopback_t*)t->impl;
+  LONG next = lb->tail + lb->held;
+
+  if (lb->held >= t->read_depth ||
+      InterlockedCompareExchange(&lb->head, 0, 0) == next) {
+    return TRANSPORT_PENDING;
+  }
+
+  LONG slot = next & (LOOPBACK_DEPTH - 1);
+  *bytes = lb->lengths[slot];
+  t->read_data = lb->reports[slot];
+  lb->held++;
+  return TRANSPORT_OK;
+}
+
+static transport_status_t loopback_write(transport_t* t,
+                                         const uint8_t* data,
+                                         size_t length,
+                                         uint32_t timeout_ms) {
+  loopback_t* lb = (loopback_t*)t->impl;
+  (void)data;
+  (void)timeout_ms;
+
+  InterlockedExchangeAdd64(&lb->written_reports, 1);
+  InterlockedExchangeAdd64(&lb->written_bytes, (LONG64)length);
+  return TRANSPORT_OK;
+}
+
+static void loopback_close(transport_t* t) {
+  free(t->impl);
+  t->impl = NULL;
+  t->is_open = false;
+}
+
+bool transport_loopback_inject(transport_t* t,
+                               const void* report,
+                               size_t length) {
+  loopback_t* lb = (loopback_t*)t->impl;
+
+  if (lb == NULL || length > TRANSPORT_REPORT_SIZE) {
+    return false;
+  }
+
+  LONG head = lb->head;
+  if ((ULONG)(head - InterlockedCompareExchange(&lb->tail, 0, 0)) >=
+      LOOPBACK_DEPTH) {
+    return false;
+  }
+
+  LONG slot = head & (LOOPBACK_DEPTH - 1);
+  memcpy(lb->reports[slot], report, length);
+  lb->lengths[slot] = (uint8_t)length;
+  // Full barrier: the report must be visible before the new head
+  InterlockedExchange(&lb->head, head + 1);
+  return true;
+}
+
+void transport_loopback_set_read_cost(transport_t* t, uint32_t ns) {
+  loopback_t* lb = (loopback_t*)t->impl;
+
+  if (lb != NULL) {
+    lb->read_cost_ns = ns;
+  }
+}
+
+void transport_loopback_written(transport_t* t,
+                                uint64_t* reports,
+                                uint64_t* bytes) {
+  loopback_t* lb = (loopback_t*)t->impl;
+
+  if (reports != NULL) {
+    *reports = lb != NULL ? (uint64_t)lb->written_reports : 0;
+  }
+  if (bytes != NULL) {
+    *bytes = lb != NULL ? (uint64_t)lb->written_bytes : 0;
+  }
+}
+
+const transport_ops_t transport_loopback_ops = {
+    .name = "loopback",
+    .open = loopback_open,
+    .read_start = loopback_read_start,
+    .read_result = loopback_read_result,
+    .write = loopback_write,
+    .close = loopback_close,
+};
@@ -0,0 +1,212 @@
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "stats.h"
+#include "transport.h"
+
+typedef struct {
+  OVERLAPPED ov;
+  bool armed;  // ov and buf are owned by the kernel until it completes
+  uint8_t buf[TRANSPORT_REPORT_SIZE];
+} win32_read_t;
+
+/* The reads form a ring: the armed ones run from next to arm, the ones
+   handed over to the caller from arm back round to next. The HID class
+   driver completes pending reads in the order they were issued, so the
+   oldest armed read is always the next one to complete. */
+typedef struct {
+  HANDLE handle;
+  OVERLAPPED ov_write;
+  uint8_t depth;
+  uint8_t next;   // Oldest armed read
+  uint8_t arm;    // Next read to arm
+  uint8_t armed;  // Reads in flight
+  win32_read_t reads[TRANSPORT_MAX_READS];
+} win32_transport_t;
+
+// Errors that mean the device went away rather than a single failed transfer
+static transport_status_t win32_classify(transport_t* t, DWORD error) {
+  t->last_error = error;
+  switch (error) {
+    case ERROR_BAD_COMMAND:
+    case ERROR_NOT_READY:
+    case ERROR_DEVICE_NOT_CONNECTED:
+    case ERROR_GEN_FAILURE:
+    case ERROR_OPERATION_ABORTED:
+      return TRANSPORT_DISCONNECTED;
+    default:
+      return TRANSPORT_ERROR;
+  }
+}
+
+static void win32_close(transport_t* t) {
+  win32_transport_t* w = (win32_transport_t*)t->impl;
+
+  t->is_open = false;
+  t->read_event = NULL;
+  if (w == NULL) {
+    return;
+  }
+
+  if (w->handle != NULL) {
+    if (w->armed > 0) {
+      // Wait for the cancelled reads so the kernel is done with them
+      CancelIoEx(w->handle, NULL);
+      for (int i = 0; i < w->depth; i++) {
+        DWORD transferred;
+        if (w->reads[i].armed) {
+          GetOverlappedResult(w->handle, &w->reads[i].ov, &transferred, TRUE);
+        }
+      }
+    }
+    CloseHandle(w->handle);
+  }
+  for (int i = 0; i < w->depth; i++) {
+    if (w->reads[i].ov.hEvent != NULL) {
+      CloseHandle(w->reads[i].ov.hEvent);
+    }
+  }
+  if (w->ov_write.hEvent != NULL) {
+    CloseHandle(w->ov_write.hEvent);
+  }
+  free(w);
+  t->impl = NULL;
+}
+
+static transport_status_t win32_open(transport_t* t, const char* path) {
+  win32_transport_t* w = (win32_transport_t*)calloc(1, sizeof(*w));
+  if (w == NULL) {
+    t->last_error = ERROR_NOT_ENOUGH_MEMORY;
+    return TRANSPORT_ERROR;
+  }
+  t->impl = w;
+
+  w->handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                          OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+  if (w->handle == INVALID_HANDLE_VALUE) {
+    w->handle = NULL;
+    t->last_error = GetLastError();
+    win32_close(t);
+    return TRANSPORT_DISCONNECTED;
+  }
+
+  w->depth = t->read_depth;
+  for (int i = 0; i < w->depth; i++) {
+    w->reads[i].ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (w->reads[i].ov.hEvent == NULL) {
+      t->last_error = GetLastError();
+      win32_close(t);
+      return TRANSPORT_ERROR;
+    }
+  }
+  w->ov_write.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (w->ov_write.hEvent == NULL) {
+    t->last_error = GetLastError();
+    win32_close(t);
+    return TRANSPORT_ERROR;
+  }
+
+  t->read_event = w->reads[0].ov.hEvent;
+  t->is_open = true;
+  return TRANSPORT_OK;
+}
+
+static transport_status_t win32_read_start(transport_t* t) {
+  win32_transport_t* w = (win32_transport_t*)t->impl;
+
+  while (w->armed < w->depth) {
+    win32_read_t* r = &w->reads[w->arm];
+
+    stats_count_io(STATS_IO_CALL, 2);
+    ResetEvent(r->ov.hEvent);
+    if (!ReadFile(w->handle, r->buf, TRANSPORT_REPORT_SIZE, NULL, &r->ov)) {
+      DWORD error = GetLastError();
+      if (error != ERROR_IO_PENDING) {
+        return win32_classify(t, error);
+      }
+    }
+    r->armed = true;
+    w->arm = (uint8_t)((w->arm + 1) % w->depth);
+    w->armed++;
+  }
+  return TRANSPORT_OK;
+}
+
+static transport_status_t win32_read_result(transport_t* t, size_t* bytes) {
+  win32_transport_t* w = (win32_transport_t*)t->impl;
+  win32_read_t* r = &w->reads[w->next];
+  DWORD transferred = 0;
+
+  if (w->armed == 0) {
+    return TRANSPORT_PENDING;
+  }
+
+  BOOL done = GetOverlappedResult(w->handle, &r->ov, &transferred, FALSE);
+  DWORD error = done ? ERROR_SUCCESS : GetLastError();
+  if (error == ERROR_IO_INCOMPLETE) {
+    return TRANSPORT_PENDING;
+  }
+
+  // Hand the buffer over as it is, it is re-armed by the next read_start
+  r->armed = false;
+  w->armed--;
+  w->next = (uint8_t)((w->next + 1) % w->depth);
+  t->read_event = w->reads[w->next].ov.hEvent;
+  if (!done) {
+    return win32_classify(t, error);
+  }
+
+  t->read_data = r->buf;
+  *bytes = transferred;
+  return TRANSPORT_OK;
+}
+
+static transport_status_t win32_write(transport_t* t,
+                                      const uint8_t* data,
+                                      size_t length,
+                                      uint32_t timeout_ms) {
+  win32_transport_t* w = (win32_transport_t*)t->impl;
+  DWORD written;
+
+  stats_count_io(STATS_IO_CALL, 3);
+  stats_count_io(STATS_IO_WAIT, 1);
+  ResetEvent(w->ov_write.hEvent);
+  if (!WriteFile(w->handle, data, (DWORD)length, &written, &w->ov_write) &&
+      GetLastError() != ERROR_IO_PENDING) {
+    return win32_classify(t, GetLastError());
+  }
+
+  if (WaitForSingleObject(w->ov_write.hEvent, timeout_ms) != WAIT_OBJECT_0) {
+    // The OVERLAPPED must not be reused while the write is still pending
+    CancelIoEx(w->handle, &w->ov_write);
+    GetOverlappedResult(w->handle, &w->ov_write, &written, TRUE);
+    t->last_error = ERROR_TIMEOUT;
+    return TRANSPORT_TIMEOUT;
+  }
+
+  if (!GetOverlappedResult(w->handle, &w->ov_write, &written, FALSE)) {
+    return win32_classify(t, GetLastError());
+  }
+  return TRANSPORT_OK;
+}
+
+// The waiting win32_write() sees the aborted write as a disconnect
+static void win32_cancel_write(transport_t* t) {
+  win32_transport_t* w = (win32_transport_t*)t->impl;
+
+  CancelIoEx(w->handle, &w->ov_write);
+}
+
+const transport_ops_t transport_win32_ops = {
+    .name = "win32",
+    .open = win32_open,
+    .read_start = win32_read_start,
+    .read_result = win32_read_result,
+    .write = win32_write,
+    .cancel_write = win32_cancel_write,
+    .close = win32_close,
+};
@@ -3,66 +3,364 @@
 #include <windows.h>
 
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "dprintf.h"
 
-static long dbg_buf_lock_init;
-static CRITICAL_SECTION dbg_buf_lock;
-static char dbg_buf[16384];
-static size_t dbg_buf_pos;
+/* Every thread that logs gets a single-producer ring of fixed-size message
+   slots, claimed on its first message and released when the thread exits
+   (through a fiber local storage callback). A released ring is handed to a
+   new thread once the flusher has emptied it, so short-lived threads such as
+   thread pool callbacks do not use the rings up. The flusher thread is the
+   only consumer: it merges the rings in global sequence order and hands them
+   to OutputDebugStringA in batches, so a slow debugger only ever stalls the
+   flusher. */
+
+#define DLOG_RINGS 16
+#define DLOG_SLOTS 256       // Per ring, power of two; fits mu3_io_dump_stats
+#define DLOG_LINE 244        // Longer messages are truncated
+#define DLOG_FLUSH_MS 20     // Flusher period while the rings are quiet
+#define DLOG_BATCH 4000      // Bytes per OutputDebugStringA call
+
+typedef struct {
+    long seq;
+    unsigned short len;
+    char text[DLOG_LINE];
+} dlog_msg_t;
+
+typedef struct {
+    volatile long head;      // Written by the owning thread only
+    char pad0[60];
+    volatile long tail;      // Written by the flusher only
+    volatile long released;  // Owning thread exited, reusable once drained
+    char pad1[56];
+    dlog_msg_t msgs[DLOG_SLOTS];
+} dlog_ring_t;
+
+volatile long dprintf_level = DLOG_INFO;
+
+static volatile long dlog_init_state;
+static DWORD dlog_fls = FLS_OUT_OF_INDEXES;
+static CRITICAL_SECTION dlog_drain_lock;  // Consumers only, never producers
+static HANDLE dlog_wake;
+static HANDLE dlog_flusher;
+
+static dlog_ring_t dlog_rings[DLOG_RINGS];
+static volatile long dlog_rings_claimed;
+static volatile long dlog_seq;
+static volatile long dlog_dropped;
+static long dlog_dropped_reported;
+
+static DWORD WINAPI dlog_flusher_proc(LPVOID param);
+static void dlog_atexit(void);
+static void WINAPI dlog_ring_release(PVOID data);
+
+static void dlog_init(void)
+{
+    long state;
+
+    /* Static constructors in C are difficult to do in a way that works under
+       both GCC and MSVC, so we have to use atomic ops to ensure that the
+       logger is correctly initialized instead. */
+
+    do {
+        state = InterlockedCompareExchange(&dlog_init_state, 1, 0);
+
+        if (state == 0) {
+            /* We won the init race, global variable is now set to 1, other
+               threads will spin until it becomes -1. */
+            dlog_fls = FlsAlloc(dlog_ring_release);
+            InitializeCriticalSection(&dlog_drain_lock);
+            dlog_wake = CreateEventA(NULL, FALSE, FALSE, NULL);
+            if (dlog_wake != NULL) {
+                dlog_flusher = CreateThread(
+                        NULL, 0, dlog_flusher_proc, NULL, 0, NULL);
+            }
+            atexit(dlog_atexit);
+            InterlockedExchange(&dlog_init_state, -1);
+            state = -1;
+        }
+    } while (state >= 0);
+}
+
+/* Runs on a thread that exits, with the ring it owned */
+static void WINAPI dlog_ring_release(PVOID data)
+{
+    dlog_ring_t *ring = (dlog_ring_t *) data;
+
+    if (ring != NULL) {
+        InterlockedExchange(&ring->released, 1);
+
+        /* Drain it soon, so that the next new thread can have it */
+        if (dlog_wake != NULL) {
+            SetEvent(dlog_wake);
+        }
+    }
+}
+
+/* A ring released by a thread that exited, once its messages are out */
+static dlog_ring_t *dlog_reuse_ring(void)
+{
+    long claimed = dlog_rings_claimed;
+    long i;
+
+    if (claimed > DLOG_RINGS) {
+        claimed = DLOG_RINGS;
+    }
+
+    for (i = 0; i < claimed; i++) {
+        dlog_ring_t *ring = &dlog_rings[i];
+
+        /* Nobody writes a released ring, so once empty it stays empty */
+        if (ring->released &&
+                InterlockedCompareExchange(&ring->tail, 0, 0) == ring->head &&
+                InterlockedCompareExchange(&ring->released, 0, 1) == 1) {
+            return ring;
+        }
+    }
+
+    return NULL;
+}
+
+static dlog_ring_t *dlog_thread_ring(void)
+{
+    dlog_ring_t *ring;
+    long index;
+
+    if (dlog_fls == FLS_OUT_OF_INDEXES) {
+        return NULL;
+    }
+
+    ring = (dlog_ring_t *) FlsGetValue(dlog_fls);
+
+    if (ring != NULL) {
+        return ring;
+    }
+
+    ring = dlog_reuse_ring();
+
+    if (ring == NULL) {
+        index = InterlockedIncrement(&dlog_rings_claimed) - 1;
+
+        if (index >= DLOG_RINGS) {
+            /* Keep the count from wrapping around to a valid index */
+            InterlockedExchange(&dlog_rings_claimed, DLOG_RINGS);
+
+            return NULL;
+        }
+
+        ring = &dlog_rings[index];
+    }
+
+    FlsSetValue(dlog_fls, ring);
+
+    return ring;
+}
+
+/* Oldest message of all rings, NULL if they are empty. Caller holds the
+   drain lock. */
+static dlog_msg_t *dlog_oldest(dlog_ring_t **oldest_ring)
+{
+    dlog_msg_t *oldest = NULL;
+    long claimed = dlog_rings_claimed;
+    long i;
+
+    if (claimed > DLOG_RINGS) {
+        claimed = DLOG_RINGS;
+    }
+
+    for (i = 0; i < claimed; i++) {
+        dlog_ring_t *ring = &dlog_rings[i];
+        long tail = ring->tail;
+        dlog_msg_t *msg;
+
+        if (InterlockedCompareExchange(&ring->head, 0, 0) == tail) {
+            continue;
+        }
+
+        msg = &ring->msgs[tail & (DLOG_SLOTS - 1)];
+
+        if (oldest == NULL ||
+                (long) ((unsigned long) msg->seq -
+                        (unsigned long) oldest->seq) < 0) {
+            oldest = msg;
+            *oldest_ring = ring;
+        }
+    }
+
+    return oldest;
+}
+
+/* Write out everything in the rings. With wait false, give up if another
+   thread is already draining (or died doing so, at process exit). */
+static void dlog_drain(bool wait)
+{
+    char batch[DLOG_BATCH + DLOG_LINE + 1];
+    size_t pos = 0;
+    dlog_ring_t *ring;
+    dlog_msg_t *msg;
+    long dropped;
+
+    if (wait) {
+        EnterCriticalSection(&dlog_drain_lock);
+    } else if (!TryEnterCriticalSection(&dlog_drain_lock)) {
+        return;
+    }
+
+    while ((msg = dlog_oldest(&ring)) != NULL) {
+        memcpy(batch + pos, msg->text, msg->len);
+        pos += msg->len;
+        InterlockedExchange(&ring->tail, ring->tail + 1);
+
+        if (pos >= DLOG_BATCH) {
+            batch[pos] = '\0';
+            OutputDebugStringA(batch);
+            pos = 0;
+        }
+    }
+
+    dropped = dlog_dropped;
+
+    if (dropped != dlog_dropped_reported) {
+        pos += snprintf(batch + pos, sizeof(batch) - pos,
+                "dprintf: %ld messages dropped\n",
+                dropped - dlog_dropped_reported);
+        dlog_dropped_reported = dropped;
+    }
+
+    if (pos > 0) {
+        batch[pos] = '\0';
+        OutputDebugStringA(batch);
+    }
+
+    LeaveCriticalSection(&dlog_drain_lock);
+}
+
+static DWORD WINAPI dlog_flusher_proc(LPVOID param)
+{
+    (void) param;
+
+    for (;;) {
+        WaitForSingleObject(dlog_wake, DLOG_FLUSH_MS);
+        dlog_drain(true);
+    }
+
+    return 0;
+}
+
+static void dlog_atexit(void)
+{
+    dlog_drain(false);
+}
 
 void dprintf(const char *fmt, ...)
 {
     va_list ap;
 
     va_start(ap, fmt);
-    dprintfv(fmt, ap);
+    dlogv(DLOG_INFO, fmt, ap);
     va_end(ap);
 }
 
 void dprintfv(const char *fmt, va_list ap)
 {
-    long init;
+    dlogv(DLOG_INFO, fmt, ap);
+}
 
-    /* Static constructors in C are difficult to do in a way that works under
-       both GCC and MSVC, so we have to use atomic ops to ensure that the
-       buffer mutex is correctly initialized instead. */
+void dlogf(int level, const char *fmt, ...)
+{
+    va_list ap;
 
-    do {
-        init = InterlockedCompareExchange(&dbg_buf_lock_init, 0, 1);
+    va_start(ap, fmt);
+    dlogv(level, fmt, ap);
+    va_end(ap);
+}
 
-        if (init == 0) {
-            /* We won the init race, global variable is now set to 1, other
-               threads will spin until it becomes -1. */
-            InitializeCriticalSection(&dbg_buf_lock);
-            dbg_buf_lock_init = -1;
-            init = -1;
+void dlogv(int level, const char *fmt, va_list ap)
+{
+    dlog_ring_t *ring;
+    dlog_msg_t *msg;
+    long head;
+    int len;
+
+    if (!dprintf_enabled(level)) {
+        return;
+    }
+
+    if (dlog_init_state != -1) {
+        dlog_init();
+    }
+
+    ring = dlog_thread_ring();
+
+    if (ring == NULL) {
+        InterlockedIncrement(&dlog_dropped);
+
+        return;
+    }
+
+    head = ring->head;
+
+    if (head - InterlockedCompareExchange(&ring->tail, 0, 0) >= DLOG_SLOTS) {
+        InterlockedIncrement(&dlog_dropped);
+        if (dlog_wake != NULL) {
+            SetEvent(dlog_wake);
         }
-    } while (init >= 0);
 
-    EnterCriticalSection(&dbg_buf_lock);
+        return;
+    }
+
+    msg = &ring->msgs[head & (DLOG_SLOTS - 1)];
+    len = vsnprintf(msg->text, sizeof(msg->text), fmt, ap);
+
+    if (len < 0) {
+        len = 0;
+    } else if (len >= (int) sizeof(msg->text)) {
+        /* Truncated: keep the line break so the next message starts on a
+           line of its own */
+        len = sizeof(msg->text) - 1;
+        msg->text[len - 1] = '\n';
+    }
+
+    msg->len = (unsigned short) len;
+    msg->seq = InterlockedIncrement(&dlog_seq);
 
-    dbg_buf_pos += vsnprintf_s(
-            dbg_buf + dbg_buf_pos,
-            sizeof(dbg_buf) - dbg_buf_pos,
-            sizeof(dbg_buf) - dbg_buf_pos - 1,
-            fmt,
-            ap);
+    /* Publish the slot to the flusher */
+    InterlockedExchange(&ring->head, head + 1);
 
-    if (dbg_buf_pos + 1 > sizeof(dbg_buf)) {
-        abort();
+    if (dlog_flusher == NULL) {
+        /* No flusher thread: write it out here, like a plain dprintf */
+        dlog_drain(true);
+    } else if (head + 1 - ring->tail >= DLOG_SLOTS / 2) {
+        SetEvent(dlog_wake);
     }
+}
 
-    if (strchr(dbg_buf, '\n') != NULL) {
-        OutputDebugStringA(dbg_buf);
-        dbg_buf_pos = 0;
-        dbg_buf[0] = '\0';
+void dprintf_set_level(int level)
+{
+    if (level < DLOG_ERROR) {
+        level = DLOG_ERROR;
+    } else if (level >= DLOG_LEVELS) {
+        level = DLOG_LEVELS - 1;
     }
 
-    LeaveCriticalSection(&dbg_buf_lock);
+    InterlockedExchange(&dprintf_level, level);
+}
+
+void dprintf_flush(void)
+{
+    if (dlog_init_state == -1) {
+        dlog_drain(true);
+    }
+}
+
+unsigned long dprintf_dropped(void)
+{
+    return (unsigned long) InterlockedCompareExchange(&dlog_dropped, 0, 0);
 }
 
 void dwprintf(const wchar_t *fmt, ...)
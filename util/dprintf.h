@@ -5,18 +5,107 @@
 
 #ifdef __GNUC__
 #define DPRINTF_CHK __attribute__(( format(printf, 1, 2) ))
+#define DLOG_CHK __attribute__(( format(printf, 2, 3) ))
 #else
 #define DPRINTF_CHK
+#define DLOG_CHK
 #endif
 
-#ifndef NDEBUG
+/* Log levels. dprintf() logs at DLOG_INFO; dlog() skips the formatting of
+   messages above the current level, so DLOG_DEBUG and DLOG_TRACE messages
+   cost one load and one compare while they are off. */
+enum {
+    DLOG_ERROR,
+    DLOG_WARN,
+    DLOG_INFO,
+    DLOG_DEBUG,
+    DLOG_TRACE,
+    DLOG_LEVELS
+};
+
+#if !defined(_WIN32)
+/* Host-native builds: log straight to stderr. stdio.h goes first so that its
+   POSIX dprintf(int, ...) declaration is not hit by the macro. */
+#include <stdio.h>
+#define dprintf(...) fprintf(stderr, __VA_ARGS__)
+#define dprintfv(fmt, ap) vfprintf(stderr, fmt, ap)
+#define dprintf_enabled(level) ((level) <= DLOG_INFO)
+#define dlog(level, ...)                    \
+    do {                                    \
+        if (dprintf_enabled(level)) {       \
+            fprintf(stderr, __VA_ARGS__);   \
+        }                                   \
+    } while (0)
+#define dprintf_set_level(level) ((void)(level))
+#define dprintf_flush()
+#define dprintf_dropped() 0u
+#elif !defined(NDEBUG)
+/* Messages are formatted on the calling thread into a ring owned by that
+   thread, and written out by a background flusher, so logging never takes a
+   lock or waits for OutputDebugStringA. A message that finds its ring full
+   (or finds no free ring) is dropped and counted. */
+extern volatile long dprintf_level;
+
+#define dprintf_enabled(level) ((long)(level) <= dprintf_level)
+#define dlog(level, ...)                        \
+    do {                                        \
+        if (dprintf_enabled(level)) {           \
+            dlogf(level, __VA_ARGS__);          \
+        }                                       \
+    } while (0)
+
 void dprintf(const char *fmt, ...) DPRINTF_CHK;
 void dprintfv(const char *fmt, va_list ap);
+void dlogf(int level, const char *fmt, ...) DLOG_CHK;
+void dlogv(int level, const char *fmt, va_list ap);
 void dwprintf(const wchar_t *fmt, ...);
 void dwprintfv(const wchar_t *fmt, va_list ap);
+
+/* Messages above level are skipped from now on. */
+void dprintf_set_level(int level);
+
+/* Write out everything logged so far, on the calling thread. */
+void dprintf_flush(void);
+
+/* Messages dropped because their thread's ring was full or no ring was
+   left for the thread. */
+unsigned long dprintf_dropped(void);
 #else
 #define dprintf(...)
 #define dprintfv(fmt, ap)
 #define dwprintf(...)
 #define dwprintfv(fmt, ap)
+#define dprintf_enabled(level) 0
+#define dlog(level, ...)
+#define dprintf_set_level(level) ((void)(level))
+#define dprintf_flush()
+#define dprintf_dropped() 0u
 #endif
+
+/* Parse a level name (error, warn, info, debug, trace) or number. Returns
+   -1 if it is neither. */
+static inline int dprintf_parse_level(const char *name)
+{
+    static const char *const names[DLOG_LEVELS] = {
+        "error", "warn", "info", "debug", "trace",
+    };
+
+    if (name[0] >= '0' && name[0] < '0' + DLOG_LEVELS && name[1] == '\0') {
+        return name[0] - '0';
+    }
+
+    for (int i = 0; i < DLOG_LEVELS; i++) {
+        const char *a = name;
+        const char *b = names[i];
+
+        while (*b != '\0' && (*a | 0x20) == *b) {
+            a++;
+            b++;
+        }
+        if (*a == '\0' && *b == '\0') {
+            return i;
+        }
+    }
+
+    return -1;
+}
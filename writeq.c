@@ -0,0 +1,218 @@
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util/dprintf.h"
+
+#include "stats.h"
+#include "writeq.h"
+
+typedef struct {
+  uint32_t key;
+  size_t length;
+  uint8_t report[WRITEQ_REPORT_SIZE];
+} writeq_slot_t;
+
+// FIFO of pending reports, guarded by writeq_lock. The lock is only held
+// for the copy, never across device I/O.
+static CRITICAL_SECTION writeq_lock;
+static writeq_slot_t writeq_slots[WRITEQ_DEPTH];
+static size_t writeq_head = 0;  // Oldest pending slot
+static size_t writeq_count = 0;
+
+static HANDLE writeq_event = NULL;  // Auto-reset, signalled on submit
+static HANDLE writeq_thread = NULL;
+static writeq_write_fn writeq_write = NULL;
+static writeq_wake_fn writeq_wake = NULL;  // Consumer mode, else the thread
+static volatile LONG writeq_started = 0;
+static bool writeq_running = false;
+
+static writeq_stats_t writeq_stats;
+
+static bool writeq_pop(writeq_slot_t* out) {
+  bool popped = false;
+
+  EnterCriticalSection(&writeq_lock);
+  if (writeq_count > 0) {
+    *out = writeq_slots[writeq_head];
+    writeq_head = (writeq_head + 1) % WRITEQ_DEPTH;
+    writeq_count--;
+    popped = true;
+  }
+  LeaveCriticalSection(&writeq_lock);
+
+  return popped;
+}
+
+bool writeq_take(uint8_t* report, size_t* length) {
+  writeq_slot_t slot;
+
+  if (!writeq_pop(&slot)) {
+    return false;
+  }
+  memcpy(report, slot.report, slot.length);
+  *length = slot.length;
+  return true;
+}
+
+void writeq_done(HRESULT hr) {
+  if (hr == S_OK) {
+    InterlockedIncrement(&writeq_stats.completed);
+  } else if (hr == HRESULT_FROM_WIN32(ERROR_TIMEOUT)) {
+    InterlockedIncrement(&writeq_stats.timed_out);
+  } else {
+    InterlockedIncrement(&writeq_stats.failed);
+  }
+}
+
+static DWORD WINAPI writeq_thread_proc(LPVOID param) {
+  writeq_slot_t slot;
+  (void)param;
+
+  dprintf("SimGEKI: Output worker started.\n");
+
+  for (;;) {
+    WaitForSingleObject(writeq_event, INFINITE);
+    stats_count_io(STATS_IO_CALL, 1);
+    stats_count_io(STATS_IO_WAIT, 1);
+
+    while (writeq_pop(&slot)) {
+      writeq_done(writeq_write(slot.report, slot.length));
+    }
+  }
+
+  return 0;
+}
+
+HRESULT writeq_init(writeq_write_fn write_fn) {
+  if (InterlockedCompareExchange(&writeq_started, 1, 0) != 0) {
+    return S_OK;
+  }
+
+  InitializeCriticalSection(&writeq_lock);
+  writeq_write = write_fn;
+
+  writeq_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (writeq_event == NULL) {
+    return HRESULT_FROM_WIN32(GetLastError());
+  }
+
+  writeq_thread = CreateThread(NULL, 0, writeq_thread_proc, NULL, 0, NULL);
+  if (writeq_thread == NULL) {
+    HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+    CloseHandle(writeq_event);
+    writeq_event = NULL;
+    return hr;
+  }
+
+  writeq_running = true;
+  return S_OK;
+}
+
+HRESULT writeq_init_consumer(writeq_wake_fn wake) {
+  if (InterlockedCompareExchange(&writeq_started, 1, 0) != 0) {
+    return S_OK;
+  }
+
+  InitializeCriticalSection(&writeq_lock);
+  writeq_wake = wake;
+  writeq_running = true;
+  return S_OK;
+}
+
+HRESULT writeq_submit(const void* report, size_t length, uint32_t key) {
+  HRESULT hr = S_OK;
+
+  if (!writeq_running || report == NULL || length == 0 ||
+      length > WRITEQ_REPORT_SIZE) {
+    return S_FALSE;
+  }
+
+  EnterCriticalSection(&writeq_lock);
+
+  writeq_slot_t* slot = NULL;
+  if ((key & WRITEQ_TAG) == 0) {
+    for (size_t i = 0; i < writeq_count; i++) {
+      writeq_slot_t* pending = &writeq_slots[(writeq_head + i) % WRITEQ_DEPTH];
+      if (pending->key == key) {
+        slot = pending;
+        InterlockedIncrement(&writeq_stats.coalesced);
+        break;
+      }
+    }
+  }
+
+  if (slot == NULL) {
+    if (writeq_count == WRITEQ_DEPTH) {
+      InterlockedIncrement(&writeq_stats.rejected);
+      hr = S_FALSE;
+    } else {
+      slot = &writeq_slots[(writeq_head + writeq_count) % WRITEQ_DEPTH];
+      slot->key = key;
+      writeq_count++;
+      InterlockedIncrement(&writeq_stats.queued);
+    }
+  }
+
+  if (slot != NULL) {
+    memcpy(slot->report, report, length);
+    slot->length = length;
+  }
+
+  LeaveCriticalSection(&writeq_lock);
+
+  if (hr == S_OK) {
+    if (writeq_wake != NULL) {
+      writeq_wake();
+    } else {
+      stats_count_io(STATS_IO_CALL, 1);
+      SetEvent(writeq_event);
+    }
+  }
+  return hr;
+}
+
+bool writeq_pending(uint32_t key) {
+  bool pending = false;
+
+  if (!writeq_running) {
+    return false;
+  }
+
+  EnterCriticalSection(&writeq_lock);
+  for (size_t i = 0; i < writeq_count && !pending; i++) {
+    pending = writeq_slots[(writeq_head + i) % WRITEQ_DEPTH].key == key;
+  }
+  LeaveCriticalSection(&writeq_lock);
+
+  return pending;
+}
+
+void writeq_clear(void) {
+  if (!writeq_running) {
+    return;
+  }
+
+  EnterCriticalSection(&writeq_lock);
+  writeq_head = 0;
+  writeq_count = 0;
+  LeaveCriticalSection(&writeq_lock);
+}
+
+void writeq_get_stats(writeq_stats_t* stats) {
+  if (stats == NULL) {
+    return;
+  }
+
+  stats->queued = InterlockedCompareExchange(&writeq_stats.queued, 0, 0);
+  stats->coalesced =
+      InterlockedCompareExchange(&writeq_stats.coalesced, 0, 0);
+  stats->completed =
+      InterlockedCompareExchange(&writeq_stats.completed, 0, 0);
+  stats->timed_out =
+      InterlockedCompareExchange(&writeq_stats.timed_out, 0, 0);
+  stats->failed = InterlockedCompareExchange(&writeq_stats.failed, 0, 0);
+  stats->rejected = InterlockedCompareExchange(&writeq_stats.rejected, 0, 0);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <windows.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of pending output reports
+#define WRITEQ_DEPTH 16
+// Largest report the queue can carry
+#define WRITEQ_REPORT_SIZE 64
+
+// Key bit: the report is only tagged with the key, for writeq_pending(),
+// and never merged with other reports
+#define WRITEQ_TAG 0x80000000u
+// Reports submitted with this key are never merged with other reports
+#define WRITEQ_NO_COALESCE 0xFFFFFFFFu
+
+typedef struct {
+  LONG queued;     // Reports accepted into the queue
+  LONG coalesced;  // Reports that replaced a pending report with the same key
+  LONG completed;  // Reports the device accepted
+  LONG timed_out;  // Reports cancelled after the write timeout
+  LONG failed;     // Reports that failed or were not sent (disconnected)
+  LONG rejected;   // Reports refused because the queue was full
+} writeq_stats_t;
+
+/* Performs one blocking write on the worker thread. Must return S_OK when
+   the device accepted the report, HRESULT_FROM_WIN32(ERROR_TIMEOUT) when the
+   write timed out, and anything else for a failed write. */
+typedef HRESULT (*writeq_write_fn)(const uint8_t* report, size_t length);
+
+/* Called by writeq_submit() after queuing, instead of waking the worker. */
+typedef void (*writeq_wake_fn)(void);
+
+/* Start the output worker. Safe to call more than once; the first
+   writeq_init() or writeq_init_consumer() call wins. */
+HRESULT writeq_init(writeq_write_fn write_fn);
+
+/* Start without a worker thread, for an I/O engine that issues the writes
+   itself: wake tells it that reports were queued, it takes them with
+   writeq_take() and reports each outcome with writeq_done(). */
+HRESULT writeq_init_consumer(writeq_wake_fn wake);
+
+/* Consumer mode: take the oldest pending report (up to WRITEQ_REPORT_SIZE
+   bytes). Returns false if none is pending. */
+bool writeq_take(uint8_t* report, size_t* length);
+
+/* Consumer mode: count the outcome of a report, with the HRESULTs of
+   writeq_write_fn. */
+void writeq_done(HRESULT hr);
+
+/* Queue a report for the worker and return immediately. If a report with the
+   same coalesce key is still pending it is overwritten in place, so only the
+   newest frame per key is ever sent (unless the key has WRITEQ_TAG set).
+
+   Returns S_OK when queued, S_FALSE when the queue is full or not started. */
+HRESULT writeq_submit(const void* report, size_t length, uint32_t key);
+
+/* Is a report submitted with key still waiting in the queue? */
+bool writeq_pending(uint32_t key);
+
+/* Drop every pending report, e.g. after the device went away. */
+void writeq_clear(void);
+
+void writeq_get_stats(writeq_stats_t* stats);